@@ -0,0 +1,40 @@
+#ifndef __ALIAS_TABLE_H__
+#define __ALIAS_TABLE_H__
+
+#include <vector>
+
+#include "util.h"
+
+// Walker's alias method with Vose's construction - after an O(n) setup a discrete distribution over n outcomes is
+// sampled in O(1) with two uniform words: the first one picks a bin and the second one decides between the outcome
+// of the bin and its alias
+class AliasTable {
+public:
+	// builds the table from non-negative weights, returns false if there are no outcomes or all weights are zero
+	bool build(const float * weights, int count);
+
+	// returns an outcome from two independent uniformly distributed 32-bit words
+	int sample(uint32 binWord, uint32 aliasWord) const noexcept {
+		const int bin = static_cast<int>((static_cast<uint64>(binWord) * bins.size()) >> 32);
+		const Bin& b = bins[bin];
+		return (aliasWord < b.threshold ? bin : b.alias);
+	}
+
+	int getCount() const noexcept {
+		return static_cast<int>(bins.size());
+	}
+
+	size_t getMemoryUsage() const noexcept {
+		return bins.size() * sizeof(Bin);
+	}
+
+private:
+	struct Bin {
+		uint32 threshold; //!< the probability of the own outcome of the bin scaled to 2^32
+		int32 alias; //!< the outcome of the rest of the bin
+	};
+
+	std::vector<Bin> bins;
+};
+
+#endif // __ALIAS_TABLE_H__
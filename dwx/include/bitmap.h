@@ -4,6 +4,7 @@
 #include <functional>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "color.h"
 
 // point in discrete 2d space
@@ -92,6 +93,16 @@ enum UpscaleFiltering {
 	UF_BICUBIC,               //!< bicubic upscaling
 };
 
+template<class ColorType>
+class Pixelmap;
+
+// the downscaled levels of a pixelmap, built on demand and shared by the copies made after it was first requested
+template<class ColorType>
+struct PixelmapPyramid {
+	std::mutex levelsMutex;
+	std::vector<std::shared_ptr<const Pixelmap<ColorType> > > levels; //!< the level i + 1 is at index i
+};
+
 template<class ColorType = Color>
 class Pixelmap {
 	static inline bool remapCoord(float& c, int bound, EdgeFillType edge) noexcept;
@@ -99,8 +110,14 @@ protected:
 	int width, height;
 	// TODO make Bitmap data a shared ptr, so bitmaps can be easily shared
 	ColorType* data;
+	// dropped on every change of the pixels, so the changed pixelmap no longer shares the levels of its copies
+	mutable std::shared_ptr<PixelmapPyramid<ColorType> > pyramid;
 
 	void copy(const Pixelmap& rhs) noexcept;
+	std::shared_ptr<PixelmapPyramid<ColorType> > getPyramid() const; //!< creates the shared pyramid on first use
+	void invalidatePyramid() noexcept {
+		pyramid.reset();
+	}
 public:
 	Pixelmap() noexcept; //!< Generates an empty bitmap
 	Pixelmap(int width, int height, const ColorType * pixelValues = nullptr) noexcept; //!< Generates bitmap with specified dimensions and initializes it with the buffer (if supplied)
@@ -130,7 +147,8 @@ public:
 
 	void setPixel(int x, int y, const ColorType& col) noexcept; //!< Sets the pixel at coordinates (x, y)
 
-	ColorType* getDataPtr() const noexcept; //!< get the current data ptr - fastest data management for reading
+	const ColorType * getDataPtr() const noexcept; //!< get the current data ptr - fastest data management for reading
+	ColorType * getDataPtr() noexcept; //!< get the current data ptr for writing, drops the cached pyramid
 
 	ColorType * operator[](int row) noexcept;
 	const ColorType * operator[](int row) const noexcept;
@@ -166,9 +184,13 @@ public:
 	// relocates the pixelmap (0, 0) -> (x, y)
 	bool relocate(Pixelmap<ColorType>& relocated, const int x, const int y) const;
 
-	// downscales the bitmap using fractions
-	template<class IntermediateColorType>
-	bool downscale(Pixelmap<ColorType>& downScaled, const int downWidth, const int downHeight) const;
+	// returns the pixelmap downscaled 2^level times by averaging the 2x2 blocks of the previous level, with the odd last
+	// row and column dropped; the levels are built on demand and kept until the pixels change
+	// returns nullptr if the level is less than 1 or empty; implemented only for Color
+	std::shared_ptr<const Pixelmap<ColorType> > getPyramidLevel(int level) const;
+
+	// returns the deepest level of the pyramid with at least the given dimensions (0 is the pixelmap itself)
+	int getPyramidLevelFor(int minWidth, int minHeight) const noexcept;
 
 	// upscales the bitmap using the provided upscale type
 	template<class IntermediateColorType>
@@ -192,6 +214,9 @@ public:
 
 using Bitmap = Pixelmap<>;
 
+template<>
+std::shared_ptr<const Bitmap> Bitmap::getPyramidLevel(int level) const;
+
 enum HistogramDataLayout {
 	HDL_CHANNEL = 0, //!< each channel is layed out in continuous memory
 	HDL_VALUE,       //!< channels are interleaved and each tuple of numChannels is close (may improve memory cache misses)
@@ -3,102 +3,197 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include "util.h"
 #include "dcomplex.h"
+#include "lru_cache.h"
 
+// the floating point precision used for the fft calculations
+enum FFTPrecision {
+	FP_DOUBLE = 0,
+	FP_FLOAT,
+	FP_COUNT,
+};
+
+// returns the smallest size not less than n, which factors only to 2, 3 and 5
+int fftFriendlySize(int n);
+
+template<class T>
+struct FFTPrecisionOf;
+
+template<>
+struct FFTPrecisionOf<double> {
+	static const FFTPrecision value = FP_DOUBLE;
+};
+
+template<>
+struct FFTPrecisionOf<float> {
+	static const FFTPrecision value = FP_FLOAT;
+};
+
+// chooses the stage radices of the 1D ffts - by default they are factored greedily,
+// but when measuring is enabled the alternative factorizations of each new size are benchmarked
+// and the fastest one is remembered in the wisdom, which can be persisted to a file
+class FFTPlanner {
+public:
+	FFTPlanner();
+	FFTPlanner(const FFTPlanner&) = delete;
+	FFTPlanner& operator=(const FFTPlanner&) = delete;
+
+	// returns the radices of the stages for an fft of the given size and precision
+	std::vector<int> getRadices(int nfft, FFTPrecision precision);
+
+	// enables or disables the benchmarking of sizes missing in the wisdom
+	void setMeasure(bool enabled);
+	bool getMeasure() const;
+
+	// loads the wisdom from the file (if it exists), enables measuring and saves every newly measured size to the same file
+	bool setWisdomFile(const std::string& path);
+
+	// loads the wisdom entries from a file, returns false if the file could not be read
+	bool loadWisdom(const std::string& path);
+
+	// writes all wisdom entries to a file, returns false if the file could not be written
+	bool saveWisdom(const std::string& path) const;
+
+	// the default greedy factorization - 4s first, then 2, 3, 5 and so on
+	static std::vector<int> greedyRadices(int nfft);
+
+	// all the factorizations which will be benchmarked for the size
+	static std::vector<std::vector<int> > candidateRadices(int nfft);
+
+	static FFTPlanner& get();
+private:
+	// benchmarks all candidate factorizations and returns the fastest one
+	template<class T>
+	static std::vector<int> measure(int nfft);
+
+	bool saveWisdomUnlocked(const std::string& path) const;
+
+	static uint64 wisdomKey(int nfft, FFTPrecision precision) noexcept;
+
+	mutable std::mutex mutex;
+	bool measureEnabled;
+	std::string wisdomPath; //!< if not empty the wisdom is saved to it after each measurement
+	std::unordered_map<uint64, std::vector<int> > wisdom;
+};
+
+template<class T = double>
 class ButterflyFFT {
 public:
+	using ComplexType = TComplex<T>;
+
+	// uses the radices chosen by the planner
 	ButterflyFFT(const int _nfft, bool _inverse);
 
+	// uses the given stage radices, their product must be equal to nfft
+	ButterflyFFT(const int _nfft, bool _inverse, const std::vector<int>& radices);
+
 	// transforms a 1D function to the signal domain
-	void transform(const Complex * src, Complex * dest) const;
+	void transform(const ComplexType * src, ComplexType * dest) const;
 
 	// a more generic function using specified strides
-	void transform(const Complex * src, Complex * dest, const int inStride) const;
+	void transform(const ComplexType * src, ComplexType * dest, const int inStride) const;
+
+	// returns an estimate of the memory used by the configuration in bytes
+	size_t getMemoryUsage() const noexcept;
 private:
-	// fills twiddles as a preparation for the work later
-	void prepare();
+	// fills twiddles and the stages as a preparation for the work later
+	void prepare(const std::vector<int>& radices);
 
-	// will be specialized for 2, 3, 4 and 5 strides
-	template<int n>
-	void butterfly(Complex * fOut, const int fStride, const int m) const;
+	// specialized butterflies for radix 2, 3, 4 and 5
+	void butterfly2(ComplexType * fOut, const int fStride, const int m) const;
+	void butterfly3(ComplexType * fOut, const int fStride, const int m) const;
+	void butterfly4(ComplexType * fOut, const int fStride, const int m) const;
+	void butterfly5(ComplexType * fOut, const int fStride, const int m) const;
 
 	// will be used for all m that are not divisible by 2,3,4 or 5
-	void butterflyGeneric(Complex * fOut, const int fStride, const int m, const int p) const;
+	void butterflyGeneric(ComplexType * fOut, const int fStride, const int m, const int p) const;
 
 	// makes the actual calls to the buttefly functions and recursively calls itself for factored m
-	void work(const int stage, Complex * fOut, const Complex * f, const int fStride, const int inStride) const;
+	void work(const int stage, ComplexType * fOut, const ComplexType * f, const int fStride, const int inStride) const;
 
 	int nfft;
 	bool inverse;
-	std::vector<Complex> twiddles;
+	std::vector<ComplexType> twiddles;
 	std::vector<int> stageRadix;
 	std::vector<int> stageRemainder;
 };
 
-template<int nd = 2>
+template<int nd = 2, class T = double>
 class MultiDimFFT {
 public:
+	using ComplexType = TComplex<T>;
+
 	MultiDimFFT(const std::vector<int>& _dims, bool _inverse);
 	~MultiDimFFT();
 	MultiDimFFT(const MultiDimFFT&) = delete;
 	MultiDimFFT& operator=(const MultiDimFFT&) = delete;
 
-	void transform(const Complex * fIn, Complex * fOut) const;
+	// the transform is reentrant - intermediate results are stored in the scratch buffer,
+	// which must hold at least getScratchSize() elements; if it is nullptr a temporary one is allocated
+	void transform(const ComplexType * fIn, ComplexType * fOut, ComplexType * scratch = nullptr) const;
+
+	// returns the number of elements needed for the scratch buffer of the transform
+	int getScratchSize() const noexcept;
+
+	// returns an estimate of the memory used by the plan in bytes
+	size_t getMemoryUsage() const noexcept;
 
 private:
 	int dimProd;
 	const bool inverse;
 	const std::vector<int> dims;
-	const ButterflyFFT * fftConfig[nd];
-	Complex * tmpBuf; //!< used for intemediate calculations
+	const ButterflyFFT<T> * fftConfig[nd];
 };
 
 using FFT2D = MultiDimFFT<2>;
+using FFT2DF = MultiDimFFT<2, float>;
 
-template<int nd>
-MultiDimFFT<nd>::MultiDimFFT(const std::vector<int>& _dims, bool _inverse)
+template<int nd, class T>
+MultiDimFFT<nd, T>::MultiDimFFT(const std::vector<int>& _dims, bool _inverse)
 	: dimProd(1)
 	, inverse(_inverse)
 	, dims(_dims)
 	, fftConfig{nullptr}
-	, tmpBuf(nullptr)
 {
 	DASSERT(dims.size() >= nd);
 	for (int i = 0; i < nd; ++i) {
 		const int dim = dims[i];
-		fftConfig[i] = new ButterflyFFT(dim, inverse);
+		fftConfig[i] = new ButterflyFFT<T>(dim, inverse);
 		dimProd *= dim;
 	}
-	tmpBuf = new Complex[dimProd];
 }
 
-template<int nd>
-MultiDimFFT<nd>::~MultiDimFFT() {
+template<int nd, class T>
+MultiDimFFT<nd, T>::~MultiDimFFT() {
 	for (int i = 0; i < nd; ++i) {
 		delete fftConfig[i];
 		fftConfig[i] = nullptr;
 	}
-	
-	// delete the tmpBuf as well
-	delete[] tmpBuf;
-	tmpBuf = nullptr;
 }
 
-template<int nd>
-inline void MultiDimFFT<nd>::transform(const Complex * fIn, Complex * fOut) const {
-	const Complex * bufIn = fIn;
-	Complex * bufOut = nullptr;
+template<int nd, class T>
+inline void MultiDimFFT<nd, T>::transform(const ComplexType * fIn, ComplexType * fOut, ComplexType * scratch) const {
+	std::unique_ptr<ComplexType[]> localScratch;
+	if (!scratch) {
+		localScratch.reset(new ComplexType[dimProd]);
+		scratch = localScratch.get();
+	}
+	const ComplexType * bufIn = fIn;
+	ComplexType * bufOut = nullptr;
 	// arrange it so that bufOut == fOut
 	if (nd & 1) {
 		bufOut = fOut;
 		if (fIn == fOut) {
-			memcpy(tmpBuf, fIn, dimProd * sizeof(Complex));
-			bufIn = tmpBuf;
+			memcpy(scratch, fIn, dimProd * sizeof(ComplexType));
+			bufIn = scratch;
 		}
 	} else {
-		bufOut = tmpBuf;
+		bufOut = scratch;
 	}
 
 	for (int d = 0; d < nd; ++d) {
@@ -110,37 +205,121 @@ inline void MultiDimFFT<nd>::transform(const Complex * fIn, Complex * fOut) cons
 		}
 
 		// toggle back and forth between the two buffers
-		if (bufOut == tmpBuf) {
+		if (bufOut == scratch) {
 			bufOut = fOut;
-			bufIn = tmpBuf;
+			bufIn = scratch;
 		} else {
-			bufOut = tmpBuf;
+			bufOut = scratch;
 			bufIn = fOut;
 		}
 	}
 }
 
+template<int nd, class T>
+inline int MultiDimFFT<nd, T>::getScratchSize() const noexcept {
+	return dimProd;
+}
+
+template<int nd, class T>
+inline size_t MultiDimFFT<nd, T>::getMemoryUsage() const noexcept {
+	size_t usage = sizeof(*this);
+	for (int i = 0; i < nd; ++i) {
+		usage += fftConfig[i]->getMemoryUsage();
+	}
+	return usage;
+}
+
+// the key of a cached fft plan - its dimensions and direction
 template<int nd>
-class CachedFFT {
-public:
-	std::vector<int> dims;
-	std::unique_ptr<MultiDimFFT<nd> > forward;
-	std::unique_ptr<MultiDimFFT<nd> > inverse;
+struct FFTPlanKey {
+	int dims[nd];
+	bool inverse;
+
+	bool operator==(const FFTPlanKey& rhs) const noexcept {
+		bool match = (inverse == rhs.inverse);
+		for (int i = 0; i < nd && match; ++i) {
+			match = (dims[i] == rhs.dims[i]);
+		}
+		return match;
+	}
 };
 
 template<int nd>
+struct FFTPlanKeyHash {
+	size_t operator()(const FFTPlanKey<nd>& key) const noexcept {
+		size_t h = (key.inverse ? 1 : 0);
+		for (int i = 0; i < nd; ++i) {
+			h = h * 1000003 + static_cast<size_t>(key.dims[i]);
+		}
+		return h;
+	}
+};
+
+// a thread safe cache of fft plans, bounded by a memory budget
+// plans are shared between the callers, so a plan evicted from the cache remains valid while it is used
+template<int nd, class T = double>
 class FFTCache {
 public:
-	FFTCache();
-	~FFTCache();
+	using FFTPtr = std::shared_ptr<const MultiDimFFT<nd, T> >;
+
+	static const size_t DefaultMemoryBudget = 64 << 20; //!< in bytes
+
+	FFTCache(size_t memoryBudget = DefaultMemoryBudget);
 	FFTCache(const FFTCache&) = delete;
 	FFTCache& operator=(const FFTCache&) = delete;
 
-	const MultiDimFFT<nd>& getFFT(const std::vector<int>& dims, bool inverse);
+	FFTPtr getFFT(const std::vector<int>& dims, bool inverse);
+
+	// sets the maximum memory in bytes held by the cached plans, least recently used plans are evicted first
+	void setMemoryBudget(size_t bytes);
+	size_t getMemoryBudget() const;
 
 	static FFTCache& get();
 private:
-	std::vector<CachedFFT<nd>* > cache;
+	LruCache<FFTPlanKey<nd>, MultiDimFFT<nd, T>, FFTPlanKeyHash<nd> > cache;
+};
+
+// the key of a cached spectrum - the name of the kind of source, the source values and the dimensions of the spectrum
+struct SpectrumKey {
+	std::string name;
+	std::vector<float> source;
+	int width;
+	int height;
+
+	bool operator==(const SpectrumKey& rhs) const noexcept {
+		return width == rhs.width && height == rhs.height && name == rhs.name && source == rhs.source;
+	}
+};
+
+struct SpectrumKeyHash {
+	size_t operator()(const SpectrumKey& key) const noexcept;
+};
+
+// a thread safe cache of computed spectra (like transformed filter kernels), bounded by a memory budget
+template<class T = double>
+class SpectrumCache {
+public:
+	using Spectrum = std::vector<TComplex<T> >;
+	using SpectrumPtr = std::shared_ptr<const Spectrum>;
+
+	static const size_t DefaultMemoryBudget = 128 << 20; //!< in bytes
+
+	SpectrumCache(size_t memoryBudget = DefaultMemoryBudget);
+	SpectrumCache(const SpectrumCache&) = delete;
+	SpectrumCache& operator=(const SpectrumCache&) = delete;
+
+	// returns the cached spectrum or nullptr if it is missing
+	SpectrumPtr find(const SpectrumKey& key);
+
+	// adds a computed spectrum, if one has already been added for the key it is returned instead
+	SpectrumPtr insert(const SpectrumKey& key, SpectrumPtr spectrum);
+
+	void setMemoryBudget(size_t bytes);
+	size_t getMemoryBudget() const;
+
+	static SpectrumCache& get();
+private:
+	LruCache<SpectrumKey, Spectrum, SpectrumKeyHash> cache;
 };
 
 #endif // __FFT_BUTTERFLY_H__
@@ -0,0 +1,28 @@
+#ifndef __FFT_CODEC_H__
+#define __FFT_CODEC_H__
+
+#include <istream>
+#include <ostream>
+
+#include "bitmap.h"
+
+// a lossy image codec over the spectrum of the image
+// only the low frequencies inside a compWidth x compHeight window are retained and since the color channels are real
+// only half of them are stored - the rest follow from the symmetry of the spectrum; the retained coefficients are
+// uniformly quantized and coded with adaptive Golomb-Rice codes in order of increasing frequency
+//
+// stream layout (all integers are little endian):
+//   "DWXF" | version : uint8 | width, height, compWidth, compHeight : uint32 | quantStep : float32 | coefficient bits
+// the images are limited to 2^26 pixels, so the decoder never allocates an unbounded spectrum
+template<class T = double>
+class FFTCodec {
+public:
+	// the quantization step is in color levels of the decoded image, the steps too small for the size of the image are
+	// raised to the smallest one, which keeps the quantized coefficients in range
+	static bool encode(const Bitmap& bmp, int compWidth, int compHeight, float quantStep, std::ostream& out);
+
+	// reads a single image from the stream and transforms it back to the signal domain
+	static bool decode(std::istream& in, Bitmap& bmp);
+};
+
+#endif // __FFT_CODEC_H__
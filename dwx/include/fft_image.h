@@ -0,0 +1,80 @@
+#ifndef __FFT_IMAGE_H__
+#define __FFT_IMAGE_H__
+
+#include <memory>
+
+#include "bitmap.h"
+#include "color.h"
+#include "dcomplex.h"
+#include "fft_butterfly.h"
+
+// separates the spectrum of one of two real signals packed as z = first + i * second using the symmetry of the real spectra
+// from the packed coefficients at k and -k: First[k] = (Z[k] + conj(Z[-k])) / 2 and Second[k] = (Z[k] - conj(Z[-k])) / 2i
+template<class T>
+inline TComplex<T> unpackSpectrum(const TComplex<T>& z, const TComplex<T>& zMirror, bool second) noexcept {
+	const T half = static_cast<T>(0.5);
+	if (!second) {
+		return (z + zMirror.conjugate()) * half;
+	} else {
+		const TComplex<T> d = z - zMirror.conjugate();
+		return TComplex<T>(d.imag() * half, -d.real() * half);
+	}
+}
+
+// the spectrum of the three color channels of an 8-bit image, stored in two planes
+// since the channels are real the red and green channels are packed as the real and imaginary part of the first plane
+// and the blue channel is in the second plane, so the whole image needs two transforms instead of three
+template<class T = double>
+class ColorSpectrum {
+public:
+	using ComplexType = TComplex<T>;
+
+	static const int PlaneCount = 2;
+
+	ColorSpectrum(int _width, int _height);
+	ColorSpectrum(const ColorSpectrum&) = delete;
+	ColorSpectrum& operator=(const ColorSpectrum&) = delete;
+
+	// gathers all channels of the bitmap in a single pass starting from (x0, y0) and transforms them to the frequency domain
+	// the bitmap is sampled with wrapping around its edges, so it may be smaller than the spectrum
+	bool forward(const Bitmap& bmp, int x0 = 0, int y0 = 0);
+
+	// transforms the planes back to the signal domain and scatters the normalized region with the given dimensions
+	// starting from (sx, sy) to the bitmap at (dx, dy); the spectrum is no longer valid after this call
+	bool inverse(Bitmap& bmp, int sx, int sy, int regionWidth, int regionHeight, int dx, int dy);
+
+	// transforms back the whole spectrum to a bitmap with the same dimensions
+	bool inverse(Bitmap& bmp);
+
+	// multiplies all channels with the spectrum of a real filter (so the packed channels remain separable)
+	void multiply(const ComplexType * filter) noexcept;
+
+	// returns the coefficient of a single color channel at the (x, y) frequency
+	ComplexType getCoefficient(ColorChannel cc, int x, int y) const noexcept;
+
+	// zeroes the coefficient of all channels at the (x, y) frequency
+	// to get a real signal back, the coefficient at (-x, -y) has to be zeroed as well
+	void zeroCoefficient(int x, int y) noexcept;
+
+	int getWidth() const noexcept {
+		return width;
+	}
+
+	int getHeight() const noexcept {
+		return height;
+	}
+
+	ComplexType * getPlane(int plane) const noexcept {
+		return planes[plane].get();
+	}
+
+private:
+	int width;
+	int height;
+	typename FFTCache<2, T>::FFTPtr forwardFFT;
+	typename FFTCache<2, T>::FFTPtr inverseFFT;
+	std::unique_ptr<ComplexType[]> planes[PlaneCount];
+	std::unique_ptr<ComplexType[]> scratch; //!< shared by the transforms of both planes
+};
+
+#endif // __FFT_IMAGE_H__
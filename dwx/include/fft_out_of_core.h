@@ -0,0 +1,89 @@
+#ifndef __FFT_OUT_OF_CORE_H__
+#define __FFT_OUT_OF_CORE_H__
+
+#include <string>
+#include <functional>
+
+#include "util.h"
+#include "dcomplex.h"
+
+// a temporary file mapped into memory, used as a disk backed scratch buffer
+// the file is removed when it is closed
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// creates a file with the given size (truncating an existing one) and maps it for reading and writing
+	bool create(const std::string& path, uint64 size);
+
+	// unmaps and removes the file
+	void close();
+
+	bool isOK() const noexcept {
+		return data != nullptr;
+	}
+
+	uint8 * getData() const noexcept {
+		return data;
+	}
+
+	uint64 getSize() const noexcept {
+		return size;
+	}
+
+	// returns a unique path for a scratch file in the temporary directory of the system
+	static std::string temporaryPath(const std::string& prefix);
+
+private:
+	uint8 * data;
+	uint64 size;
+	std::string path;
+#ifdef _WIN32
+	void * fileHandle;
+	void * mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
+
+// a 2D fft over a plane, which is stored in a memory mapped scratch file instead of RAM
+// the transform streams row panels and then column panels through buffers limited by the RAM budget:
+// the rows of a panel are transformed straight back to the file, while the columns of a panel are
+// gathered transposed, transformed and scattered back by rows, so the file is always accessed in contiguous runs
+template<class T = double>
+class OutOfCoreFFT2D {
+public:
+	using ComplexType = TComplex<T>;
+
+	OutOfCoreFFT2D(int _width, int _height, size_t _ramBudget);
+
+	// creates the scratch file for the plane, if the path is empty a temporary one is used
+	bool create(const std::string& scratchPath = std::string());
+
+	// transforms the plane in place, returns false if the plane is not created or the transform was aborted
+	bool transform(bool inverse, const std::function<bool()>& abortCheck = std::function<bool()>());
+
+	// the row major plane in the mapped file
+	ComplexType * getData() const noexcept {
+		return reinterpret_cast<ComplexType *>(file.getData());
+	}
+
+	int getWidth() const noexcept {
+		return width;
+	}
+
+	int getHeight() const noexcept {
+		return height;
+	}
+
+private:
+	int width;
+	int height;
+	size_t ramBudget; //!< in bytes, used for the panel buffers
+	MappedFile file;
+};
+
+#endif // __FFT_OUT_OF_CORE_H__
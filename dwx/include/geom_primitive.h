@@ -4,9 +4,11 @@
 #include "bitmap.h"
 #include "vector2.h"
 #include "module_base.h"
+#include "lru_cache.h"
 
 #include <string>
 #include <vector>
+#include <memory>
 
 enum DrawFlags {
 	DF_OVER       = 0,      //!< overwrite previous contents (this is the default)
@@ -129,6 +131,10 @@ public:
 	// returns the input real coordinates in the raster coordinate system
 	Vector2 realToRaster(const Vector2& r) const noexcept;
 
+	// returns true if the current mapping differs from the provided previous one only by a translation of a whole
+	// number of pixels, which is returned in shiftX and shiftY (a pixel from the previous raster moves to (x + shiftX, y + shiftY))
+	bool getPixelShift(const Vector2& prevScale, const Vector2& prevOffset, int& shiftX, int& shiftY) const noexcept;
+
 	void drawAxes();
 
 	// parametric setters and getters
@@ -174,25 +180,105 @@ public:
 	virtual void draw(unsigned flags = DF_OVER) override final;
 };
 
+// the maximum memory used by the cached samples of a single raster
+const size_t RasterCacheBudget = 64 << 20;
+
 template<class CType>
 class FunctionRaster : public GeometricPrimitive<CType> {
+	// the function evaluated at the centers of the raster pixels, together with the mapping used for the evaluation
+	struct FunctionSamples {
+		int width;
+		int height;
+		Vector2 scale;
+		Vector2 offset;
+		std::vector<double> values;
+	};
+
 	std::function<double(double, double)> fxy;
+	std::string functionKey; //!< identifies the function in the sample cache (caching is disabled if empty)
+	bool incremental;
+	LruCache<std::string, FunctionSamples> sampleCache;
+
+	// evaluates the function over the raster, if it was only panned since the last evaluation of the same function
+	// the cached samples are moved and only the exposed strips are evaluated; returns nullptr if aborted
+	std::shared_ptr<const FunctionSamples> evaluateSamples();
 public:
 	FunctionRaster(int width = -1, int height = -1);
 
-	virtual void setFunction(std::function<double(double, double)>);
+	virtual void setFunction(std::function<double(double, double)>, const std::string& _functionKey = std::string());
+
+	// enables the reuse of the samples from the previous draws of the same function
+	virtual void setIncremental(bool _incremental) {
+		incremental = _incremental;
+	}
 
 	virtual void draw(unsigned flags = DF_OVER) override final;
 };
 
 template<class CType>
 class FineFunctionRaster : public GeometricPrimitive<CType> {
+	// an intersection of the function with the sampling grid, found while checking the cell of a pixel
+	struct CellIntersection {
+		int cell; //!< the offset of the pixel in the raster
+		Vector2 position; //!< in real coordinates
+	};
+
+	// all intersections found in the raster, together with the mapping used for finding them
+	struct IntersectionSamples {
+		int width;
+		int height;
+		Vector2 scale;
+		Vector2 offset;
+		std::vector<CellIntersection> intersections;
+	};
+public:
+	enum RendererType {
+		RT_NEAREST = 0, //!< shades every pixel by its nearest intersection of the function with the sampling grid
+		RT_CONTOURS, //!< extracts the contours with marching squares and draws them with an anti-aliased pen
+		RT_COUNT,
+	};
+private:
 	std::function<double(double, double)> fxy;
+	std::string functionKey; //!< identifies the function in the sample cache (caching is disabled if empty)
 	bool treeOutput;
+	bool incremental;
+	RendererType renderer;
+	LruCache<std::string, IntersectionSamples> sampleCache;
+	std::vector<std::vector<Vector2> > contours; //!< the polylines of the last draw with the contour renderer, in real coordinates
+
+	// checks the cell of the pixel for horizontal and vertical intersections with the function
+	void findCellIntersections(int x, int y, std::vector<CellIntersection>& output) const;
+
+	// finds the intersections in the whole raster, if it was only panned by whole pixels since the last draw of the same
+	// function the cached intersections are moved and only the exposed cells are checked; returns nullptr if aborted
+	std::shared_ptr<const IntersectionSamples> findIntersections();
+
+	// samples the function in the pixel centers and connects the zero crossings of the sampled cells to polylines,
+	// returns false if aborted
+	bool extractContours();
+
+	// draws the extracted contours with the pen, the shading depends on the distance to the closest segment,
+	// which is found per tile of the raster from the segments binned to it, so only the pixels around them are visited
+	void drawContours(bool additive);
 public:
 	FineFunctionRaster(int width = -1, int height = -1);
 
-	virtual void setFunction(std::function<double(double, double)>);
+	virtual void setFunction(std::function<double(double, double)>, const std::string& _functionKey = std::string());
+
+	// enables the reuse of the intersections from the previous draws of the same function
+	virtual void setIncremental(bool _incremental) {
+		incremental = _incremental;
+	}
+
+	virtual void setRenderer(RendererType _renderer) {
+		renderer = _renderer;
+	}
+
+	// returns the contours of the last draw with the contour renderer as polylines in real coordinates
+	// closed contours end with their first point
+	const std::vector<std::vector<Vector2> >& getContours() const noexcept {
+		return contours;
+	}
 
 	virtual void setTreeOutput(bool _treeOutput) {
 		treeOutput = _treeOutput;
@@ -0,0 +1,46 @@
+#ifndef __HOMOGRAPHY_H__
+#define __HOMOGRAPHY_H__
+
+#include "vector2.h"
+
+// a projective transform of the plane as a row-major 3x3 matrix applied to (x, y, 1)
+// the elements are in double precision, because the perspective division amplifies the rounding errors far from the origin
+class Homography {
+public:
+	double m[3][3];
+
+	Homography() noexcept
+		: m{ { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } }
+	{}
+
+	Homography(
+		double a00, double a01, double a02,
+		double a10, double a11, double a12,
+		double a20, double a21, double a22
+		) noexcept
+		: m{ { a00, a01, a02 }, { a10, a11, a12 }, { a20, a21, a22 } }
+	{}
+
+	// maps the point; returns false if it is mapped to (or beyond) the line at infinity
+	bool apply(double x, double y, double& outX, double& outY) const noexcept {
+		const double w = m[2][0] * x + m[2][1] * y + m[2][2];
+		if (!(w > 1e-12)) {
+			return false;
+		}
+		const double rw = 1.0 / w;
+		outX = (m[0][0] * x + m[0][1] * y + m[0][2]) * rw;
+		outY = (m[1][0] * x + m[1][1] * y + m[1][2]) * rw;
+		return true;
+	}
+
+	// finds the inverse transform; returns false if the matrix is singular
+	bool inverse(Homography& result) const noexcept;
+
+	// finds the transform mapping each of the four source points to the respective destination point
+	// returns false if three of the points on either side are (nearly) collinear
+	static bool fromPoints(const Vector2 src[4], const Vector2 dst[4], Homography& result);
+};
+
+Homography operator * (const Homography& a, const Homography& b) noexcept; //!< the transform applying b first and then a
+
+#endif // __HOMOGRAPHY_H__
@@ -0,0 +1,126 @@
+#ifndef __HOUGH_H__
+#define __HOUGH_H__
+
+#include <vector>
+
+#include "bitmap.h"
+#include "color.h"
+#include "vector2.h"
+
+class ProgressCallback;
+
+// an edge point relative to the center of the image with the direction of the intensity gradient in radians
+// the gradient is normal to the edge, so it is also the theta of the lines along the edge (modulo PI)
+struct HoughPoint {
+	Vector2 position;
+	float direction;
+};
+
+enum GradientOperator {
+	GO_SOBEL = 0,
+	GO_SCHARR, //!< more rotationally symmetric, so the directions are more accurate
+};
+
+// returns the points with a gradient magnitude of at least the threshold (in intensity levels per pixel) in row order
+// the gradient is computed with the 3x3 operator, so the border pixels are skipped
+std::vector<HoughPoint> findEdgePoints(const Bitmap& bmp, GradientOperator op, float magnitudeThreshold);
+
+// a line in the normal form x * cos(theta) + y * sin(theta) = rho, in pixels relative to the center of the image
+struct HoughLine {
+	float rho;
+	float theta; //!< in radians in [0, PI)
+	uint32 votes;
+};
+
+// the accumulator of the Hough transform for lines over the (theta, rho) space
+// the sines and cosines of all theta bins are precomputed and the voting is split by theta between the workers,
+// so every worker owns whole rows of the accumulator and no synchronization is needed
+class HoughAccumulator {
+public:
+	// the rho resolution is in pixels and the theta resolution is in degrees per bin
+	HoughAccumulator(int imageWidth, int imageHeight, float rhoResolution, float thetaResolution);
+
+	// votes for all lines through the points, which are relative to the center of the image; returns false if aborted
+	bool vote(const std::vector<Vector2>& points, ProgressCallback * cb = nullptr);
+
+	// votes only for the lines with theta within thetaWindow degrees of the gradient directions of the points
+	// the points are sorted by the theta bin of their direction, so each row of the accumulator reads only its voters
+	bool vote(const std::vector<HoughPoint>& points, float thetaWindow, ProgressCallback * cb = nullptr);
+
+	// returns up to maxLines lines sorted by decreasing votes, each of them with at least minVotes votes and
+	// the most voted in the (2 * suppressionRadius + 1) square of bins around it (theta wraps around with a negated rho)
+	std::vector<HoughLine> findLines(int maxLines, uint32 minVotes, int suppressionRadius) const;
+
+	// the votes normalized to the maximum with theta along the x axis and rho along the y axis
+	void getVotesBitmap(Bitmap& out) const;
+
+	void clear();
+
+	int getThetaBins() const noexcept {
+		return thetaBins;
+	}
+
+	int getRhoBins() const noexcept {
+		return rhoBins;
+	}
+
+	uint32 getVotes(int thetaBin, int rhoBin) const noexcept {
+		return votes[thetaBin * rhoBins + rhoBin];
+	}
+
+private:
+	static const int PointBlockSize = 4096; //!< the points voting together, so they stay in the cache for all thetas of a worker
+	static const int ThetaChunkSize = 4; //!< the accumulator rows voted by a worker at once
+
+	float rhoResolution;
+	int thetaBins;
+	int rhoBins;
+	float rhoOffset; //!< the fractional bin of zero rho, with the rounding to the nearest bin
+	std::vector<float> cosTable; //!< scaled by the inverse of the rho resolution
+	std::vector<float> sinTable; //!< scaled by the inverse of the rho resolution
+	std::vector<uint32> votes; //!< thetaBins rows of rhoBins
+};
+
+// draws the part of the line inside the bitmap, one pixel per step along its major axis
+void drawHoughLine(Bitmap& bmp, const HoughLine& line, const Color& color);
+
+// a circle found by the circle Hough transform
+struct HoughCircle {
+	Vector2 center; //!< in pixels of the image
+	float radius;
+	float score; //!< the weighted fraction of the circle covered by edges
+};
+
+// the circle Hough transform as a sweep of fft convolutions of the edge map with rings of all radii in a range
+// the edge map is transformed once and the (cached) ring spectra are applied two at a time - as the real and the
+// imaginary part of the same plane - so every pair of radii costs a single inverse transform
+// only the best score and its radius are kept for each pixel, so the memory does not grow with the radius range
+class CircleHoughAccumulator {
+public:
+	CircleHoughAccumulator(int width, int height, int minRadius, int maxRadius, int radiusStep = 1);
+
+	// votes with the edge points (relative to the center of the image as returned by findEdgePoints)
+	// returns false if aborted
+	bool vote(const std::vector<HoughPoint>& points, ProgressCallback * cb = nullptr);
+
+	// returns up to maxCircles circles sorted by decreasing score, each with at least minScore and the best score
+	// in the (2 * suppressionRadius + 1) square of pixels around its center
+	std::vector<HoughCircle> findCircles(int maxCircles, float minScore, int suppressionRadius) const;
+
+	// the best scores of the pixels normalized to the maximum
+	void getScoresBitmap(Bitmap& out) const;
+
+private:
+	static const size_t ScratchBudget = 512 << 20; //!< the memory in bytes used by the planes of all workers
+
+	int width;
+	int height;
+	std::vector<int> radii;
+	std::vector<float> bestScores; //!< the best score of any radius for each pixel
+	std::vector<float> bestRadii; //!< the radius with the best score
+};
+
+// draws the part of the circle inside the bitmap
+void drawHoughCircle(Bitmap& bmp, const HoughCircle& circle, const Color& color);
+
+#endif // __HOUGH_H__
@@ -0,0 +1,114 @@
+#ifndef __LRU_CACHE_H__
+#define __LRU_CACHE_H__
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// a thread safe cache of immutable shared values, bounded by a memory budget
+// when the budget is exceeded the least recently used values are dropped from the cache,
+// but they are kept alive by their shared pointers as long as some caller still uses them
+template<class Key, class Value, class Hash = std::hash<Key> >
+class LruCache {
+public:
+	using ValuePtr = std::shared_ptr<const Value>;
+
+	explicit LruCache(size_t _budget)
+		: budget(_budget)
+		, usage(0)
+	{}
+
+	LruCache(const LruCache&) = delete;
+	LruCache& operator=(const LruCache&) = delete;
+
+	// returns the cached value for the key (and marks it as most recently used) or nullptr if missing
+	ValuePtr find(const Key& key) {
+		std::lock_guard<std::mutex> lk(mutex);
+		auto it = index.find(key);
+		if (it == index.end()) {
+			return ValuePtr();
+		}
+		entries.splice(entries.begin(), entries, it->second);
+		return it->second->value;
+	}
+
+	// inserts a new value with the given cost in bytes
+	// if another thread has already inserted a value for the same key the existing one is returned
+	ValuePtr insert(const Key& key, ValuePtr value, size_t cost) {
+		std::lock_guard<std::mutex> lk(mutex);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			entries.splice(entries.begin(), entries, it->second);
+			return it->second->value;
+		}
+		entries.push_front(Entry{ key, value, cost });
+		index[key] = entries.begin();
+		usage += cost;
+		evict();
+		return value;
+	}
+
+	// removes the value for the key from the cache (if present)
+	void erase(const Key& key) {
+		std::lock_guard<std::mutex> lk(mutex);
+		auto it = index.find(key);
+		if (it != index.end()) {
+			usage -= it->second->cost;
+			entries.erase(it->second);
+			index.erase(it);
+		}
+	}
+
+	// changes the memory budget and evicts entries if necessary
+	void setBudget(size_t _budget) {
+		std::lock_guard<std::mutex> lk(mutex);
+		budget = _budget;
+		evict();
+	}
+
+	size_t getBudget() const {
+		std::lock_guard<std::mutex> lk(mutex);
+		return budget;
+	}
+
+	// returns the summed cost of all values currently held by the cache
+	size_t getUsage() const {
+		std::lock_guard<std::mutex> lk(mutex);
+		return usage;
+	}
+
+	void clear() {
+		std::lock_guard<std::mutex> lk(mutex);
+		entries.clear();
+		index.clear();
+		usage = 0;
+	}
+
+private:
+	struct Entry {
+		Key key;
+		ValuePtr value;
+		size_t cost;
+	};
+
+	// drops the least recently used entries until the usage fits the budget
+	// the most recently used entry is always kept, even if it alone exceeds the budget
+	void evict() {
+		while (usage > budget && entries.size() > 1) {
+			const Entry& last = entries.back();
+			usage -= last.cost;
+			index.erase(last.key);
+			entries.pop_back();
+		}
+	}
+
+	mutable std::mutex mutex;
+	size_t budget; //!< the maximum summed cost of the cached values
+	size_t usage; //!< the current summed cost of the cached values
+	std::list<Entry> entries; //!< ordered from the most to the least recently used
+	std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+};
+
+#endif // __LRU_CACHE_H__
@@ -32,6 +32,10 @@ enum ModuleId {
 	M_FFT_DOMAIN,
 	M_FFT_COMPRESSION,
 	M_FFT_FILTER,
+	M_DENSITY_SAMPLING,
+	M_CIRCLE_HOUGH,
+	M_WARP,
+	M_LAPLACIAN_PYRAMID,
 	M_COUNT, //!< must remain to be used for IDs and array sizes
 };
 
@@ -8,11 +8,15 @@
 #include <condition_variable>
 #include <atomic>
 #include <mutex>
+#include <cstring>
 
 #include "bitmap.h"
+#include "alias_table.h"
+#include "lru_cache.h"
 #include "module_base.h"
 #include "geom_primitive.h"
 #include "param_handlers.h"
+#include "resample.h"
 
 // TODO add a module as an input/output manager of another module to chain modules
 
@@ -92,7 +96,6 @@ protected:
 	std::atomic<State> state;
 	std::mutex moduleMutex;
 	std::condition_variable ev;
-	std::thread loopThread;
 
 	static void moduleLoop(AsyncModule * k);
 
@@ -100,6 +103,41 @@ protected:
 
 	//!< override for all AsyncModules by default
 	virtual void setOutput() const override {}
+
+	// progressive execution - modules with a "progressive" parameter are first run at a fraction of the resolution
+	// and each preview level is published before the next one starts, a dirty state cancels the remaining levels
+
+	// forwards the outputs of a preview level to the real output manager upscaled by the level divisor
+	class PreviewOutputManager : public OutputManager {
+	public:
+		PreviewOutputManager()
+			: target(nullptr)
+			, divisor(1)
+		{}
+
+		void setOutput(const Bitmap& outputBmp, int id) override;
+
+		OutputManager * target;
+		int divisor;
+	};
+
+	int progressiveDivisor; //!< the resolution divisor of the current run (1 for the full resolution)
+	PreviewOutputManager previewOutput;
+	Bitmap previewInput; //!< the full resolution input of the preview runs, kept only while they run
+	int previewInputId;
+
+	std::thread loopThread; //!< declared last, so it starts after all other members are initialized
+
+	// runs the module implementation once, or once per level if the progressive execution is enabled
+	ModuleBase::ProcessResult runLevels();
+
+	// the divisor of the resolution for the current run, modules without an input have to scale their own dimensions by it
+	int getProgressiveDivisor() const {
+		return progressiveDivisor;
+	}
+
+	// in the preview runs the input is the level of its pyramid with the divisor of the run
+	virtual bool getInput() override;
 };
 
 class IdentityModule : public SimpleModule {
@@ -191,6 +229,7 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "additive", "false"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "clear", "true"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "axis", "false"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "incremental", "true"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
@@ -219,6 +258,9 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "clear", "true"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "axis", "false"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "outputTree", "false"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "renderer", "nearest;contours"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "incremental", "true"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "progressive", "false"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
@@ -244,8 +286,10 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "sy", "1024.0"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_COLOR, "background", "000000"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_COLOR, "sampleColor", "ffffff"));
-		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "randEngine", "c-rand;LCG;MT;ranlux;knuth_b", &distGenHandler));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "randEngine", "c-rand;LCG;MT;ranlux;knuth_b;philox", &distGenHandler));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "distribution", "uniform;normal;chi_squared;log_normal;cauchy;fisher_f;student_t", &distGenHandler, false));
+		// zero picks a new random seed for every run, any other value gives the same image with all engines
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "seed", "0"));
 	}
 
 	enum {
@@ -254,6 +298,7 @@ public:
 		RE_MERSENNE_TWISTER,
 		RE_RANLUX,
 		RE_KNUTH_B,
+		RE_PHILOX,
 	};
 
 	enum {
@@ -269,8 +314,112 @@ public:
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
 };
 
+// samples points with the density of the intensity of the input image, e.g. for stippling
+class DensitySamplingModule : public AsyncModule {
+public:
+	enum DensityMode {
+		DM_INTENSITY = 0, //!< brighter pixels are sampled more often
+		DM_INVERTED, //!< darker pixels are sampled more often
+	};
+
+	static const size_t TableCacheBudget = 256 << 20; //!< in bytes
+
+	DensitySamplingModule()
+		: tableCache(TableCacheBudget)
+	{
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "samples", "1000000"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "gradient", "2"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "scale", "1.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "density", "intensity;inverted"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "gamma", "1.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_COLOR, "background", "000000"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_COLOR, "sampleColor", "ffffff"));
+		// zero picks a new random seed for every run
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "seed", "0"));
+	}
+
+	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
+private:
+	struct TableKey {
+		uint64 contentHash;
+		std::shared_ptr<const Bitmap> pixels; //!< compared on lookup, so inputs with the same hash never share a table
+		unsigned density;
+		float gamma;
+
+		bool operator==(const TableKey& rhs) const noexcept {
+			if (contentHash != rhs.contentHash || density != rhs.density || gamma != rhs.gamma) {
+				return false;
+			} else if (pixels == rhs.pixels) {
+				return true;
+			}
+			return pixels->getWidth() == rhs.pixels->getWidth() && pixels->getHeight() == rhs.pixels->getHeight() &&
+				memcmp(pixels->getDataPtr(), rhs.pixels->getDataPtr(), pixels->getDimensionProduct() * sizeof(Color)) == 0;
+		}
+	};
+
+	struct TableKeyHash {
+		size_t operator()(const TableKey& key) const noexcept;
+	};
+
+	// returns the alias table of the input bitmap, it is built only if the same input has not been sampled recently
+	std::shared_ptr<const AliasTable> getTable(DensityMode density, float gamma);
+
+	LruCache<TableKey, AliasTable, TableKeyHash> tableCache;
+};
+
 class HoughModule : public AsyncModule {
 public:
+	enum OutputType {
+		OT_ACCUMULATOR = 0, //!< the normalized votes with theta along x and rho along y
+		OT_LINES, //!< the strongest lines drawn over the input
+	};
+
+	enum EdgeDetection {
+		ED_SOBEL = 0, //!< the pixels with strong gradients vote only around their gradient direction
+		ED_SCHARR,
+		ED_THRESHOLD, //!< all pixels darker than the threshold vote for all thetas
+	};
+
+	HoughModule() {
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "edges", "sobel;scharr;threshold"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "threshold", "15"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "edgeThreshold", "32.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "thetaWindow", "6.0"));
+		// the fraction of the edge points voting in the probabilistic transform
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "sampling", "1.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "rhoResolution", "2.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "thetaResolution", "0.5"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "output", "accumulator;lines"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "maxLines", "10"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "minVotes", "0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "suppression", "4"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_COLOR, "lineColor", "ff0000"));
+	}
+
+	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
+};
+
+class CircleHoughModule : public AsyncModule {
+public:
+	enum OutputType {
+		OT_CIRCLES = 0, //!< the strongest circles drawn over the input
+		OT_ACCUMULATOR, //!< the normalized best score of each pixel over all radii
+	};
+
+	CircleHoughModule() {
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "edges", "sobel;scharr"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "edgeThreshold", "32.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "minRadius", "10"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "maxRadius", "50"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "radiusStep", "1"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "output", "circles;accumulator"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "maxCircles", "10"));
+		// the weighted fraction of a circle that has to be covered by edges
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "minScore", "0.3"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "suppression", "8"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_COLOR, "circleColor", "ff0000"));
+	}
+
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
 };
 
@@ -280,6 +429,8 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "angle"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "edge", "blank;tile;stretch;mirror"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "filterType", "bilinear;bicubic"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "method", "mapping;shears"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "progressive", "false"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
@@ -292,9 +443,85 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "vertical", "0.0"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "edge", "blank;tile;stretch;mirror"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "filterType", "bilinear;bicubic"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "method", "mapping;shears"));
+	}
+
+	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
+};
+
+// maps the input with an affine or projective transform; the source coordinates of all output pixels are kept in a cache
+// of remap tables, so the frames with the same geometry and size only gather the pixels
+class WarpModule : public AsyncModule {
+public:
+	static const size_t TableCacheBudget = 256 << 20; //!< in bytes
+
+	WarpModule()
+		: tableCache(TableCacheBudget)
+	{
+		// the row-major matrix (6 or 9 values) mapping the input to the output, with the pixel centers at +0.5
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_STRING, "matrix", "1;0;0;0;1;0;0;0;1"));
+		// "x,y;x,y;x,y;x,y" of the input mapped to the top left, top right, bottom right and bottom left corners of the output
+		// overrides the matrix when set
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_STRING, "corners", ""));
+		// zero keeps the dimension of the input
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "width", "0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "height", "0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "edge", "blank;tile;stretch;mirror"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "filterType", "bilinear;bicubic"));
+	}
+
+	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
+private:
+	struct TableKey {
+		double inverse[3][3];
+		int width;
+		int height;
+
+		bool operator==(const TableKey& rhs) const noexcept {
+			return width == rhs.width && height == rhs.height && memcmp(inverse, rhs.inverse, sizeof(inverse)) == 0;
+		}
+	};
+
+	struct TableKeyHash {
+		size_t operator()(const TableKey& key) const noexcept;
+	};
+
+	// returns the remap table of the geometry, it is built only if it has not been used recently
+	std::shared_ptr<const RemapTable> getTable(const Homography& inverse, int width, int height);
+
+	LruCache<TableKey, RemapTable, TableKeyHash> tableCache;
+};
+
+// edits and blends the images over the levels of their Laplacian pyramids
+// the gui gives a single input to the modules, so the second image of a blend is kept from a previous run in the capture mode
+class LaplacianPyramidModule : public AsyncModule {
+public:
+	enum PyramidMode {
+		PM_DETAIL = 0, //!< scales the details of each level by its gain
+		PM_CAPTURE,    //!< keeps the input as the second image of the blend and passes it through
+		PM_BLEND,      //!< blends the captured image into the input with a seam as wide as the wavelengths of each level
+	};
+
+	enum BlendMask {
+		BM_VERTICAL = 0, //!< the captured image is on the left of the split
+		BM_HORIZONTAL,   //!< the captured image is above the split
+		BM_ELLIPSE,      //!< the captured image is inside an ellipse around the center with radii of split times the half sizes
+	};
+
+	LaplacianPyramidModule() {
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "mode", "detail;capture;blend"));
+		// zero builds the levels down to a side of 8 pixels
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "levels", "0"));
+		// the gains of the details from the finest level, the rest are kept
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_STRING, "gains", "1.5;1.25"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "mask", "vertical;horizontal;ellipse"));
+		// the position of the seam as a fraction of the size
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "split", "0.5"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
+private:
+	Bitmap captured; //!< the second image of the blend
 };
 
 class HistogramModule : public AsyncModule {
@@ -343,7 +570,7 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "height", "128", &aspectHandler));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "keepAspect", "false", &aspectHandler));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "aspectRatio", "1.0", &aspectHandler));
-		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "medium", "uint16;uint8;float;double"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "filterType", "box;triangle;mitchell;lanczos3"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
@@ -359,7 +586,8 @@ public:
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "height", "128", &aspectHandler));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "keepAspect", "false", &aspectHandler));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "aspectRatio", "1.0", &aspectHandler));
-		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "filterType", "NearestNeighbour;Bilinear;Bicubic"));
+		// box is the nearest neighbour and triangle is bilinear when upscaling
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "filterType", "box;triangle;mitchell;lanczos3"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
@@ -424,38 +652,78 @@ public:
 	KMeansModule() {
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "numClasses", "5"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "numIterations", "10"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "progressive", "false"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
 };
 
 class FFTDomainModule : public AsyncModule {
+	// computes the normalized magnitudes of the spectrum of the input in the given precision, returns false if aborted
+	template<class T>
+	bool computeDomain(const Bitmap& input, bool logScale, Bitmap& out);
+
+	// the same as computeDomain, but the spectrum is kept in memory mapped scratch files and only ramBudget bytes are used for the transforms
+	template<class T>
+	ModuleBase::ProcessResult computeDomainOutOfCore(const Bitmap& input, bool logScale, size_t ramBudget, Bitmap& out);
 public:
 	FFTDomainModule() {
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "logScale", "true"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "centralized", "true"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "squareDimension", "false"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "powerOf2", "false"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "precision", "double;float"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "outOfCore", "false"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "ramBudgetMB", "256"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
 };
 
 class FFTCompressionModule : public AsyncModule {
+	// zeroes the high frequencies outside of the compressed dimensions in the given precision, returns false if aborted
+	template<class T>
+	bool compress(const Bitmap& input, int compWidth, int compHeight, Bitmap& out);
 public:
+	enum CompressionMode {
+		CM_SIMULATE = 0, //!< only zeroes the high frequencies
+		CM_CODEC, //!< encodes the image with the FFTCodec and decodes it back
+		CM_COUNT,
+	};
+
 	FFTCompressionModule() {
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "compressPercent", "50.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "precision", "double;float"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "mode", "simulate;codec"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "quantStep", "1.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_STRING, "outputFile", ""));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
 };
 
 class FFTFilter : public AsyncModule {
+	// applies the kernel to the input as a circular convolution in the given precision, returns false if aborted
+	template<class T>
+	bool applyFilter(const Bitmap& input, const ConvolutionKernel& ck, Bitmap& out);
+
+	// applies the same convolution with overlap-save over fft friendly tiles, which are processed in parallel
+	template<class T>
+	bool applyFilterTiled(const Bitmap& input, const ConvolutionKernel& ck, int tileSize, Bitmap& out);
 public:
+	enum FilterMode {
+		FM_FULL = 0,
+		FM_TILED,
+		FM_COUNT,
+	};
+
 	FFTFilter() {
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_CKERNEL, "kernelFFT", "5"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_BOOL, "normalizeKernel", "true"));
 		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_FLOAT, "normalizationValue", "1.0"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "precision", "double;float"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_ENUM, "mode", "full;tiled"));
+		paramList.push_back(ParamDescriptor(this, ParamDescriptor::ParamType::PT_INT, "tileSize", "512"));
 	}
 
 	ModuleBase::ProcessResult moduleImplementation(unsigned flags) override final;
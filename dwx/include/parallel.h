@@ -0,0 +1,44 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// returns the number of threads used by the parallel loops by default
+inline int getWorkerCount() {
+	const unsigned hwThreads = std::thread::hardware_concurrency();
+	return (hwThreads > 0 ? static_cast<int>(hwThreads) : 1);
+}
+
+// calls func(index, worker) for every index in [0, count) using up to maxWorkers threads (all hardware threads if 0)
+// indices are handed out dynamically one at a time, and each worker id in [0, workers) is used by a single thread,
+// so it can safely index per worker buffers; the calling thread is used as worker 0
+template<class Func>
+void parallelFor(int count, Func func, int maxWorkers = 0) {
+	const int workers = std::min(maxWorkers > 0 ? maxWorkers : getWorkerCount(), count);
+	if (workers <= 1) {
+		for (int i = 0; i < count; ++i) {
+			func(i, 0);
+		}
+		return;
+	}
+	std::atomic<int> nextIndex(0);
+	auto workerLoop = [&nextIndex, &func, count](int worker) {
+		for (int i = nextIndex++; i < count; i = nextIndex++) {
+			func(i, worker);
+		}
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (int w = 1; w < workers; ++w) {
+		threads.emplace_back(workerLoop, w);
+	}
+	workerLoop(0);
+	for (auto& t : threads) {
+		t.join();
+	}
+}
+
+#endif // __PARALLEL_H__
@@ -0,0 +1,122 @@
+#ifndef __PHILOX_H__
+#define __PHILOX_H__
+
+#include "util.h"
+
+// the Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+// every output block of four words is a keyed bijection of a 128-bit counter, so any position of the sequence
+// can be reached in O(1) without generating the preceding values; the counter is split into a 64-bit stream
+// and a 64-bit block inside the stream, and independent workers may simply use different streams
+// satisfies the requirements of a UniformRandomBitGenerator, so it can be used with the standard distributions
+class Philox4x32 {
+public:
+	using result_type = uint32;
+
+	static const int BlockSize = 4; //!< the number of words generated for one counter value
+
+	static constexpr result_type min() {
+		return 0;
+	}
+
+	static constexpr result_type max() {
+		return 0xffffffff;
+	}
+
+	explicit Philox4x32(uint64 seed = 0) noexcept {
+		setKey(seed);
+		seek(0, 0);
+	}
+
+	// the key is taken from the first two words of the seed sequence
+	template<class SeedSeq>
+	explicit Philox4x32(SeedSeq& seq) {
+		uint32 words[2] = { 0 };
+		seq.generate(words, words + 2);
+		key[0] = words[0];
+		key[1] = words[1];
+		seek(0, 0);
+	}
+
+	void setKey(uint64 seed) noexcept {
+		key[0] = static_cast<uint32>(seed);
+		key[1] = static_cast<uint32>(seed >> 32);
+	}
+
+	// moves to the first word of the block in the given stream
+	void seek(uint64 stream, uint64 block) noexcept {
+		counter[0] = static_cast<uint32>(block);
+		counter[1] = static_cast<uint32>(block >> 32);
+		counter[2] = static_cast<uint32>(stream);
+		counter[3] = static_cast<uint32>(stream >> 32);
+		outputIndex = BlockSize;
+	}
+
+	// skips the next z words of the current stream
+	void discard(uint64 z) noexcept {
+		// the counter is already past the buffered block
+		const uint64 nextWord = (outputIndex == BlockSize ? getBlock() * BlockSize : (getBlock() - 1) * BlockSize + outputIndex);
+		const uint64 word = nextWord + z;
+		const uint64 block = word / BlockSize;
+		counter[0] = static_cast<uint32>(block);
+		counter[1] = static_cast<uint32>(block >> 32);
+		outputIndex = BlockSize;
+		const int wordInBlock = static_cast<int>(word % BlockSize);
+		if (wordInBlock > 0) {
+			generateBlock();
+			outputIndex = wordInBlock;
+		}
+	}
+
+	result_type operator()() noexcept {
+		if (outputIndex == BlockSize) {
+			generateBlock();
+			outputIndex = 0;
+		}
+		return output[outputIndex++];
+	}
+
+private:
+	static const uint32 Multiplier0 = 0xD2511F53;
+	static const uint32 Multiplier1 = 0xCD9E8D57;
+	static const uint32 Weyl0 = 0x9E3779B9;
+	static const uint32 Weyl1 = 0xBB67AE85;
+	static const int Rounds = 10;
+
+	uint64 getBlock() const noexcept {
+		return (static_cast<uint64>(counter[1]) << 32) | counter[0];
+	}
+
+	// generates the output of the current counter and advances the block
+	void generateBlock() noexcept {
+		uint32 c0 = counter[0];
+		uint32 c1 = counter[1];
+		uint32 c2 = counter[2];
+		uint32 c3 = counter[3];
+		uint32 k0 = key[0];
+		uint32 k1 = key[1];
+		for (int r = 0; r < Rounds; ++r) {
+			const uint64 p0 = static_cast<uint64>(Multiplier0) * c0;
+			const uint64 p1 = static_cast<uint64>(Multiplier1) * c2;
+			c0 = static_cast<uint32>(p1 >> 32) ^ c1 ^ k0;
+			c1 = static_cast<uint32>(p1);
+			c2 = static_cast<uint32>(p0 >> 32) ^ c3 ^ k1;
+			c3 = static_cast<uint32>(p0);
+			k0 += Weyl0;
+			k1 += Weyl1;
+		}
+		output[0] = c0;
+		output[1] = c1;
+		output[2] = c2;
+		output[3] = c3;
+		const uint64 next = getBlock() + 1;
+		counter[0] = static_cast<uint32>(next);
+		counter[1] = static_cast<uint32>(next >> 32);
+	}
+
+	uint32 key[2];
+	uint32 counter[4];
+	uint32 output[BlockSize];
+	int outputIndex;
+};
+
+#endif // __PHILOX_H__
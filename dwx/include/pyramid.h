@@ -0,0 +1,88 @@
+#ifndef __PYRAMID_H__
+#define __PYRAMID_H__
+
+#include <vector>
+
+#include "bitmap.h"
+
+class ProgressCallback;
+
+// a level of the pyramids - interleaved float channels in the range of the 8 bit colors
+struct PyramidImage {
+	int width;
+	int height;
+	int channels;
+	std::vector<float> data;
+
+	PyramidImage()
+		: width(0)
+		, height(0)
+		, channels(0)
+	{}
+
+	void resize(int w, int h, int c) {
+		width = w;
+		height = h;
+		channels = c;
+		data.resize(static_cast<size_t>(w) * h * c);
+	}
+
+	float * row(int y) noexcept {
+		return data.data() + static_cast<size_t>(y) * width * channels;
+	}
+
+	const float * row(int y) const noexcept {
+		return data.data() + static_cast<size_t>(y) * width * channels;
+	}
+};
+
+// the count of levels down to a side of minSide pixels (including the level of the image itself)
+int getPyramidLevelCount(int width, int height, int minSide = 8);
+
+// blurs the image with the 5 tap binomial filter and drops every other row and column (the odd last ones are kept)
+void pyramidReduce(const PyramidImage& src, PyramidImage& dst);
+
+// interpolates the image to the given size with the same filter, the inverse of the reduction of an image of that size
+void pyramidExpand(const PyramidImage& src, int width, int height, PyramidImage& dst);
+
+// the bitmap as a level with three channels
+void bitmapToPyramidImage(const Bitmap& bmp, PyramidImage& out);
+
+// rounds and clamps the three channels of the image to a bitmap
+void pyramidImageToBitmap(const PyramidImage& img, Bitmap& out);
+
+// the Gaussian pyramid of the image - the first level is the image itself and every next one is reduced from the previous
+void buildGaussianPyramid(const PyramidImage& image, int levelCount, std::vector<PyramidImage>& levels);
+
+// the Laplacian pyramid - every level except the last is the difference of the Gaussian level and the expansion of the
+// next one, so it holds only the details of a single octave of frequencies, while the last level is the low-pass residual
+// all levels together are about 4 / 3 times the size of the image, so the effects over the levels cost the same for any radius
+// the rows of every level are processed in parallel
+class LaplacianPyramid {
+public:
+	// returns false if aborted
+	bool build(const Bitmap& bmp, int levelCount, ProgressCallback * cb = nullptr);
+
+	// adds up the expanded levels back to an image
+	void collapse(Bitmap& out) const;
+
+	// multiplies the details of each level by its gain, the gains are from the finest level and the rest keep a gain of 1
+	void scaleDetails(const std::vector<float>& gains);
+
+	// replaces the pyramid with the blend of a and b weighted by the levels of the Gaussian pyramid of a single channel mask
+	// (1 takes a and 0 takes b), so the seam is as wide as the wavelengths of each level; returns false if they do not match
+	bool blend(const LaplacianPyramid& a, const LaplacianPyramid& b, const std::vector<PyramidImage>& maskPyramid);
+
+	int getLevelCount() const noexcept {
+		return static_cast<int>(levels.size());
+	}
+
+	const PyramidImage& getLevel(int level) const noexcept {
+		return levels[level];
+	}
+
+private:
+	std::vector<PyramidImage> levels;
+};
+
+#endif // __PYRAMID_H__
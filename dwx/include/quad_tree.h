@@ -5,7 +5,12 @@
 #include "drect.h"
 
 #include <vector>
-#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <stdint.h>
 
 enum QuadTreeOffsets {
 	QTO_NONE = 0,
@@ -14,6 +19,11 @@ enum QuadTreeOffsets {
 	QTO_COUNT = QTO_NEG_X + QTO_NEG_Y + 1,
 };
 
+// a quad tree with a fixed depth, which keeps all of its nodes in a single pool and all of its elements in a single array
+// the elements of a leaf are chained through indices, so a leaf needs no allocations of its own, and after a bulk build
+// the elements of every leaf are contiguous and the leaves are in Morton order
+// every node keeps the bounds of its elements, which are used for pruning the queries, so elements outside of the tree
+// box are still found
 template<class T>
 class QuadTree {
 public:
@@ -30,37 +40,17 @@ public:
 		T element;
 	};
 
-	QuadTree(int _level, float _halfWidth, float _halfHeight, Vector2 _c = Vector2(0.0f, 0.0f))
-		: level(_level)
-		, halfWidth(_halfWidth)
-		, halfHeight(_halfHeight)
-		, c(_c)
-		, subtrees{ nullptr }
-	{}
-
-	~QuadTree() {
-		for (int i = 0; i < QuadTreeOffsets::QTO_COUNT; ++i) {
-			delete subtrees[i];
-			subtrees[i] = nullptr;
-		}
-	}
+	static const int MaxLevels = 15; //!< so the Morton codes of the leaves fit in 32 bits
+	static const int MaxNeighbours = 32; //!< the maximum count of neighbours of a single k nearest query
 
-	QuadTree(const QuadTree& copy)
-		: level(copy.level)
-		, halfWidth(copy.halfWidth)
-		, halfHeight(copy.halfHeight)
-		, c(copy.c)
-		, subtrees{ nullptr }
+	QuadTree(int _level, float _halfWidth, float _halfHeight, Vector2 _c = Vector2(0.0f, 0.0f))
+		: level(std::min(std::max(_level, 0), static_cast<int>(MaxLevels)))
 	{
-		copyTree(copy);
+		clear(_halfWidth, _halfHeight, _c);
 	}
 
-	QuadTree& operator=(const QuadTree& assign) {
-		if (this != &assign) {
-			copyTree(assign);
-		}
-		return *this;
-	}
+	QuadTree(const QuadTree&) = default;
+	QuadTree& operator=(const QuadTree&) = default;
 
 	// returns the number of levels required to have the bottom level dimension as specified
 	// provided the dimension of the top level
@@ -70,152 +60,316 @@ public:
 
 	// returns the bounding box of the quad tree
 	inline Rect getBoundingBox() const noexcept {
-		return Rect(
-			c.x - halfWidth,
-			c.y - halfHeight,
-			halfWidth * 2.0f,
-			halfHeight * 2.0f
-		);
+		return nodes[0].getBoundingBox();
+	}
+
+	// removes all elements keeping the pools' memory
+	inline void clear() {
+		clear(nodes[0].halfWidth, nodes[0].halfHeight, nodes[0].c);
 	}
 
 	inline void addElement(const Vector2& pos, const T& element) {
-		if (0 == level) {
-			if (!elements) {
-				elements.reset(new std::vector<QuadTreeElement>());
-			}
-			elements->push_back(QuadTreeElement(pos, element));
+		const int elementIndex = static_cast<int>(elements.size());
+		elements.push_back(QuadTreeElement(pos, element));
+		nextElement.push_back(-1);
+		int nodeIndex = 0;
+		nodes[0].extendBounds(pos);
+		for (int l = level; l > 0; --l) {
+			nodeIndex = getSubtree(nodeIndex, pos, true);
+			nodes[nodeIndex].extendBounds(pos);
+		}
+		Node& leaf = nodes[nodeIndex];
+		if (leaf.lastElement < 0) {
+			leaf.firstElement = elementIndex;
 		} else {
-			QuadTree * subtree = getSubtree(pos, true);
-			subtree->addElement(pos, element);
+			nextElement[leaf.lastElement] = elementIndex;
+		}
+		leaf.lastElement = elementIndex;
+	}
+
+	// replaces the contents of the tree with the provided elements
+	// they are sorted by the Morton code of their leaves first, so both the leaves and their elements are laid out
+	// in the order of the space filling curve, which keeps neighbouring leaves close in memory for the queries
+	inline void build(const std::vector<QuadTreeElement>& input) {
+		clear();
+		const Rect bbox = getBoundingBox();
+		const int cells = 1 << level;
+		const float cellsPerWidth = (bbox.width > 0.0f ? cells / bbox.width : 0.0f);
+		const float cellsPerHeight = (bbox.height > 0.0f ? cells / bbox.height : 0.0f);
+		std::vector<std::pair<uint32_t, int> > codes(input.size());
+		for (int i = 0; i < static_cast<int>(input.size()); ++i) {
+			const Vector2& p = input[i].position;
+			const int cx = std::min(std::max(static_cast<int>((p.x - bbox.x) * cellsPerWidth), 0), cells - 1);
+			const int cy = std::min(std::max(static_cast<int>((p.y - bbox.y) * cellsPerHeight), 0), cells - 1);
+			codes[i] = std::make_pair(interleaveBits(static_cast<uint32_t>(cx)) | (interleaveBits(static_cast<uint32_t>(cy)) << 1), i);
+		}
+		std::sort(codes.begin(), codes.end());
+		elements.reserve(input.size());
+		nextElement.reserve(input.size());
+		for (const auto& code : codes) {
+			const QuadTreeElement& e = input[code.second];
+			addElement(e.position, e.element);
 		}
 	}
 
 	// returns the count of elements in the provided bounding box that are stored in the quad tree
-	inline int getElementCount(const Rect& bbox = getBoundingBox()) const noexcept {
+	inline int getElementCount(const Rect& bbox) const noexcept {
 		int count = 0;
-		if (0 == level) {
-			// if on the bottom level of the tree - iterate the elemnts
-			if (elements) {
-				for (const auto & e : *elements) {
-					count += (bbox.inside(e.position) ? 1 : 0);
-				}
-			}
-		} else {
-			// otherwise check subtrees, but only if they intersect the bbox
-			for (int i = 0; i < QuadTreeOffsets::QTO_COUNT; ++i) {
-				const QuadTree * subt = subtrees[i];
-				if (nullptr != subt && bbox.intersects(subt->getBoundingBox())) {
-					count += subt->getElementCount(bbox);
-				}
-			}
-		}
+		visitElements(bbox, [&count](const QuadTreeElement&) {
+			++count;
+		});
 		return count;
 	}
 
+	// returns the count of all elements in the quad tree
+	inline int getElementCount() const noexcept {
+		return static_cast<int>(elements.size());
+	}
+
 	// returns all the elements that are contained in the provided bounding box
-	inline void getElements(std::vector<QuadTreeElement>& output, const Rect& bbox) const noexcept {
-		if (0 == level) {
-			// get all the elemnts that are inside the bounding box
-			if (elements) {
-				for (const auto & e : *elements) {
-					if (bbox.inside(e.position)) {
-						output.push_back(e);
+	inline void getElements(std::vector<QuadTreeElement>& output, const Rect& bbox) const {
+		visitElements(bbox, [&output](const QuadTreeElement& e) {
+			output.push_back(e);
+		});
+	}
+
+	// calls visitor(element) for every element contained in the provided bounding box
+	template<class Visitor>
+	inline void visitElements(const Rect& bbox, Visitor visitor) const {
+		int stack[StackSize];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const Node& node = nodes[stack[--stackSize]];
+			if (node.level == 0) {
+				for (int i = node.firstElement; i >= 0; i = nextElement[i]) {
+					if (bbox.inside(elements[i].position)) {
+						visitor(elements[i]);
 					}
 				}
-			}
-		} else {
-			// otherwise recursively gather the elements from the subtrees if their bboxes intersect the provided
-			for (int i = 0; i < QuadTreeOffsets::QTO_COUNT; ++i) {
-				const QuadTree * subt = subtrees[i];
-				if (nullptr != subt && bbox.intersects(subt->getBoundingBox())) {
-					subt->getElements(output, bbox);
+			} else {
+				// push in reverse, so the subtrees are visited in the order of their offsets
+				for (int s = QuadTreeOffsets::QTO_COUNT - 1; s >= 0; --s) {
+					const int child = node.subtrees[s];
+					if (child >= 0 && nodes[child].intersectsBounds(bbox)) {
+						stack[stackSize++] = child;
+					}
 				}
 			}
 		}
 	}
 
-	// returns true if the quad tree contains elements where this point would be placed
-	inline bool containsElements(const Vector2& p) const noexcept {
-		if (0 == level) {
-			return (elements && 0 < elements->size());
-		} else {
-			const QuadTree * subt = getSubtree(p, false);
-			return (nullptr != subt && subt->containsElements(p));
+	// calls visitor(element, squareDistance) for the (up to) k elements nearest to p, which are not further than maxDistance,
+	// in the order of increasing distance; returns the count of visited elements; no memory is allocated
+	template<class Visitor>
+	inline int visitNearest(const Vector2& p, int k, float maxDistance, Visitor visitor) const {
+		k = std::min(k, static_cast<int>(MaxNeighbours));
+		if (k <= 0) {
+			return 0;
 		}
+		int nearest[MaxNeighbours];
+		float nearestDistances[MaxNeighbours];
+		int found = 0;
+		// the squared distance beyond which no element can be accepted, it shrinks when k elements are found
+		float bound = maxDistance * maxDistance;
+		int stack[StackSize];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const Node& node = nodes[stack[--stackSize]];
+			if (node.getSquareDistance(p) > bound) {
+				continue;
+			}
+			if (node.level == 0) {
+				for (int i = node.firstElement; i >= 0; i = nextElement[i]) {
+					const float dist = (elements[i].position - p).lengthSqr();
+					if (dist > bound || (found == k && dist >= nearestDistances[k - 1])) {
+						continue;
+					}
+					// insertion into the sorted neighbours
+					int j = (found < k ? found++ : k - 1);
+					for (; j > 0 && nearestDistances[j - 1] > dist; --j) {
+						nearest[j] = nearest[j - 1];
+						nearestDistances[j] = nearestDistances[j - 1];
+					}
+					nearest[j] = i;
+					nearestDistances[j] = dist;
+					if (found == k) {
+						bound = nearestDistances[k - 1];
+					}
+				}
+			} else {
+				// push the subtrees so the closest one is visited first, which shrinks the bound the fastest
+				int order[QuadTreeOffsets::QTO_COUNT];
+				float orderDistances[QuadTreeOffsets::QTO_COUNT];
+				int orderCount = 0;
+				for (int s = 0; s < QuadTreeOffsets::QTO_COUNT; ++s) {
+					const int child = node.subtrees[s];
+					if (child < 0) {
+						continue;
+					}
+					const float dist = nodes[child].getSquareDistance(p);
+					if (dist > bound) {
+						continue;
+					}
+					int j = orderCount++;
+					for (; j > 0 && orderDistances[j - 1] < dist; --j) {
+						order[j] = order[j - 1];
+						orderDistances[j] = orderDistances[j - 1];
+					}
+					order[j] = child;
+					orderDistances[j] = dist;
+				}
+				for (int j = 0; j < orderCount; ++j) {
+					stack[stackSize++] = order[j];
+				}
+			}
+		}
+		for (int j = 0; j < found; ++j) {
+			visitor(elements[nearest[j]], nearestDistances[j]);
+		}
+		return found;
 	}
 
-	// returns vector of all quad tree pointers that contain at least one element
-	inline void getBottomTrees(std::vector<const QuadTree*>& output) const noexcept {
-		if (0 == level) {
-			// if this tree was created, it must contain an element or is the top tree
-			output.push_back(this);
-		} else {
-			// iterate over all subtrees
-			for (int i = 0; i < QuadTreeOffsets::QTO_COUNT; ++i) {
-				const QuadTree * subt = subtrees[i];
-				if (subt) {
-					subt->getBottomTrees(output);
-				}
+	// returns the element nearest to p, which is not further than maxDistance, or nullptr if there is no such element
+	inline const QuadTreeElement * findNearest(const Vector2& p, float maxDistance, float * squareDistance = nullptr) const {
+		const QuadTreeElement * result = nullptr;
+		visitNearest(p, 1, maxDistance, [&result, squareDistance](const QuadTreeElement& e, float dist) {
+			result = &e;
+			if (squareDistance) {
+				*squareDistance = dist;
 			}
+		});
+		return result;
+	}
+
+	// returns true if the quad tree contains elements where this point would be placed
+	inline bool containsElements(const Vector2& p) const noexcept {
+		int nodeIndex = 0;
+		for (int l = level; l > 0 && nodeIndex >= 0; --l) {
+			nodeIndex = getSubtree(nodeIndex, p);
 		}
+		return (nodeIndex >= 0 && nodes[nodeIndex].firstElement >= 0);
 	}
 
-	inline const std::vector<QuadTreeElement> * getTreeElements() const noexcept {
-		return elements.get();
+	// returns all elements of the tree grouped by their leaves (in Morton order after a bulk build)
+	inline const std::vector<QuadTreeElement>& getAllElements() const noexcept {
+		return elements;
 	}
 
 	inline Vector2 getTreeCenter() const noexcept {
-		return c;
+		return nodes[0].c;
 	}
 
 private:
-	inline QuadTree * getSubtree(const Vector2& p, bool create) {
-		const int subtreeIndex =
-			(p.x < c.x ? QuadTreeOffsets::QTO_NEG_X : 0) +
-			(p.y < c.y ? QuadTreeOffsets::QTO_NEG_Y : 0);
-		if (nullptr == subtrees[subtreeIndex] && create) {
-			// create the subtree
-			const float subHalfWidth = halfWidth * 0.5f;
-			const float subHalfHeight = halfHeight * 0.5f;
-			const Vector2 subCenter(
-				c.x + (p.x < c.x ? -subHalfWidth : subHalfWidth),
-				c.y + (p.y < c.y ? -subHalfHeight : subHalfHeight)
+	static const int StackSize = MaxLevels * (QuadTreeOffsets::QTO_COUNT - 1) + 1; //!< enough for a depth first traversal
+
+	struct Node {
+		Node(int _level, float _halfWidth, float _halfHeight, Vector2 _c)
+			: c(_c)
+			, halfWidth(_halfWidth)
+			, halfHeight(_halfHeight)
+			, level(_level)
+			, subtrees{ -1, -1, -1, -1 }
+			, firstElement(-1)
+			, lastElement(-1)
+			, boundsMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max())
+			, boundsMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest())
+		{}
+
+		inline Rect getBoundingBox() const noexcept {
+			return Rect(
+				c.x - halfWidth,
+				c.y - halfHeight,
+				halfWidth * 2.0f,
+				halfHeight * 2.0f
 			);
-			subtrees[subtreeIndex] = new QuadTree(level - 1, subHalfWidth, subHalfHeight, subCenter);
 		}
-		return subtrees[subtreeIndex];
-	}
-
-	inline void copyTree(const QuadTree& cpy) {
-		c = cpy.c;
-		halfWidth = cpy.halfWidth;
-		halfHeight = cpy.halfHeight;
-		level = cpy.level;
-		for (int i = 0; i < QuadTreeOffsets::QTO_COUNT; ++i) {
-			if (nullptr != subtrees[i]) {
-				delete subtrees[i];
-				subtrees[i] = nullptr;
-			}
-			if (nullptr != cpy.subtrees[i]) {
-				const QuadTree& subt = cpy.subtrees[i];
-				subtrees[i] = new QuadTree(subt.level, subt.halfWidth, subt.halfHeight, subt.c);
-				subtrees[i]->copyTree(subt);
-			} else {
-				subtrees[i] = nullptr;
+
+		inline void extendBounds(const Vector2& p) noexcept {
+			boundsMin = Vector2(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y));
+			boundsMax = Vector2(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y));
+		}
+
+		inline bool intersectsBounds(const Rect& r) const noexcept {
+			return !(
+				boundsMax.x < r.x || r.x + r.width < boundsMin.x ||
+				boundsMax.y < r.y || r.y + r.height < boundsMin.y);
+		}
+
+		// the squared distance from the point to the bounds of the elements in the node (infinite for an empty node)
+		inline float getSquareDistance(const Vector2& p) const noexcept {
+			if (boundsMin.x > boundsMax.x) {
+				return std::numeric_limits<float>::infinity();
 			}
+			const float dx = std::max(std::max(boundsMin.x - p.x, p.x - boundsMax.x), 0.0f);
+			const float dy = std::max(std::max(boundsMin.y - p.y, p.y - boundsMax.y), 0.0f);
+			return dx * dx + dy * dy;
 		}
-		if (cpy.elements) {
-			elements.reset(new std::vector<QuadTreeElement>(*(cpy.elements)));
+
+		Vector2 c; //!< the center of the node
+		float halfWidth; //!< the half width of the node (it has width of 2 * halfWidth)
+		float halfHeight; //!< the half height of the node (it has height of 2 * halfHeight)
+		int level; //!< the level of depth upwards from the node relative to its subtrees
+		int subtrees[QuadTreeOffsets::QTO_COUNT]; //!< the pool indices of the subtrees (-1 if missing)
+		int firstElement; //!< the first element of a leaf node (-1 if empty)
+		int lastElement; //!< the last element of a leaf node, so new elements are appended in constant time
+		Vector2 boundsMin; //!< the minimum of the element positions in the node, which may be outside of its box
+		Vector2 boundsMax; //!< the maximum of the element positions in the node
+	};
+
+	// spreads the lower 16 bits of the value to the even bits of the result
+	static inline uint32_t interleaveBits(uint32_t v) noexcept {
+		v &= 0x0000ffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	inline void clear(float halfWidth, float halfHeight, Vector2 c) {
+		nodes.clear();
+		nodes.push_back(Node(level, halfWidth, halfHeight, c));
+		elements.clear();
+		nextElement.clear();
+	}
+
+	inline int getSubtree(int nodeIndex, const Vector2& p) const noexcept {
+		const Node& node = nodes[nodeIndex];
+		return node.subtrees[getSubtreeOffset(node, p)];
+	}
+
+	inline int getSubtree(int nodeIndex, const Vector2& p, bool create) {
+		const int subtreeOffset = getSubtreeOffset(nodes[nodeIndex], p);
+		int subtreeIndex = nodes[nodeIndex].subtrees[subtreeOffset];
+		if (subtreeIndex < 0 && create) {
+			// create the subtree - the pool may be reallocated, so the parent is accessed by index
+			const Node& node = nodes[nodeIndex];
+			const float subHalfWidth = node.halfWidth * 0.5f;
+			const float subHalfHeight = node.halfHeight * 0.5f;
+			const Vector2 subCenter(
+				node.c.x + ((subtreeOffset & QuadTreeOffsets::QTO_NEG_X) ? -subHalfWidth : subHalfWidth),
+				node.c.y + ((subtreeOffset & QuadTreeOffsets::QTO_NEG_Y) ? -subHalfHeight : subHalfHeight)
+			);
+			const Node subtree(node.level - 1, subHalfWidth, subHalfHeight, subCenter);
+			subtreeIndex = static_cast<int>(nodes.size());
+			nodes.push_back(subtree);
+			nodes[nodeIndex].subtrees[subtreeOffset] = subtreeIndex;
 		}
+		return subtreeIndex;
 	}
 
-	Vector2 c; //!< the center of this quad tree
-	float halfWidth; //!< the half width of the quad tree (it has width of 2 * halfWidth)
-	float halfHeight; //!< the half height of the quad tree (it has height of 2 * halfHeight)
-	int level; //!< the level of depth upwards from the current tree relative to its subtrees
-	QuadTree * subtrees[QuadTreeOffsets::QTO_COUNT]; //!< the subtrees of this tree (may be nullptr)
+	static inline int getSubtreeOffset(const Node& node, const Vector2& p) noexcept {
+		return
+			(p.x < node.c.x ? QuadTreeOffsets::QTO_NEG_X : 0) +
+			(p.y < node.c.y ? QuadTreeOffsets::QTO_NEG_Y : 0);
+	}
 
-	std::unique_ptr<std::vector<QuadTreeElement> > elements; //!< the elements the subtree saves on its 0 level
+	int level; //!< the level of depth of the root relative to the leaves
+	std::vector<Node> nodes; //!< the pool of nodes, the root is the first one
+	std::vector<QuadTreeElement> elements; //!< all elements of the tree
+	std::vector<int> nextElement; //!< the index of the next element in the same leaf for each element (-1 for the last one)
 };
 
 #endif
@@ -0,0 +1,166 @@
+#ifndef __RANDOM_SAMPLER_H__
+#define __RANDOM_SAMPLER_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "bitmap.h"
+#include "color.h"
+#include "parallel.h"
+#include "philox.h"
+#include "progress.h"
+#include "util.h"
+
+// counter based engines share their key between all workers and jump to a separate stream for every sample, so the
+// sampled image depends only on the seed, and not on the number of workers or the order of the chunks
+template<class RandGen>
+struct SamplerEngineTraits {
+	static const bool CounterBased = false;
+
+	static void seekSample(RandGen&, int64) noexcept {}
+};
+
+template<>
+struct SamplerEngineTraits<Philox4x32> {
+	static const bool CounterBased = true;
+
+	static void seekSample(Philox4x32& rGen, int64 sample) noexcept {
+		rGen.seek(static_cast<uint64>(sample), 0);
+	}
+};
+
+// a point distribution of two independent distributions of the coordinates
+template<class DistWidth, class DistHeight>
+class IndependentPointDistribution {
+	DistWidth distWidth;
+	DistHeight distHeight;
+public:
+	IndependentPointDistribution(DistWidth dw, DistHeight dh)
+		: distWidth(dw)
+		, distHeight(dh)
+	{}
+
+	template<class RandGen>
+	void operator()(RandGen& rGen, int& x, int& y) {
+		x = static_cast<int>(std::round(distWidth(rGen)));
+		y = static_cast<int>(std::round(distHeight(rGen)));
+	}
+
+	void reset() {
+		distWidth.reset();
+		distHeight.reset();
+	}
+};
+
+// draws the samples in chunks on the hardware threads, where every worker has its own engine and its own buffer with the
+// sample counts of the pixels; the buffers are summed up in the output in the end, and their total memory limits the workers
+// the sequential engines are reseeded from the base seeds and the index of every chunk, so the image does not depend on
+// which worker draws the chunk, while the counter based ones jump to the stream of every sample
+template<class RandGen, class PointDistribution>
+class RandomBmpSampler {
+public:
+	static const int64 ChunkSize = 1 << 20;
+	static const size_t CountsBudget = 512 << 20; //!< the memory in bytes used by the count buffers of all workers
+
+	RandomBmpSampler(const std::vector<uint32>& _seeds, PointDistribution pd)
+		: seeds(_seeds)
+		, pointDist(pd)
+	{}
+
+	// adds c to the output for every sample in it, using up to maxWorkers threads (all hardware threads if 0)
+	void sample(Pixelmap<TColor<double> >& output, const TColor<double> c, const int64 samples, ProgressCallback * cb, int maxWorkers = 0) {
+		if (!output.isOK() || samples <= 0) {
+			return;
+		}
+		const int width = output.getWidth();
+		const int height = output.getHeight();
+		const int dimProd = width * height;
+		const int chunkCount = static_cast<int>(std::min<int64>((samples + ChunkSize - 1) / ChunkSize, std::numeric_limits<int>::max()));
+		const int64 chunkSize = (samples + chunkCount - 1) / chunkCount;
+		const size_t workerMemory = static_cast<size_t>(dimProd) * sizeof(uint32);
+		const int workers = std::max(1, std::min({ (maxWorkers > 0 ? maxWorkers : getWorkerCount()), chunkCount, static_cast<int>(CountsBudget / workerMemory) }));
+
+		std::vector<RandGen> engines;
+		std::vector<PointDistribution> pointDists(workers, pointDist);
+		engines.reserve(workers);
+		for (int w = 0; w < workers; ++w) {
+			std::seed_seq seq(seeds.begin(), seeds.end());
+			engines.emplace_back(seq);
+		}
+		std::vector<std::vector<uint32> > counts(workers, std::vector<uint32>(dimProd, 0));
+		std::vector<int64> countedSamples(workers, 0);
+		// the buffers of the workers are moved here before they could overflow
+		std::vector<uint64> totals;
+		std::mutex totalsMutex;
+		std::atomic<int> chunksDone(0);
+
+		parallelFor(chunkCount, [&](int chunk, int worker) {
+			if (cb && cb->getAbortFlag()) {
+				return;
+			}
+			const int64 chunkSamples = std::min(chunkSize, samples - chunk * chunkSize);
+			uint32 * countData = counts[worker].data();
+			if (countedSamples[worker] + chunkSamples > std::numeric_limits<uint32>::max()) {
+				std::unique_lock<std::mutex> lk(totalsMutex);
+				if (totals.empty()) {
+					totals.resize(dimProd, 0);
+				}
+				for (int i = 0; i < dimProd; ++i) {
+					totals[i] += countData[i];
+					countData[i] = 0;
+				}
+				countedSamples[worker] = 0;
+			}
+			countedSamples[worker] += chunkSamples;
+			RandGen& rGen = engines[worker];
+			PointDistribution& pd = pointDists[worker];
+			const int64 chunkStart = chunk * chunkSize;
+			if (!SamplerEngineTraits<RandGen>::CounterBased) {
+				std::vector<uint32> chunkSeeds(seeds);
+				chunkSeeds.push_back(static_cast<uint32>(chunk));
+				std::seed_seq seq(chunkSeeds.begin(), chunkSeeds.end());
+				rGen = RandGen(seq);
+				pd.reset();
+			}
+			for (int64 i = 0; i < chunkSamples; ++i) {
+				if (SamplerEngineTraits<RandGen>::CounterBased) {
+					// the distributions may keep values of the previous stream
+					SamplerEngineTraits<RandGen>::seekSample(rGen, chunkStart + i);
+					pd.reset();
+				}
+				int x = 0;
+				int y = 0;
+				pd(rGen, x, y);
+				if (x >= 0 && x < width && y >= 0 && y < height) {
+					++countData[y * width + x];
+				}
+			}
+			if (cb) {
+				cb->setPercentDone(++chunksDone, chunkCount);
+			}
+		}, workers);
+
+		TColor<double> * outData = output.getDataPtr();
+		parallelFor(height, [&](int y, int) {
+			for (int i = y * width; i < (y + 1) * width; ++i) {
+				uint64 total = (totals.empty() ? 0 : totals[i]);
+				for (int w = 0; w < workers; ++w) {
+					total += counts[w][i];
+				}
+				if (total > 0) {
+					outData[i] += c * static_cast<double>(total);
+				}
+			}
+		});
+	}
+private:
+	std::vector<uint32> seeds;
+	PointDistribution pointDist;
+};
+
+#endif // __RANDOM_SAMPLER_H__
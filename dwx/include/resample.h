@@ -0,0 +1,120 @@
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+#include <algorithm>
+#include <vector>
+
+#include "bitmap.h"
+#include "homography.h"
+#include "matrix2.h"
+
+class ProgressCallback;
+
+enum ResampleFilter {
+	RF_BILINEAR = 0,
+	RF_BICUBIC,
+};
+
+enum ScaleFilter {
+	SF_BOX = 0,  //!< the average of the covered pixels, or the nearest pixel when upscaling
+	SF_TRIANGLE, //!< bilinear
+	SF_MITCHELL, //!< the cubic with B = C = 1 / 3, sharp with little ringing
+	SF_LANCZOS3, //!< the sharpest, with some ringing around the edges
+};
+
+enum TransformMethod {
+	TM_MAPPING = 0, //!< every output pixel is mapped to the input and filtered in 2D
+	TM_SHEARS,      //!< the transform is decomposed in 1D shears of the rows and the columns
+};
+
+// fills the output with the input under an affine mapping around the centers of both bitmaps - the output pixel (x, y)
+// is sampled at inverse * (x - outWidth / 2 + 0.5, y - outHeight / 2 + 0.5) + (width / 2, height / 2) of the input
+// the source coordinates are stepped along each row in fixed point, and the interior span of the row - where all taps
+// of the filter are inside the input - is interpolated with integer weights without any edge checks; only the pixels
+// near the borders fall back to the filtered getters of the bitmap with the edge handling
+// the rows are processed in parallel; returns false if aborted
+bool resampleAffine(const Bitmap& input, Bitmap& output, const Matrix2& inverse, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb = nullptr);
+
+// rotates the input by a multiple of a right angle in the direction of rotationMatrix by reordering the pixels
+void rotateRightAngle(const Bitmap& input, Bitmap& output, int rightTurns);
+
+// transposes the input in square blocks, so both the reads and the writes stay in the cache
+void transposeBitmap(const Bitmap& input, Bitmap& output);
+
+// the same mapping as resampleAffine with an inverse of X(firstRowShear) * Y(columnShear) * X(secondRowShear), where X and Y are
+// the horizontal and vertical shear matrices; every shear is a pass of 1D resampling of the rows - the column one between
+// two transpositions - with the same filter weights along the whole row, so the passes run over contiguous memory
+// the taps beyond the input are blank, and the other edge types are handled by expanding the input beforehand
+bool resampleShears(const Bitmap& input, Bitmap& output, float firstRowShear, float columnShear, float secondRowShear, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb = nullptr);
+
+// Paeth's three shear rotation with the same mapping as resampleAffine with the inverse of rotationMatrix(angle)
+// the angle (in radians) is reduced to [-45, 45] degrees with right turns first, so the shears stay small
+bool rotateShears(const Bitmap& input, Bitmap& output, float angle, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb = nullptr);
+
+// scales the input to the size of the output with a separable filter, which is stretched over the input when downscaling
+// the weights of every output row and column are computed once, and each block of output rows filters horizontally
+// only the input rows it needs, and then accumulates them vertically along whole rows, so both passes read contiguous memory
+// the blocks are processed in parallel; returns false if aborted
+bool resampleScale(const Bitmap& input, Bitmap& output, ScaleFilter filter, ProgressCallback * cb = nullptr);
+
+// the same with the given input pixels per output pixel along each axis, so the output may cover more or less than the input
+bool resampleScale(const Bitmap& input, Bitmap& output, double scaleX, double scaleY, ScaleFilter filter, ProgressCallback * cb = nullptr);
+
+// the source coordinates of every output pixel under a projective mapping, precomputed for repeated warps of the same geometry
+// the coordinates are stored in 20.12 fixed point in tiles of TileSize squared pixels, each tile contiguous with its bounds,
+// so a tile mapped entirely inside the input is gathered without any edge checks
+class RemapTable {
+public:
+	// the inverse maps the continuous coordinates of the output (with the pixel centers at +0.5) to those of the input
+	// the pixels mapped beyond the line at infinity or too far for the fixed point are always blank
+	RemapTable(const Homography& inverse, int width, int height);
+
+	// fills the output (resized to the size of the table) from the input; returns false if aborted
+	bool apply(const Bitmap& input, Bitmap& output, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb = nullptr) const;
+
+	int getWidth() const noexcept {
+		return width;
+	}
+
+	int getHeight() const noexcept {
+		return height;
+	}
+
+	size_t getMemoryUsage() const noexcept {
+		return entries.size() * sizeof(Entry) + bounds.size() * sizeof(TileBounds);
+	}
+
+private:
+	static constexpr int TileSize = 64;
+	static constexpr int FractionBits = 12; //!< more than the phases of the filters
+	static constexpr int32 InvalidCoord = INT32_MIN; //!< marks the pixels without a source
+
+	struct Entry {
+		int32 x; //!< in the coordinates of the filtered getters of the bitmap
+		int32 y;
+	};
+
+	// the extent of the valid entries of a tile
+	struct TileBounds {
+		int32 minX;
+		int32 minY;
+		int32 maxX;
+		int32 maxY;
+		bool hasInvalid;
+	};
+
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	std::vector<Entry> entries; //!< the tiles in row order, each of them with its own rows
+	std::vector<TileBounds> bounds;
+
+	// the index of the first entry of the tile
+	size_t tileOffset(int tx, int ty) const noexcept {
+		const int tileHeight = std::min(TileSize, height - ty * TileSize);
+		return static_cast<size_t>(ty) * TileSize * width + static_cast<size_t>(tx) * TileSize * tileHeight;
+	}
+};
+
+#endif // __RESAMPLE_H__
@@ -61,7 +61,7 @@ namespace Convert {
 class BitmapCanvas;
 
 // a class for rescaling wxImage and wxBitmaps (roughly - no subpixel magics)
-// @note: the class keeps cache for downscaled images
+// @note: the class keeps cache for downscaled images, which are scaled from the nearest level of the pyramid of the image
 class ImageRescaler {
 public:
 	ImageRescaler() = default;
@@ -78,6 +78,7 @@ private:
 	void clearCache(); // manual deletion of cached elements
 
 	wxBitmap bmp;
+	mutable Bitmap source; //!< the pixels of the bitmap for the pyramid, converted on the first downscale
 	mutable std::unordered_map<int, wxBitmap*> downscaleCache;
 };
 
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cmath>
+
+#include "alias_table.h"
+
+bool AliasTable::build(const float * weights, int count) {
+	bins.clear();
+	if (count <= 0) {
+		return false;
+	}
+	double weightSum = 0.0;
+	for (int i = 0; i < count; ++i) {
+		weightSum += std::max(weights[i], 0.0f);
+	}
+	if (!(weightSum > 0.0)) {
+		return false;
+	}
+	// the weights scaled so the average bin is exactly 1
+	const double scale = count / weightSum;
+	std::vector<double> probabilities(count);
+	std::vector<int> small;
+	std::vector<int> large;
+	small.reserve(count);
+	large.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		probabilities[i] = std::max(weights[i], 0.0f) * scale;
+		if (probabilities[i] < 1.0) {
+			small.push_back(i);
+		} else {
+			large.push_back(i);
+		}
+	}
+	bins.resize(count);
+	const double thresholdScale = 4294967296.0;
+	auto setBin = [&](int i, double probability, int alias) {
+		bins[i].threshold = static_cast<uint32>(std::min(probability * thresholdScale, thresholdScale - 1.0));
+		bins[i].alias = alias;
+	};
+	// fill each small bin with its own outcome and top it up from a large one, which may turn small
+	while (!small.empty() && !large.empty()) {
+		const int s = small.back();
+		small.pop_back();
+		const int l = large.back();
+		setBin(s, probabilities[s], l);
+		probabilities[l] -= 1.0 - probabilities[s];
+		if (probabilities[l] < 1.0) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// the rest are full up to rounding errors
+	for (int i : large) {
+		setBin(i, 1.0, i);
+	}
+	for (int i : small) {
+		setBin(i, 1.0, i);
+	}
+	return true;
+}
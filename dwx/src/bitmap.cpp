@@ -24,6 +24,7 @@
 #include "color.h"
 #include "constants.h"
 #include "ascii_table.h"
+#include "parallel.h"
 
 FloatBitmap::FloatBitmap() noexcept
 	: width(-1)
@@ -166,62 +167,6 @@ const FloatColor * FloatBitmap::operator[](int row) const noexcept {
 	return data + row * width;
 }
 
-// CoeffCache - used for downscaling
-
-struct CoeffCacheElem {
-	int src, dest;
-	float * coefficients;
-	CoeffCacheElem * next;
-};
-
-class CoeffCache {
-	CoeffCacheElem * root;
-public:
-	CoeffCache() {
-		root = nullptr;
-	}
-	~CoeffCache() {
-		CoeffCacheElem * next = nullptr;
-		for (CoeffCacheElem * e = root; e != nullptr; e = next) {
-			next = e->next;
-			delete[] e->coefficients;
-			delete e;
-		}
-	}
-
-	// will return the scaling coefficients with destLen to normalize the resized array properly
-	const float * getCoefficients(const int srcLen, const int destLen) {
-		CoeffCacheElem * e = root;
-		while (e) {
-			if (e->src == srcLen && e->dest == destLen)
-				return e->coefficients;
-			e = e->next;
-		}
-		CoeffCacheElem * newElement = new CoeffCacheElem;
-		newElement->src = srcLen;
-		newElement->dest = destLen;
-		newElement->coefficients = new float[destLen];
-		memset(newElement->coefficients, 0, sizeof(float) * destLen);
-		float ratio = (destLen - 1) / ((float)srcLen - 1);
-		for (int i = 0; i < srcLen; i++) {
-			float x = i * ratio;
-			int xx = int(x);
-			float mul1 = 1.0f - (x - xx);
-			newElement->coefficients[xx] += mul1;
-			if (xx + 1 < destLen)
-				newElement->coefficients[xx + 1] += 1.0f - mul1;
-		}
-		for (int i = 0; i < destLen; i++)
-			newElement->coefficients[i] = 1.0f / newElement->coefficients[i];
-
-		newElement->next = root;
-		root = newElement;
-		return newElement->coefficients;
-	}
-};
-
-static CoeffCache coeffsCache;
-
 // Pixelmap<T>
 
 template class TColor<uint16>;
@@ -260,11 +205,6 @@ template bool Pixelmap<TColor<Complex> >::getChannel<Complex>(Complex *, ColorCh
 template bool Pixelmap<Color>::setChannel<uint8>(const uint8 *, ColorChannel);
 template bool Pixelmap<TColor<Complex> >::setChannel<Complex>(const Complex *, ColorChannel);
 
-template bool Pixelmap<Color>::downscale<TColor<uint16> >(Pixelmap<Color>&, const int, const int) const;
-template bool Pixelmap<Color>::downscale<Color>(Pixelmap<Color>&, const int, const int) const;
-template bool Pixelmap<Color>::downscale<TColor<float> >(Pixelmap<Color>&, const int, const int) const;
-template bool Pixelmap<Color>::downscale<TColor<double> >(Pixelmap<Color>&, const int, const int) const;
-
 template bool Pixelmap<Color>::upscale<TColor<double> >(Pixelmap<Color>&, const int, const int, UpscaleFiltering filterType) const;
 
 template<class ColorType>
@@ -294,6 +234,7 @@ Pixelmap<ColorType>::~Pixelmap() noexcept {
 
 template<class ColorType>
 void Pixelmap<ColorType>::freeMem(void) noexcept {
+	invalidatePyramid();
 	if (data) delete[] data;
 	data = nullptr;
 	width = height = -1;
@@ -332,14 +273,40 @@ inline bool Pixelmap<ColorType>::remapCoord(float& c, int bound, EdgeFillType ed
 
 template<class ColorType>
 void Pixelmap<ColorType>::copy(const Pixelmap<ColorType>& rhs) noexcept {
-	// free memory only if necessary
-	if (width * height != rhs.width * rhs.height) {
+	if (!rhs.isOK()) {
+		freeMem();
+		return;
+	}
+	// free memory only if necessary (an empty pixelmap has the same product of dimensions as a single pixel one)
+	if ((width * height != rhs.width * rhs.height) || nullptr == data) {
 		freeMem();
 		data = new ColorType[rhs.width * rhs.height];
 	}
 	width = rhs.width;
 	height = rhs.height;
 	memcpy(data, rhs.data, width * height * sizeof(ColorType));
+	// the same pixels have the same pyramid, it is shared only if already created, so the copies do not allocate one
+	pyramid = std::atomic_load(&rhs.pyramid);
+}
+
+template<class ColorType>
+std::shared_ptr<PixelmapPyramid<ColorType> > Pixelmap<ColorType>::getPyramid() const {
+	// the pyramid of a const pixelmap may be requested from several threads
+	std::shared_ptr<PixelmapPyramid<ColorType> > current = std::atomic_load(&pyramid);
+	if (!current) {
+		std::shared_ptr<PixelmapPyramid<ColorType> > created = std::make_shared<PixelmapPyramid<ColorType> >();
+		current = (std::atomic_compare_exchange_strong(&pyramid, &current, created) ? created : current);
+	}
+	return current;
+}
+
+template<class ColorType>
+int Pixelmap<ColorType>::getPyramidLevelFor(int minWidth, int minHeight) const noexcept {
+	int level = 0;
+	while ((width >> (level + 1)) >= std::max(minWidth, 1) && (height >> (level + 1)) >= std::max(minHeight, 1)) {
+		++level;
+	}
+	return level;
 }
 
 template<class ColorType>
@@ -403,6 +370,7 @@ template<class ColorType>
 void Pixelmap<ColorType>::generateEmptyImage(int w, int h, bool clear) noexcept {
 	if (w <= 0 || h <= 0)
 		return;
+	invalidatePyramid();
 	// free memory only if necessary
 	if ((width * height != w * h) || nullptr == data) {
 		freeMem();
@@ -417,6 +385,7 @@ void Pixelmap<ColorType>::generateEmptyImage(int w, int h, bool clear) noexcept
 
 template<class ColorType>
 void Pixelmap<ColorType>::fill(ColorType c, int x, int y, int _width, int _height) {
+	invalidatePyramid();
 	// check if the filled area is completely outside this bitmap
 	if (!this->isOK() || (_width != -1 && x + _width < 0) || (_height != -1 && y + _height < 0) || x >= width || y >= height)
 		return;
@@ -534,23 +503,32 @@ template<class ColorType>
 void Pixelmap<ColorType>::setPixel(int x, int y, const ColorType& color) noexcept {
 	if (!data || x < 0 || x >= width || y < 0 || y >= height)
 		return;
+	invalidatePyramid();
 	data[x + y * width] = color;
 }
 
 template<class ColorType>
 void Pixelmap<ColorType>::remap(std::function<ColorType(ColorType)> remapFn) noexcept {
+	invalidatePyramid();
 	for (int i = 0; i < width * height; i++) {
 		data[i] = remapFn(data[i]);
 	}
 }
 
 template<class ColorType>
-ColorType * Pixelmap<ColorType>::getDataPtr() const noexcept {
+const ColorType * Pixelmap<ColorType>::getDataPtr() const noexcept {
+	return data;
+}
+
+template<class ColorType>
+ColorType * Pixelmap<ColorType>::getDataPtr() noexcept {
+	invalidatePyramid();
 	return data;
 }
 
 template<class ColorType>
 ColorType * Pixelmap<ColorType>::operator[](int row) noexcept {
+	invalidatePyramid();
 	return data + row * width;
 }
 
@@ -566,6 +544,7 @@ bool Pixelmap<ColorType>::mirror(PixelmapAxis axis) {
 	} else if (PA_NONE == axis) {
 		return true;
 	}
+	invalidatePyramid();
 	if ((axis & PA_Y_AXIS) != 0) {
 		std::unique_ptr<ColorType[]> tmp(new ColorType[width]);
 		const int halfHeight = height / 2;
@@ -862,6 +841,7 @@ bool Pixelmap<ColorType>::setChannel(const ChannelScalar * channel, ColorChannel
 	if (!this->isOK() || !channel) {
 		return false;
 	}
+	invalidatePyramid();
 
 	const int dim = getDimensionProduct();
 	for (int i = 0; i < dim; ++i) {
@@ -870,71 +850,6 @@ bool Pixelmap<ColorType>::setChannel(const ChannelScalar * channel, ColorChannel
 	return true;
 }
 
-template<class ColorType>
-template<class IntermediateColorType>
-bool Pixelmap<ColorType>::downscale(Pixelmap<ColorType>& downScaled, const int downWidth, const int downHeight) const {
-	if (!this->isOK() || this == &downScaled || downWidth <= 0 || downWidth > width || downHeight <= 0 || downHeight > height) {
-		return false;
-	} else if (downWidth == width && downHeight == height) {
-		downScaled = *this;
-		return true;
-	}
-
-	auto arrayResize = [](const IntermediateColorType * src, const int srcLen, IntermediateColorType * dest, const int destLen, const float * coefficients) {
-		for (int i = 0; i < destLen; ++i)
-			dest[i].makeZero();
-		const float ratio = (destLen - 1) / (float(srcLen - 1));
-		for (int i = 0; i < srcLen; ++i) {
-			const float x = i * ratio;
-			const int xx = int(x);
-			const float mult = 1.0f - (x - xx);
-			dest[xx] += mult * src[i];
-			if (xx + 1 < destLen) {
-				const float multRest = 1.0f - mult;
-				dest[xx + 1] += multRest * src[i];
-			}
-		}
-		for (int i = 0; i < destLen; ++i) {
-			dest[i] *= coefficients[i];
-		}
-	};
-
-	Pixelmap<IntermediateColorType> srcPmp(*this);
-	Pixelmap<IntermediateColorType> destPmp(downWidth, downHeight);
-	IntermediateColorType * srcData = srcPmp.getDataPtr();
-	IntermediateColorType * destData = destPmp.getDataPtr();
-
-	if (width != downWidth) {
-		std::unique_ptr<IntermediateColorType[]> row(new IntermediateColorType[width]);
-		const float * widthCoefficients = coeffsCache.getCoefficients(width, downWidth);
-		for (int y = 0; y < height; ++y) {
-			arrayResize(srcData + (y * width), width, row.get(), downWidth, widthCoefficients);
-			memcpy(srcData + (y * width), row.get(), downWidth * sizeof(IntermediateColorType));
-		}
-	}
-
-	if (height != downHeight) {
-		std::unique_ptr<IntermediateColorType[]> column(new IntermediateColorType[height]);
-		std::unique_ptr<IntermediateColorType[]> newColumn(new IntermediateColorType[downHeight]);
-		const float * heightCoefficients = coeffsCache.getCoefficients(height, downHeight);
-		for (int x = 0; x < downWidth; ++x) {
-			for (int y = 0; y < height; ++y) {
-				column[y] = srcData[x + y * width]; // this has to use the previous width
-			}
-			arrayResize(column.get(), height, newColumn.get(), downHeight, heightCoefficients);
-			for (int y = 0; y < downHeight; ++y) {
-				destData[x + y * downWidth] = newColumn[y];
-			}
-		}
-	} else {
-		for (int y = 0; y < downHeight; ++y) {
-			memcpy(destData + (y * downWidth), srcData + (y * width), downWidth * sizeof(IntermediateColorType));
-		}
-	}
-	downScaled = Pixelmap<ColorType>(destPmp);
-	return true;
-}
-
 template<class ColorType>
 template<class IntermediateColorType>
 bool Pixelmap<ColorType>::upscale(Pixelmap<ColorType>& upScaled, const int upWidth, const int upHeight, UpscaleFiltering filterType) const {
@@ -973,6 +888,47 @@ bool Pixelmap<ColorType>::upscale(Pixelmap<ColorType>& upScaled, const int upWid
 	return true;
 }
 
+// averages the 2x2 blocks of the source in the destination, dropping the odd last row and column
+static void halveBitmap(const Bitmap& src, Bitmap& dst) {
+	const int w = src.getWidth() / 2;
+	const int h = src.getHeight() / 2;
+	dst.generateEmptyImage(w, h, false);
+	const int64 srcStride = static_cast<int64>(src.getWidth()) * 3;
+	const uint8 * srcData = reinterpret_cast<const uint8 *>(src.getDataPtr());
+	uint8 * dstData = reinterpret_cast<uint8 *>(dst.getDataPtr());
+	const int rowsPerTask = 64;
+	parallelFor((h + rowsPerTask - 1) / rowsPerTask, [=](int task, int) {
+		const int yEnd = std::min(h, (task + 1) * rowsPerTask);
+		for (int y = task * rowsPerTask; y < yEnd; ++y) {
+			const uint8 * top = srcData + 2 * y * srcStride;
+			const uint8 * bottom = top + srcStride;
+			uint8 * out = dstData + static_cast<int64>(y) * w * 3;
+			for (int x = 0; x < w; ++x, top += 6, bottom += 6, out += 3) {
+				for (int c = 0; c < 3; ++c) {
+					out[c] = static_cast<uint8>((top[c] + top[c + 3] + bottom[c] + bottom[c + 3] + 2) >> 2);
+				}
+			}
+		}
+	});
+}
+
+template<>
+std::shared_ptr<const Bitmap> Bitmap::getPyramidLevel(int level) const {
+	if (!isOK() || level < 1 || level > 30 || (width >> level) <= 0 || (height >> level) <= 0) {
+		return nullptr;
+	}
+	std::shared_ptr<PixelmapPyramid<Color> > shared = getPyramid();
+	std::lock_guard<std::mutex> lk(shared->levelsMutex);
+	// every missing level is averaged from the previous one
+	while (static_cast<int>(shared->levels.size()) < level) {
+		const Bitmap& previous = (shared->levels.empty() ? *this : *shared->levels.back());
+		std::shared_ptr<Bitmap> next = std::make_shared<Bitmap>();
+		halveBitmap(previous, *next);
+		shared->levels.push_back(next);
+	}
+	return shared->levels[level - 1];
+}
+
 template<class ColorType>
 bool Pixelmap<ColorType>::drawBitmap(Pixelmap<ColorType> & subBmp, const int x, const int y) noexcept {
 	if (!subBmp.isOK() || !this->isOK() || this == &subBmp)
@@ -983,6 +939,7 @@ bool Pixelmap<ColorType>::drawBitmap(Pixelmap<ColorType> & subBmp, const int x,
 	if (x + sw < 0 || y + sh < 0 || x >= width || y >= height) {
 		return false;
 	}
+	invalidatePyramid();
 	if (x < 0 || y < 0 || x + sw > width || y + sh > height) {
 		// calculate the source and destination coordinates
 		const int dx = (x < 0 ? 0 : x);
@@ -1025,6 +982,7 @@ bool Pixelmap<ColorType>::drawAxisAlignedLine(int start, int end, int coord, Pix
 	{
 		return false;
 	}
+	invalidatePyramid();
 	int x0, x1, y0, y1, stepX, stepY;
 	if (PixelmapAxis::PA_X_AXIS == axis) {
 		stepX = 1;
@@ -1052,6 +1010,7 @@ bool Pixelmap<ColorType>::drawCharacter(char ch, int x, int y, const ColorType&
 	if (!isOK() || x + ASCII_TABLE_PACKED_WIDTH < 0 || y + ASCII_TABLE_PACKED_HEIGHT < 0 || x >= width || y >= height) {
 		return false;
 	}
+	invalidatePyramid();
 
 	const int sw = ASCII_TABLE_PACKED_WIDTH;
 	const int sh = ASCII_TABLE_PACKED_HEIGHT;
@@ -1238,12 +1197,12 @@ std::vector<uint32> Histogram<HDL_VALUE>::getChannel(HistogramChannel ch) const
 
 template<>
 void Histogram<HDL_CHANNEL>::setChannel(const std::vector<uint32>& chData, HistogramChannel ch) {
-	memcpy(data + int(ch) * channelSize, chData.data(), std::min(channelSize, int(chData.size())) * sizeof(uint32));
+	memcpy(data + int(ch) * channelSize, chData.data(), std::min(static_cast<int>(channelSize), int(chData.size())) * sizeof(uint32));
 }
 
 template<>
 void Histogram<HDL_VALUE>::setChannel(const std::vector<uint32>& chData, HistogramChannel ch) {
-	const int count = std::min(channelSize, int(chData.size()));
+	const int count = std::min(static_cast<int>(channelSize), int(chData.size()));
 	for (int i = 0; i < count; ++i) {
 		data[i * numChannels + int(ch)] = chData[i];
 	}
@@ -1,60 +1,89 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
 #include "fft_butterfly.h"
 #include "dcomplex.h"
 
-ButterflyFFT::ButterflyFFT(const int _nfft, bool _inverse)
+int fftFriendlySize(int n) {
+	for (int size = std::max(n, 1); ; ++size) {
+		int remainder = size;
+		for (int p : { 2, 3, 5 }) {
+			while (remainder % p == 0) {
+				remainder /= p;
+			}
+		}
+		if (remainder == 1) {
+			return size;
+		}
+	}
+}
+
+template<class T>
+ButterflyFFT<T>::ButterflyFFT(const int _nfft, bool _inverse)
+	: nfft(_nfft)
+	, inverse(_inverse)
+{
+	prepare(FFTPlanner::get().getRadices(nfft, FFTPrecisionOf<T>::value));
+}
+
+template<class T>
+ButterflyFFT<T>::ButterflyFFT(const int _nfft, bool _inverse, const std::vector<int>& radices)
 	: nfft(_nfft)
 	, inverse(_inverse)
 {
-	prepare();
+	prepare(radices);
 }
 
-void ButterflyFFT::transform(const Complex * src, Complex * dest) const {
+template<class T>
+void ButterflyFFT<T>::transform(const ComplexType * src, ComplexType * dest) const {
 	work(0, dest, src, 1, 1);
 }
 
-void ButterflyFFT::transform(const Complex * src, Complex * dest, const int inStride) const {
+template<class T>
+void ButterflyFFT<T>::transform(const ComplexType * src, ComplexType * dest, const int inStride) const {
 	work(0, dest, src, 1, inStride);
 }
 
-void ButterflyFFT::prepare() {
-	// fill the twiddles first
+template<class T>
+size_t ButterflyFFT<T>::getMemoryUsage() const noexcept {
+	return sizeof(*this) + twiddles.capacity() * sizeof(ComplexType) + (stageRadix.capacity() + stageRemainder.capacity()) * sizeof(int);
+}
+
+template<class T>
+void ButterflyFFT<T>::prepare(const std::vector<int>& radices) {
+	// fill the twiddles first - they are always computed in double precision
 	twiddles.resize(nfft);
 	const double phinc = ((inverse ? 2 : -2) * acos(double(-1.0))) / nfft;
 	for (int i = 0; i < nfft; ++i) {
-		twiddles[i] = exp(Complex(0.0, i * phinc));
+		const Complex tw = exp(Complex(0.0, i * phinc));
+		twiddles[i] = ComplexType(static_cast<T>(tw.real()), static_cast<T>(tw.imag()));
 	}
 
 	// now prepare the radixes and remainders
 	int n = nfft;
-	int p = 4;
-	do {
-		while (n % p) {
-			switch (p) {
-			case 4: p = 2; break;
-			case 2: p = 3; break;
-			default: p += 2; break;
-			}
-			if (p * p > n)
-				p = n; // no more factors
-		}
+	for (int p : radices) {
 		n /= p;
 		stageRadix.push_back(p);
 		stageRemainder.push_back(n);
-	} while (n > 1);
+	}
+	DASSERT(n == 1);
 }
 
-template<>
-void ButterflyFFT::butterfly<2>(Complex * fOut, const int fStride, const int m) const {
+template<class T>
+void ButterflyFFT<T>::butterfly2(ComplexType * fOut, const int fStride, const int m) const {
 	for (int k = 0; k < m; ++k) {
-		const Complex t = fOut[m + k] * twiddles[k * fStride];
+		const ComplexType t = fOut[m + k] * twiddles[k * fStride];
 		fOut[m + k] = fOut[k] - t;
 		fOut[k] += t;
 	}
 }
 
-template<>
-void ButterflyFFT::butterfly<4>(Complex * fOut, const int fStride, const int m) const {
-	Complex scratch[6];
+template<class T>
+void ButterflyFFT<T>::butterfly4(ComplexType * fOut, const int fStride, const int m) const {
+	ComplexType scratch[6];
 	const int sign = (inverse ? -1 : 1);
 	for (int k = 0; k < m; ++k) {
 		scratch[0] = fOut[k + m] * twiddles[k * fStride];
@@ -65,7 +94,7 @@ void ButterflyFFT::butterfly<4>(Complex * fOut, const int fStride, const int m)
 		fOut[k] += scratch[1];
 		scratch[3] = scratch[0] + scratch[2];
 		scratch[4] = scratch[0] - scratch[2];
-		scratch[4] = Complex(scratch[4].imag() * sign, -scratch[4].real() * sign);
+		scratch[4] = ComplexType(scratch[4].imag() * sign, -scratch[4].real() * sign);
 
 		fOut[k + 2 * m] = fOut[k] - scratch[3];
 		fOut[k] += scratch[3];
@@ -74,13 +103,13 @@ void ButterflyFFT::butterfly<4>(Complex * fOut, const int fStride, const int m)
 	}
 }
 
-template<>
-void ButterflyFFT::butterfly<3>(Complex * fOut, const int fStride, const int m) const {
+template<class T>
+void ButterflyFFT<T>::butterfly3(ComplexType * fOut, const int fStride, const int m) const {
 	const int m2 = 2 * m;
-	const Complex * tw1 = nullptr;
-	const Complex * tw2 = nullptr;
-	Complex scratch[4];
-	const Complex epi3 = twiddles[fStride * m];
+	const ComplexType * tw1 = nullptr;
+	const ComplexType * tw2 = nullptr;
+	ComplexType scratch[4];
+	const ComplexType epi3 = twiddles[fStride * m];
 	tw1 = tw2 = &twiddles[0];
 	for (int k = m; k > 0; --k) {
 		scratch[1] = fOut[m] * (*tw1);
@@ -90,21 +119,21 @@ void ButterflyFFT::butterfly<3>(Complex * fOut, const int fStride, const int m)
 		tw1 += fStride;
 		tw2 += fStride * 2;
 
-		fOut[m] = Complex(fOut->real() - 0.5 * scratch[3].real(), fOut->imag() - 0.5 * scratch[3].imag());
+		fOut[m] = ComplexType(fOut->real() - T(0.5) * scratch[3].real(), fOut->imag() - T(0.5) * scratch[3].imag());
 		scratch[0] *= epi3.imag();
 		*fOut += scratch[3];
-		fOut[m2] = Complex(fOut[m].real() + scratch[0].imag(), fOut[m].imag() - scratch[0].real());
-		fOut[m] += Complex(-scratch[0].imag(), scratch[0].real());
+		fOut[m2] = ComplexType(fOut[m].real() + scratch[0].imag(), fOut[m].imag() - scratch[0].real());
+		fOut[m] += ComplexType(-scratch[0].imag(), scratch[0].real());
 		++fOut;
 	}
 }
 
-template<>
-void ButterflyFFT::butterfly<5>(Complex * fOut, const int fStride, const int m) const {
-	const Complex tw1 = twiddles[fStride * m];
-	const Complex tw2 = twiddles[fStride * m * 2];
-	Complex scratch[13];
-	Complex * fOutM[5] = { nullptr };
+template<class T>
+void ButterflyFFT<T>::butterfly5(ComplexType * fOut, const int fStride, const int m) const {
+	const ComplexType tw1 = twiddles[fStride * m];
+	const ComplexType tw2 = twiddles[fStride * m * 2];
+	ComplexType scratch[13];
+	ComplexType * fOutM[5] = { nullptr };
 	for (int i = 0; i < _countof(fOutM); ++i) {
 		fOutM[i] = fOut + i * m;
 	}
@@ -123,12 +152,12 @@ void ButterflyFFT::butterfly<5>(Complex * fOut, const int fStride, const int m)
 
 		*fOutM[0] += scratch[7] + scratch[8];
 
-		scratch[5] = scratch[0] + Complex(
+		scratch[5] = scratch[0] + ComplexType(
 			scratch[7].real() * tw1.real() + scratch[8].real() * tw2.real(),
 			scratch[7].imag() * tw1.real() + scratch[8].imag() * tw2.real()
 		);
 
-		scratch[6] = Complex(
+		scratch[6] = ComplexType(
 			scratch[10].imag() * tw1.imag() + scratch[9].imag() * tw2.imag(),
 			-scratch[10].real() * tw1.imag() - scratch[9].real() * tw2.imag()
 		);
@@ -136,12 +165,12 @@ void ButterflyFFT::butterfly<5>(Complex * fOut, const int fStride, const int m)
 		*fOutM[1] = scratch[5] - scratch[6];
 		*fOutM[4] = scratch[5] + scratch[6];
 
-		scratch[11] = scratch[0] + Complex(
+		scratch[11] = scratch[0] + ComplexType(
 			scratch[7].real() * tw2.real() + scratch[8].real() * tw1.real(),
 			scratch[7].imag() * tw2.real() + scratch[8].imag() * tw1.real()
 		);
 
-		scratch[12] = Complex(
+		scratch[12] = ComplexType(
 			-scratch[10].imag() * tw2.imag() + scratch[9].imag() * tw1.imag(),
 			scratch[10].real() * tw2.imag() - scratch[9].real() * tw1.imag()
 		);
@@ -155,9 +184,10 @@ void ButterflyFFT::butterfly<5>(Complex * fOut, const int fStride, const int m)
 	}
 }
 
-void ButterflyFFT::butterflyGeneric(Complex * fOut, const int fStride, const int m, const int p) const {
+template<class T>
+void ButterflyFFT<T>::butterflyGeneric(ComplexType * fOut, const int fStride, const int m, const int p) const {
 	// perform the buttefly for one stage of a mixed radix FFT
-	std::vector<Complex> scratch;
+	std::vector<ComplexType> scratch;
 	scratch.resize(p);
 	for (int u = 0; u < m; ++u) {
 		for (int q = 0, k = u; q < p; ++q, k += m) {
@@ -177,11 +207,12 @@ void ButterflyFFT::butterflyGeneric(Complex * fOut, const int fStride, const int
 	}
 }
 
-void ButterflyFFT::work(const int stage, Complex * fOut, const Complex * f, const int fStride, const int inStride) const {
+template<class T>
+void ButterflyFFT<T>::work(const int stage, ComplexType * fOut, const ComplexType * f, const int fStride, const int inStride) const {
 	const int p = stageRadix[stage];
 	const int m = stageRemainder[stage];
-	Complex * fOutBegin = fOut;
-	const Complex * fOutEnd = fOut + p * m;
+	ComplexType * fOutBegin = fOut;
+	const ComplexType * fOutEnd = fOut + p * m;
 	if (1 == m) {
 		do {
 			*fOut = *f;
@@ -201,76 +232,354 @@ void ButterflyFFT::work(const int stage, Complex * fOut, const Complex * f, cons
 	fOut = fOutBegin;
 
 	switch (p) {
-	case 2: butterfly<2>(fOut, fStride, m); break;
-	case 3: butterfly<3>(fOut, fStride, m); break;
-	case 4: butterfly<4>(fOut, fStride, m); break;
-	case 5: butterfly<5>(fOut, fStride, m); break;
+	case 2: butterfly2(fOut, fStride, m); break;
+	case 3: butterfly3(fOut, fStride, m); break;
+	case 4: butterfly4(fOut, fStride, m); break;
+	case 5: butterfly5(fOut, fStride, m); break;
 	default: butterflyGeneric(fOut, fStride, m, p); break;
 	}
 }
 
-// FFTCache
+template class ButterflyFFT<double>;
+template class ButterflyFFT<float>;
 
-template class FFTCache<2>;
-static FFTCache<2> fftCache2d;
+// FFTPlanner
 
-template<int nd>
-FFTCache<nd>::FFTCache()
+static const int MeasureElements = 1 << 18; //!< approximate number of elements transformed per measurement run
+static const int MeasureRuns = 3; //!< the best of these runs is taken for each candidate
+
+FFTPlanner::FFTPlanner()
+	: measureEnabled(false)
 {}
 
-template<int nd>
-FFTCache<nd>::~FFTCache() {
-	const int cacheSize = static_cast<int>(cache.size());
-	for (int i = 0; i < cacheSize; ++i) {
-		delete cache[i];
-		cache[i] = nullptr;
+std::vector<int> FFTPlanner::getRadices(int nfft, FFTPrecision precision) {
+	const uint64 key = wisdomKey(nfft, precision);
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		auto it = wisdom.find(key);
+		if (it != wisdom.end()) {
+			return it->second;
+		}
+		if (!measureEnabled) {
+			return greedyRadices(nfft);
+		}
+	}
+	// the measurement is done without holding the lock - in the worst case a size is measured twice
+	const std::vector<int> radices = (precision == FP_FLOAT ? measure<float>(nfft) : measure<double>(nfft));
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		wisdom[key] = radices;
+		if (!wisdomPath.empty()) {
+			saveWisdomUnlocked(wisdomPath);
+		}
+	}
+	return radices;
+}
+
+void FFTPlanner::setMeasure(bool enabled) {
+	std::lock_guard<std::mutex> lk(mutex);
+	measureEnabled = enabled;
+}
+
+bool FFTPlanner::getMeasure() const {
+	std::lock_guard<std::mutex> lk(mutex);
+	return measureEnabled;
+}
+
+bool FFTPlanner::setWisdomFile(const std::string& path) {
+	const bool loaded = loadWisdom(path);
+	std::lock_guard<std::mutex> lk(mutex);
+	wisdomPath = path;
+	measureEnabled = true;
+	return loaded;
+}
+
+bool FFTPlanner::loadWisdom(const std::string& path) {
+	std::ifstream in(path);
+	if (!in) {
+		return false;
+	}
+	// every line has the format: <precision> <nfft> <radix> <radix> ...
+	std::unordered_map<uint64, std::vector<int> > loaded;
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream lineStream(line);
+		std::string precisionName;
+		int nfft = 0;
+		if (!(lineStream >> precisionName >> nfft) || nfft < 1) {
+			continue;
+		}
+		FFTPrecision precision = FP_COUNT;
+		if (precisionName == "double") {
+			precision = FP_DOUBLE;
+		} else if (precisionName == "float") {
+			precision = FP_FLOAT;
+		} else {
+			continue;
+		}
+		std::vector<int> radices;
+		int product = 1;
+		int radix = 0;
+		while (lineStream >> radix && radix > 0) {
+			radices.push_back(radix);
+			product *= radix;
+		}
+		// ignore entries which do not factor the size correctly
+		if (!radices.empty() && product == nfft) {
+			loaded[wisdomKey(nfft, precision)] = radices;
+		}
+	}
+	std::lock_guard<std::mutex> lk(mutex);
+	for (const auto& entry : loaded) {
+		wisdom[entry.first] = entry.second;
 	}
+	return true;
 }
 
-template<int nd>
-const MultiDimFFT<nd>& FFTCache<nd>::getFFT(const std::vector<int>& dims, bool inverse) {
-	DASSERT(nd == dims.size());
-	MultiDimFFT<nd> * fft = nullptr;
-	const int cacheSize = static_cast<int>(cache.size());
-	for (int i = 0; i < cacheSize; ++i) {
-		CachedFFT<nd> * cached = cache[i];
-		// now check its dimensions
-		bool match = true;
-		for (int j = 0; j < nd; ++j) {
-			match &= (dims[j] == cached->dims[j]);
+bool FFTPlanner::saveWisdom(const std::string& path) const {
+	std::lock_guard<std::mutex> lk(mutex);
+	return saveWisdomUnlocked(path);
+}
+
+bool FFTPlanner::saveWisdomUnlocked(const std::string& path) const {
+	std::ofstream out(path, std::ios::trunc);
+	if (!out) {
+		return false;
+	}
+	out << "# fft wisdom: <precision> <size> <stage radices>" << std::endl;
+	for (const auto& entry : wisdom) {
+		const FFTPrecision precision = static_cast<FFTPrecision>(entry.first >> 32);
+		const int nfft = static_cast<int>(entry.first & 0xffffffff);
+		out << (precision == FP_FLOAT ? "float" : "double") << " " << nfft;
+		for (int radix : entry.second) {
+			out << " " << radix;
 		}
-		if (match) {
-			// we have a match, now check if there is an allocated fft
-			if (inverse) {
-				if (!cached->inverse) {
-					cached->inverse.reset(new MultiDimFFT<nd>(dims, inverse));
-				}
-				fft = cached->inverse.get();
-			} else {
-				if (!cached->forward) {
-					cached->forward.reset(new MultiDimFFT<nd>(dims, inverse));
-				}
-				fft = cached->forward.get();
+		out << std::endl;
+	}
+	return static_cast<bool>(out);
+}
+
+std::vector<int> FFTPlanner::greedyRadices(int nfft) {
+	std::vector<int> radices;
+	int n = nfft;
+	int p = 4;
+	do {
+		while (n % p) {
+			switch (p) {
+			case 4: p = 2; break;
+			case 2: p = 3; break;
+			default: p += 2; break;
 			}
-			break;
+			if (p * p > n)
+				p = n; // no more factors
 		}
+		n /= p;
+		radices.push_back(p);
+	} while (n > 1);
+	return radices;
+}
+
+std::vector<std::vector<int> > FFTPlanner::candidateRadices(int nfft) {
+	std::vector<std::vector<int> > candidates;
+	candidates.push_back(greedyRadices(nfft));
+	if (nfft < 4) {
+		return candidates;
 	}
-	// if there is still no match, create a new CachedFFT object
-	if (!fft) {
-		CachedFFT<nd> * cfft = new CachedFFT<nd>;
-		cfft->dims = dims;
-		fft = new MultiDimFFT<nd>(dims, inverse);
-		if (inverse) {
-			cfft->inverse.reset(fft);
-		} else {
-			cfft->forward.reset(fft);
+
+	// split the size to a power of two and the odd prime factors
+	int n = nfft;
+	int twos = 0;
+	while (n % 2 == 0) {
+		n /= 2;
+		++twos;
+	}
+	std::vector<int> oddFactors;
+	for (int p = 3; n > 1; p += 2) {
+		if (p * p > n) {
+			p = n;
+		}
+		while (n % p == 0) {
+			oddFactors.push_back(p);
+			n /= p;
+		}
+	}
+
+	// try with and without radix 4 stages, each in ascending and descending order
+	for (int useFours = 0; useFours < 2; ++useFours) {
+		std::vector<int> radices;
+		int remainingTwos = twos;
+		while (useFours && remainingTwos >= 2) {
+			radices.push_back(4);
+			remainingTwos -= 2;
+		}
+		radices.insert(radices.end(), remainingTwos, 2);
+		radices.insert(radices.end(), oddFactors.begin(), oddFactors.end());
+		std::sort(radices.begin(), radices.end());
+		for (int order = 0; order < 2; ++order) {
+			if (std::find(candidates.begin(), candidates.end(), radices) == candidates.end()) {
+				candidates.push_back(radices);
+			}
+			std::reverse(radices.begin(), radices.end());
+		}
+	}
+	return candidates;
+}
+
+template<class T>
+std::vector<int> FFTPlanner::measure(int nfft) {
+	const std::vector<std::vector<int> > candidates = candidateRadices(nfft);
+	if (candidates.size() == 1) {
+		return candidates[0];
+	}
+
+	std::vector<TComplex<T> > src(nfft);
+	std::vector<TComplex<T> > dest(nfft);
+	for (int i = 0; i < nfft; ++i) {
+		src[i] = TComplex<T>(static_cast<T>((i * 7919) % 256), static_cast<T>(0));
+	}
+	const int repetitions = std::max(1, MeasureElements / nfft);
+
+	int bestCandidate = 0;
+	int64 bestDuration = std::numeric_limits<int64>::max();
+	for (int c = 0; c < static_cast<int>(candidates.size()); ++c) {
+		const ButterflyFFT<T> fft(nfft, false, candidates[c]);
+		// warm up the caches before measuring
+		fft.transform(src.data(), dest.data());
+		int64 duration = std::numeric_limits<int64>::max();
+		for (int run = 0; run < MeasureRuns; ++run) {
+			const auto start = std::chrono::steady_clock::now();
+			for (int r = 0; r < repetitions; ++r) {
+				fft.transform(src.data(), dest.data());
+			}
+			const auto end = std::chrono::steady_clock::now();
+			duration = std::min<int64>(duration, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		}
+		if (duration < bestDuration) {
+			bestDuration = duration;
+			bestCandidate = c;
 		}
-		cache.push_back(cfft);
 	}
-	return *fft;
+	return candidates[bestCandidate];
+}
+
+uint64 FFTPlanner::wisdomKey(int nfft, FFTPrecision precision) noexcept {
+	return (static_cast<uint64>(precision) << 32) | static_cast<uint64>(static_cast<uint32>(nfft));
+}
+
+FFTPlanner& FFTPlanner::get() {
+	static FFTPlanner planner;
+	return planner;
+}
+
+// FFTCache
+
+static FFTCache<2, double> fftCache2d;
+static FFTCache<2, float> fftCache2dFloat;
+
+template<int nd, class T>
+FFTCache<nd, T>::FFTCache(size_t memoryBudget)
+	: cache(memoryBudget)
+{}
+
+template<int nd, class T>
+typename FFTCache<nd, T>::FFTPtr FFTCache<nd, T>::getFFT(const std::vector<int>& dims, bool inverse) {
+	DASSERT(nd == dims.size());
+	FFTPlanKey<nd> key;
+	for (int i = 0; i < nd; ++i) {
+		key.dims[i] = dims[i];
+	}
+	key.inverse = inverse;
+	FFTPtr fft = cache.find(key);
+	if (!fft) {
+		// the plan is created outside of the cache lock, so other sizes are not blocked meanwhile
+		FFTPtr created = std::make_shared<const MultiDimFFT<nd, T> >(dims, inverse);
+		fft = cache.insert(key, created, created->getMemoryUsage());
+	}
+	return fft;
+}
+
+template<int nd, class T>
+void FFTCache<nd, T>::setMemoryBudget(size_t bytes) {
+	cache.setBudget(bytes);
+}
+
+template<int nd, class T>
+size_t FFTCache<nd, T>::getMemoryBudget() const {
+	return cache.getBudget();
 }
 
 template<>
-FFTCache<2>& FFTCache<2>::get() {
+FFTCache<2, double>& FFTCache<2, double>::get() {
 	return fftCache2d;
 }
+
+template<>
+FFTCache<2, float>& FFTCache<2, float>::get() {
+	return fftCache2dFloat;
+}
+
+template class FFTCache<2, double>;
+template class FFTCache<2, float>;
+
+// SpectrumCache
+
+static SpectrumCache<double> spectrumCacheDouble;
+static SpectrumCache<float> spectrumCacheFloat;
+
+size_t SpectrumKeyHash::operator()(const SpectrumKey& key) const noexcept {
+	// FNV-1a over the dimensions and the raw bytes of the source
+	uint64 h = 14695981039346656037ULL;
+	auto hashBytes = [&h](const void * bytes, size_t count) {
+		const uint8 * ptr = reinterpret_cast<const uint8 *>(bytes);
+		for (size_t i = 0; i < count; ++i) {
+			h = (h ^ ptr[i]) * 1099511628211ULL;
+		}
+	};
+	hashBytes(key.name.data(), key.name.size());
+	hashBytes(&key.width, sizeof(key.width));
+	hashBytes(&key.height, sizeof(key.height));
+	hashBytes(key.source.data(), key.source.size() * sizeof(float));
+	return static_cast<size_t>(h);
+}
+
+template<class T>
+SpectrumCache<T>::SpectrumCache(size_t memoryBudget)
+	: cache(memoryBudget)
+{}
+
+template<class T>
+typename SpectrumCache<T>::SpectrumPtr SpectrumCache<T>::find(const SpectrumKey& key) {
+	return cache.find(key);
+}
+
+template<class T>
+typename SpectrumCache<T>::SpectrumPtr SpectrumCache<T>::insert(const SpectrumKey& key, SpectrumPtr spectrum) {
+	const size_t cost = spectrum->size() * sizeof(TComplex<T>) + key.source.size() * sizeof(float);
+	return cache.insert(key, spectrum, cost);
+}
+
+template<class T>
+void SpectrumCache<T>::setMemoryBudget(size_t bytes) {
+	cache.setBudget(bytes);
+}
+
+template<class T>
+size_t SpectrumCache<T>::getMemoryBudget() const {
+	return cache.getBudget();
+}
+
+template<>
+SpectrumCache<double>& SpectrumCache<double>::get() {
+	return spectrumCacheDouble;
+}
+
+template<>
+SpectrumCache<float>& SpectrumCache<float>::get() {
+	return spectrumCacheFloat;
+}
+
+template class SpectrumCache<double>;
+template class SpectrumCache<float>;
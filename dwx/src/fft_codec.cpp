@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "fft_codec.h"
+#include "fft_image.h"
+#include "util.h"
+
+static const char CodecMagic[4] = { 'D', 'W', 'X', 'F' };
+static const uint8 CodecVersion = 1;
+// the largest image in the stream, so a corrupted header cannot make the decoder allocate a huge spectrum
+static const int64 MaxDimensionProduct = 1 << 26;
+// the largest magnitude of a quantized coefficient, so its interleaved code still fits in 32 bits with a margin
+static const double MaxQuantizedMagnitude = 1 << 29;
+
+// writes bits to a stream, the first bit of a byte is its least significant one
+class BitWriter {
+	std::ostream& out;
+	uint32 accumulator;
+	int bitCount;
+public:
+	BitWriter(std::ostream& _out)
+		: out(_out)
+		, accumulator(0)
+		, bitCount(0)
+	{}
+
+	void writeBits(uint32 value, int count) {
+		for (int i = 0; i < count; ++i) {
+			accumulator |= ((value >> i) & 1) << bitCount;
+			if (++bitCount == 8) {
+				out.put(static_cast<char>(accumulator));
+				accumulator = 0;
+				bitCount = 0;
+			}
+		}
+	}
+
+	// pads the last byte with zeroes
+	void flush() {
+		if (bitCount > 0) {
+			out.put(static_cast<char>(accumulator));
+			accumulator = 0;
+			bitCount = 0;
+		}
+	}
+};
+
+class BitReader {
+	std::istream& in;
+	uint32 accumulator;
+	int bitCount;
+public:
+	BitReader(std::istream& _in)
+		: in(_in)
+		, accumulator(0)
+		, bitCount(0)
+	{}
+
+	// returns false if the stream ended
+	bool readBits(uint32& value, int count) {
+		value = 0;
+		for (int i = 0; i < count; ++i) {
+			if (bitCount == 0) {
+				const int byte = in.get();
+				if (byte == std::char_traits<char>::eof()) {
+					return false;
+				}
+				accumulator = static_cast<uint32>(byte);
+				bitCount = 8;
+			}
+			value |= (accumulator & 1) << i;
+			accumulator >>= 1;
+			--bitCount;
+		}
+		return true;
+	}
+};
+
+// adaptive Golomb-Rice coder of signed integers - the parameter follows the running mean of the coded magnitudes
+class RiceCoder {
+	static const int EscapeQuotient = 24; //!< longer unary prefixes are replaced by the raw value
+	static const uint32 ResetCount = 64;
+	uint32 magnitudeSum;
+	uint32 count;
+
+	int getParameter() const noexcept {
+		int k = 0;
+		while ((count << k) < magnitudeSum && k < 31) {
+			++k;
+		}
+		return k;
+	}
+
+	void update(uint32 mapped) noexcept {
+		magnitudeSum += std::min<uint32>(mapped, 1 << 24);
+		if (++count == ResetCount) {
+			magnitudeSum >>= 1;
+			count >>= 1;
+		}
+	}
+public:
+	RiceCoder()
+		: magnitudeSum(4)
+		, count(1)
+	{}
+
+	void encode(BitWriter& writer, int32 value) {
+		// interleave the negative and positive values, so small magnitudes map to small codes
+		const uint32 mapped = (value >= 0 ? static_cast<uint32>(value) << 1 : (static_cast<uint32>(-(value + 1)) << 1) | 1);
+		const int k = getParameter();
+		const uint32 quotient = mapped >> k;
+		if (quotient < EscapeQuotient) {
+			writer.writeBits((1u << quotient) - 1, quotient + 1);
+			writer.writeBits(mapped, k);
+		} else {
+			writer.writeBits((1u << EscapeQuotient) - 1, EscapeQuotient);
+			writer.writeBits(mapped, 32);
+		}
+		update(mapped);
+	}
+
+	bool decode(BitReader& reader, int32& value) {
+		const int k = getParameter();
+		uint32 quotient = 0;
+		uint32 bit = 1;
+		while (quotient < EscapeQuotient) {
+			if (!reader.readBits(bit, 1)) {
+				return false;
+			}
+			if (!bit) {
+				break;
+			}
+			++quotient;
+		}
+		uint32 mapped = 0;
+		if (quotient < EscapeQuotient) {
+			uint32 remainder = 0;
+			if (!reader.readBits(remainder, k)) {
+				return false;
+			}
+			mapped = (quotient << k) | remainder;
+		} else if (!reader.readBits(mapped, 32)) {
+			return false;
+		}
+		value = ((mapped & 1) ? -static_cast<int32>(mapped >> 1) - 1 : static_cast<int32>(mapped >> 1));
+		update(mapped);
+		return true;
+	}
+};
+
+static void writeUint32(std::ostream& out, uint32 value) {
+	for (int i = 0; i < 4; ++i) {
+		out.put(static_cast<char>((value >> (i * 8)) & 0xff));
+	}
+}
+
+static bool readUint32(std::istream& in, uint32& value) {
+	value = 0;
+	for (int i = 0; i < 4; ++i) {
+		const int byte = in.get();
+		if (byte == std::char_traits<char>::eof()) {
+			return false;
+		}
+		value |= static_cast<uint32>(byte) << (i * 8);
+	}
+	return true;
+}
+
+// returns the offsets of the retained coefficients from one half of the spectrum ordered by increasing frequency
+// a coefficient is retained if both it and its mirror are outside of the zeroed high frequency strips
+static std::vector<int> getCoefficientOrder(int width, int height, int compWidth, int compHeight) {
+	const int compWidthRemainder = width - compWidth;
+	const int compHeightRemainder = height - compHeight;
+	const int compX = (width - compWidthRemainder) / 2;
+	const int compY = (height - compHeightRemainder) / 2;
+	auto inStrips = [=](int x, int y) {
+		return (y > compY && y < compY + compHeightRemainder) || (x > compX && x < compX + compWidthRemainder);
+	};
+	// pairs of the squared normalized frequency and the offset of the coefficient
+	std::vector<std::pair<double, int> > coefficients;
+	for (int y = 0; y < height; ++y) {
+		const int my = (y == 0 ? 0 : height - y);
+		const double fy = static_cast<double>(y <= height / 2 ? y : y - height) / height;
+		for (int x = 0; x < width; ++x) {
+			const int mx = (x == 0 ? 0 : width - x);
+			const int offset = y * width + x;
+			if (offset > my * width + mx || inStrips(x, y) || inStrips(mx, my)) {
+				continue;
+			}
+			const double fx = static_cast<double>(x <= width / 2 ? x : x - width) / width;
+			coefficients.push_back(std::make_pair(fx * fx + fy * fy, offset));
+		}
+	}
+	// the sort is stable, so the order depends only on the dimensions
+	std::stable_sort(coefficients.begin(), coefficients.end(), [](const std::pair<double, int>& lhs, const std::pair<double, int>& rhs) {
+		return lhs.first < rhs.first;
+	});
+	std::vector<int> order(coefficients.size());
+	for (size_t i = 0; i < coefficients.size(); ++i) {
+		order[i] = coefficients[i].second;
+	}
+	return order;
+}
+
+template<class T>
+bool FFTCodec<T>::encode(const Bitmap& bmp, int compWidth, int compHeight, float quantStep, std::ostream& out) {
+	if (!bmp.isOK() || quantStep <= 0.0f) {
+		return false;
+	}
+	const int width = bmp.getWidth();
+	const int height = bmp.getHeight();
+	if (static_cast<int64>(width) * height > MaxDimensionProduct) {
+		return false;
+	}
+	compWidth = clamp(compWidth, 1, width);
+	compHeight = clamp(compHeight, 1, height);
+	// no coefficient is larger than the dc one of a white image, which is 255 * sqrt(width * height) levels
+	const double dimSqrt = std::sqrt(static_cast<double>(width) * height);
+	quantStep = std::max(quantStep, static_cast<float>(255.0 * dimSqrt / MaxQuantizedMagnitude));
+
+	ColorSpectrum<T> spectrum(width, height);
+	spectrum.forward(bmp);
+
+	out.write(CodecMagic, sizeof(CodecMagic));
+	out.put(static_cast<char>(CodecVersion));
+	writeUint32(out, static_cast<uint32>(width));
+	writeUint32(out, static_cast<uint32>(height));
+	writeUint32(out, static_cast<uint32>(compWidth));
+	writeUint32(out, static_cast<uint32>(compHeight));
+	uint32 stepBits = 0;
+	memcpy(&stepBits, &quantStep, sizeof(stepBits));
+	writeUint32(out, stepBits);
+
+	// the spectrum is of the channels normalized to [0, 1], so the quantization is scaled back to color levels
+	// using the orthonormal transform, where the error of a coefficient maps to the same error in the signal
+	const double quantScale = 255.0 / (dimSqrt * quantStep);
+	const std::vector<int> order = getCoefficientOrder(width, height, compWidth, compHeight);
+	BitWriter writer(out);
+	for (int cc = 0; cc < ColorChannel::CC_COUNT; ++cc) {
+		RiceCoder coder;
+		for (int offset : order) {
+			const int x = offset % width;
+			const int y = offset / width;
+			const TComplex<T> coeff = spectrum.getCoefficient(static_cast<ColorChannel>(cc), x, y);
+			coder.encode(writer, static_cast<int32>(std::lround(coeff.real() * quantScale)));
+			// the coefficients which are their own mirrors are real
+			const int mx = (x == 0 ? 0 : width - x);
+			const int my = (y == 0 ? 0 : height - y);
+			if (mx != x || my != y) {
+				coder.encode(writer, static_cast<int32>(std::lround(coeff.imag() * quantScale)));
+			}
+		}
+	}
+	writer.flush();
+	return out.good();
+}
+
+template<class T>
+bool FFTCodec<T>::decode(std::istream& in, Bitmap& bmp) {
+	char magic[sizeof(CodecMagic)] = { 0 };
+	if (!in.read(magic, sizeof(magic)) || memcmp(magic, CodecMagic, sizeof(magic)) != 0 || in.get() != CodecVersion) {
+		return false;
+	}
+	uint32 width = 0;
+	uint32 height = 0;
+	uint32 compWidth = 0;
+	uint32 compHeight = 0;
+	uint32 stepBits = 0;
+	if (!readUint32(in, width) || !readUint32(in, height) || !readUint32(in, compWidth) || !readUint32(in, compHeight) || !readUint32(in, stepBits)) {
+		return false;
+	}
+	float quantStep = 0.0f;
+	memcpy(&quantStep, &stepBits, sizeof(quantStep));
+	if (width == 0 || height == 0 || static_cast<int64>(width) * height > MaxDimensionProduct ||
+		compWidth == 0 || compHeight == 0 || compWidth > width || compHeight > height ||
+		!(quantStep > 0.0f))
+	{
+		return false;
+	}
+
+	const int w = static_cast<int>(width);
+	const int h = static_cast<int>(height);
+	const std::vector<int> order = getCoefficientOrder(w, h, static_cast<int>(compWidth), static_cast<int>(compHeight));
+	// every coefficient of every channel takes at least a bit, so a truncated stream is rejected before the allocation
+	const std::streampos start = in.tellg();
+	if (start != std::streampos(-1)) {
+		in.seekg(0, std::ios::end);
+		const std::streamoff remaining = in.tellg() - start;
+		in.seekg(start);
+		if (!in || remaining * 8 < static_cast<std::streamoff>(order.size()) * ColorChannel::CC_COUNT) {
+			return false;
+		}
+	}
+
+	ColorSpectrum<T> spectrum(w, h);
+	const int dimProd = w * h;
+	for (int p = 0; p < ColorSpectrum<T>::PlaneCount; ++p) {
+		std::fill(spectrum.getPlane(p), spectrum.getPlane(p) + dimProd, TComplex<T>());
+	}
+
+	const T dequantScale = static_cast<T>(std::sqrt(static_cast<double>(w) * h) * quantStep / 255.0);
+	TComplex<T> * planeRG = spectrum.getPlane(0);
+	TComplex<T> * planeB = spectrum.getPlane(1);
+	BitReader reader(in);
+	for (int cc = 0; cc < ColorChannel::CC_COUNT; ++cc) {
+		RiceCoder coder;
+		for (int offset : order) {
+			const int x = offset % w;
+			const int y = offset / w;
+			const int mx = (x == 0 ? 0 : w - x);
+			const int my = (y == 0 ? 0 : h - y);
+			const int mirrorOffset = my * w + mx;
+			int32 re = 0;
+			int32 im = 0;
+			if (!coder.decode(reader, re) || (mirrorOffset != offset && !coder.decode(reader, im))) {
+				return false;
+			}
+			const TComplex<T> coeff(re * dequantScale, im * dequantScale);
+			// fill the coefficient and its mirror of the real channel in the packed planes
+			if (cc == ColorChannel::CC_BLUE) {
+				planeB[offset] = coeff;
+				planeB[mirrorOffset] = coeff.conjugate();
+			} else if (cc == ColorChannel::CC_RED) {
+				planeRG[offset] += coeff;
+				if (mirrorOffset != offset) {
+					planeRG[mirrorOffset] += coeff.conjugate();
+				}
+			} else {
+				// multiplied by i
+				planeRG[offset] += TComplex<T>(-coeff.imag(), coeff.real());
+				if (mirrorOffset != offset) {
+					planeRG[mirrorOffset] += TComplex<T>(coeff.imag(), coeff.real());
+				}
+			}
+		}
+	}
+	return spectrum.inverse(bmp);
+}
+
+template class FFTCodec<double>;
+template class FFTCodec<float>;
@@ -0,0 +1,124 @@
+#include "fft_image.h"
+#include "util.h"
+
+template<class T>
+ColorSpectrum<T>::ColorSpectrum(int _width, int _height)
+	: width(_width)
+	, height(_height)
+{
+	std::vector<int> dims;
+	dims.push_back(height);
+	dims.push_back(width);
+	forwardFFT = FFTCache<2, T>::get().getFFT(dims, false);
+	inverseFFT = FFTCache<2, T>::get().getFFT(dims, true);
+	const int dimProd = width * height;
+	for (int p = 0; p < PlaneCount; ++p) {
+		planes[p].reset(new ComplexType[dimProd]);
+	}
+	scratch.reset(new ComplexType[forwardFFT->getScratchSize()]);
+}
+
+template<class T>
+bool ColorSpectrum<T>::forward(const Bitmap& bmp, int x0, int y0) {
+	if (!bmp.isOK()) {
+		return false;
+	}
+	const int bmpWidth = bmp.getWidth();
+	const int bmpHeight = bmp.getHeight();
+	const Color * bmpData = bmp.getDataPtr();
+	const T colorNorm = static_cast<T>(1.0 / 255.0);
+	ComplexType * planeRG = planes[0].get();
+	ComplexType * planeB = planes[1].get();
+	int sy = ((y0 % bmpHeight) + bmpHeight) % bmpHeight;
+	const int sx0 = ((x0 % bmpWidth) + bmpWidth) % bmpWidth;
+	for (int y = 0; y < height; ++y) {
+		const Color * bmpRow = bmpData + sy * bmpWidth;
+		ComplexType * rowRG = planeRG + y * width;
+		ComplexType * rowB = planeB + y * width;
+		for (int x = 0, sx = sx0; x < width; ++x) {
+			const Color& c = bmpRow[sx];
+			rowRG[x] = ComplexType(c.r * colorNorm, c.g * colorNorm);
+			rowB[x] = ComplexType(c.b * colorNorm, static_cast<T>(0));
+			if (++sx == bmpWidth) {
+				sx = 0;
+			}
+		}
+		if (++sy == bmpHeight) {
+			sy = 0;
+		}
+	}
+	// the transforms are in place
+	for (int p = 0; p < PlaneCount; ++p) {
+		forwardFFT->transform(planes[p].get(), planes[p].get(), scratch.get());
+	}
+	return true;
+}
+
+template<class T>
+bool ColorSpectrum<T>::inverse(Bitmap& bmp, int sx, int sy, int regionWidth, int regionHeight, int dx, int dy) {
+	if (!bmp.isOK() ||
+		sx < 0 || sy < 0 || sx + regionWidth > width || sy + regionHeight > height ||
+		dx < 0 || dy < 0 || dx + regionWidth > bmp.getWidth() || dy + regionHeight > bmp.getHeight())
+	{
+		return false;
+	}
+	for (int p = 0; p < PlaneCount; ++p) {
+		inverseFFT->transform(planes[p].get(), planes[p].get(), scratch.get());
+	}
+	const int bmpWidth = bmp.getWidth();
+	Color * bmpData = bmp.getDataPtr();
+	const T colorScale = static_cast<T>(255.0 / (width * height));
+	const T colorMax = static_cast<T>(255);
+	const T colorMin = static_cast<T>(0);
+	for (int y = 0; y < regionHeight; ++y) {
+		const ComplexType * rowRG = planes[0].get() + (sy + y) * width + sx;
+		const ComplexType * rowB = planes[1].get() + (sy + y) * width + sx;
+		Color * bmpRow = bmpData + (dy + y) * bmpWidth + dx;
+		for (int x = 0; x < regionWidth; ++x) {
+			bmpRow[x] = Color(
+				static_cast<uint8>(clamp(rowRG[x].real() * colorScale, colorMin, colorMax)),
+				static_cast<uint8>(clamp(rowRG[x].imag() * colorScale, colorMin, colorMax)),
+				static_cast<uint8>(clamp(rowB[x].real() * colorScale, colorMin, colorMax))
+			);
+		}
+	}
+	return true;
+}
+
+template<class T>
+bool ColorSpectrum<T>::inverse(Bitmap& bmp) {
+	bmp.generateEmptyImage(width, height);
+	return inverse(bmp, 0, 0, width, height, 0, 0);
+}
+
+template<class T>
+void ColorSpectrum<T>::multiply(const ComplexType * filter) noexcept {
+	const int dimProd = width * height;
+	for (int p = 0; p < PlaneCount; ++p) {
+		ComplexType * plane = planes[p].get();
+		for (int i = 0; i < dimProd; ++i) {
+			plane[i] = filter[i] * plane[i];
+		}
+	}
+}
+
+template<class T>
+typename ColorSpectrum<T>::ComplexType ColorSpectrum<T>::getCoefficient(ColorChannel cc, int x, int y) const noexcept {
+	if (cc == ColorChannel::CC_BLUE) {
+		return planes[1][y * width + x];
+	}
+	// the red and green channels are packed as r + i * g
+	const int mx = (x == 0 ? 0 : width - x);
+	const int my = (y == 0 ? 0 : height - y);
+	return unpackSpectrum(planes[0][y * width + x], planes[0][my * width + mx], cc == ColorChannel::CC_GREEN);
+}
+
+template<class T>
+void ColorSpectrum<T>::zeroCoefficient(int x, int y) noexcept {
+	for (int p = 0; p < PlaneCount; ++p) {
+		planes[p][y * width + x] = ComplexType();
+	}
+}
+
+template class ColorSpectrum<double>;
+template class ColorSpectrum<float>;
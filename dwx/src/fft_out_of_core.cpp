@@ -0,0 +1,192 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "fft_out_of_core.h"
+#include "fft_butterfly.h"
+#include "parallel.h"
+
+// MappedFile
+
+MappedFile::MappedFile()
+	: data(nullptr)
+	, size(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE)
+	, mappingHandle(nullptr)
+#else
+	, fileDescriptor(-1)
+#endif
+{}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::create(const std::string& _path, uint64 _size) {
+	close();
+	if (_size == 0) {
+		return false;
+	}
+	path = _path;
+	size = _size;
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		close();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffff), nullptr);
+	if (!mappingHandle) {
+		close();
+		return false;
+	}
+	data = reinterpret_cast<uint8 *>(MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+#else
+	fileDescriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fileDescriptor < 0 || ftruncate(fileDescriptor, static_cast<off_t>(size)) != 0) {
+		close();
+		return false;
+	}
+	void * mapped = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+	data = (mapped == MAP_FAILED ? nullptr : reinterpret_cast<uint8 *>(mapped));
+#endif
+	if (!data) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (data) {
+		munmap(data, static_cast<size_t>(size));
+	}
+	if (fileDescriptor >= 0) {
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+#endif
+	if (!path.empty()) {
+		remove(path.c_str());
+		path.clear();
+	}
+	data = nullptr;
+	size = 0;
+}
+
+std::string MappedFile::temporaryPath(const std::string& prefix) {
+	static std::atomic<unsigned> fileCounter(0);
+	std::string directory;
+#ifdef _WIN32
+	char tempDir[MAX_PATH + 1] = { 0 };
+	if (GetTempPathA(MAX_PATH + 1, tempDir)) {
+		directory = tempDir;
+	}
+#else
+	const char * tempDir = getenv("TMPDIR");
+	directory = (tempDir ? tempDir : "/tmp");
+	directory += "/";
+#endif
+	std::ostringstream name;
+	name << directory << prefix << "_" << std::chrono::steady_clock::now().time_since_epoch().count() << "_" << fileCounter++ << ".tmp";
+	return name.str();
+}
+
+// OutOfCoreFFT2D
+
+template<class T>
+OutOfCoreFFT2D<T>::OutOfCoreFFT2D(int _width, int _height, size_t _ramBudget)
+	: width(_width)
+	, height(_height)
+	, ramBudget(_ramBudget)
+{}
+
+template<class T>
+bool OutOfCoreFFT2D<T>::create(const std::string& scratchPath) {
+	const uint64 planeSize = static_cast<uint64>(width) * height * sizeof(ComplexType);
+	return file.create(scratchPath.empty() ? MappedFile::temporaryPath("fft_scratch") : scratchPath, planeSize);
+}
+
+template<class T>
+bool OutOfCoreFFT2D<T>::transform(bool inverse, const std::function<bool()>& abortCheck) {
+	if (!file.isOK()) {
+		return false;
+	}
+	auto aborted = [&abortCheck]() {
+		return abortCheck && abortCheck();
+	};
+	ComplexType * data = getData();
+	const ButterflyFFT<T> rowFFT(width, inverse);
+	const ButterflyFFT<T> columnFFT(height, inverse);
+	const size_t budgetElements = std::max<size_t>(ramBudget / sizeof(ComplexType), 1);
+
+	// step one - transform the rows in panels, reading each panel to RAM and writing the transformed rows back
+	const int panelRows = static_cast<int>(clamp<size_t>(budgetElements / width, 1, height));
+	std::unique_ptr<ComplexType[]> rowPanel(new ComplexType[static_cast<size_t>(panelRows) * width]);
+	for (int y0 = 0; y0 < height && !aborted(); y0 += panelRows) {
+		const int rows = std::min(panelRows, height - y0);
+		ComplexType * fileRows = data + static_cast<size_t>(y0) * width;
+		memcpy(rowPanel.get(), fileRows, static_cast<size_t>(rows) * width * sizeof(ComplexType));
+		parallelFor(rows, [&](int r, int) {
+			rowFFT.transform(rowPanel.get() + static_cast<size_t>(r) * width, fileRows + static_cast<size_t>(r) * width);
+		});
+	}
+	rowPanel.reset();
+
+	// step two - transform the columns in panels, the input and output panels share the budget
+	const int panelColumns = static_cast<int>(clamp<size_t>(budgetElements / (2 * static_cast<size_t>(height)), 1, width));
+	const size_t columnPanelSize = static_cast<size_t>(panelColumns) * height;
+	std::unique_ptr<ComplexType[]> columnPanel(new ComplexType[columnPanelSize]);
+	std::unique_ptr<ComplexType[]> transformedPanel(new ComplexType[columnPanelSize]);
+	for (int x0 = 0; x0 < width && !aborted(); x0 += panelColumns) {
+		const int columns = std::min(panelColumns, width - x0);
+		// gather the panel transposed, so every column is contiguous
+		for (int y = 0; y < height; ++y) {
+			const ComplexType * fileRow = data + static_cast<size_t>(y) * width + x0;
+			for (int c = 0; c < columns; ++c) {
+				columnPanel[static_cast<size_t>(c) * height + y] = fileRow[c];
+			}
+		}
+		parallelFor(columns, [&](int c, int) {
+			columnFFT.transform(columnPanel.get() + static_cast<size_t>(c) * height, transformedPanel.get() + static_cast<size_t>(c) * height);
+		});
+		// and scatter it back row by row
+		for (int y = 0; y < height; ++y) {
+			ComplexType * fileRow = data + static_cast<size_t>(y) * width + x0;
+			for (int c = 0; c < columns; ++c) {
+				fileRow[c] = transformedPanel[static_cast<size_t>(c) * height + y];
+			}
+		}
+	}
+	return !aborted();
+}
+
+template class OutOfCoreFFT2D<double>;
+template class OutOfCoreFFT2D<float>;
@@ -5,6 +5,8 @@
 #include "progress.h"
 
 #include <string>
+#include <limits>
+#include <algorithm>
 
 const Color GeometricPrimitive<Color>::axisCol = Color(127, 127, 127);
 const uint32 GeometricPrimitive<uint32>::axisCol = ~0 >> 1;
@@ -32,6 +34,20 @@ Vector2 GeometricPrimitive<CType>::realToRaster(const Vector2 & r) const noexcep
 	return Vector2(realScaled.x + center.x, -realScaled.y + center.y);
 }
 
+template<class CType>
+bool GeometricPrimitive<CType>::getPixelShift(const Vector2& prevScale, const Vector2& prevOffset, int& shiftX, int& shiftY) const noexcept {
+	if (prevScale.x != scale.x || prevScale.y != scale.y) {
+		return false;
+	}
+	// the raster position of a real point changes by the offset difference in pixels (with y flipped)
+	const float shiftXf = (prevOffset.x - offset.x) * scale.x;
+	const float shiftYf = (offset.y - prevOffset.y) * scale.y;
+	const float maxError = 1.0e-3f;
+	shiftX = static_cast<int>(std::round(shiftXf));
+	shiftY = static_cast<int>(std::round(shiftYf));
+	return (std::abs(shiftXf - shiftX) < maxError && std::abs(shiftYf - shiftY) < maxError);
+}
+
 template<class CType>
 void GeometricPrimitive<CType>::drawAxes() {
 	const int bw = bmp.getWidth();
@@ -352,11 +368,73 @@ template class FunctionRaster<Color>;
 template<class CType>
 FunctionRaster<CType>::FunctionRaster(int width, int height)
 	: GeometricPrimitive<CType>(width, height)
+	, incremental(true)
+	, sampleCache(RasterCacheBudget)
 {}
 
 template<class CType>
-void FunctionRaster<CType>::setFunction(std::function<double(double, double)> _fxy) {
+void FunctionRaster<CType>::setFunction(std::function<double(double, double)> _fxy, const std::string& _functionKey) {
 	fxy = _fxy;
+	functionKey = _functionKey;
+}
+
+template<class CType>
+std::shared_ptr<const typename FunctionRaster<CType>::FunctionSamples> FunctionRaster<CType>::evaluateSamples() {
+	const int bw = bmp.getWidth();
+	const int bh = bmp.getHeight();
+	std::shared_ptr<FunctionSamples> samples = std::make_shared<FunctionSamples>();
+	samples->width = bw;
+	samples->height = bh;
+	samples->scale = scale;
+	samples->offset = offset;
+	samples->values.resize(static_cast<size_t>(bw) * bh);
+	double * values = samples->values.data();
+
+	// check if the samples from the previous draw may be moved
+	const bool useCache = (incremental && !functionKey.empty());
+	std::shared_ptr<const FunctionSamples> cached = (useCache ? sampleCache.find(functionKey) : nullptr);
+	int shiftX = 0;
+	int shiftY = 0;
+	if (!cached || cached->width != bw || cached->height != bh ||
+		!getPixelShift(cached->scale, cached->offset, shiftX, shiftY) ||
+		std::abs(shiftX) >= bw || std::abs(shiftY) >= bh)
+	{
+		cached.reset();
+	}
+
+	auto evaluateSpan = [&](int y, int x0, int x1) {
+		for (int x = x0; x < x1; ++x) {
+			const Vector2 sample = rasterToReal(Vector2(x, y) + Vector2(0.5f, 0.5f));
+			values[y * bw + x] = fxy(sample.x, sample.y);
+		}
+	};
+	for (int y = 0; y < bh; ++y) {
+		const int prevY = y - shiftY;
+		if (cached && prevY >= 0 && prevY < bh) {
+			// copy the part of the row covered by the cached samples and evaluate the rest
+			const int coveredBegin = std::max(shiftX, 0);
+			const int coveredEnd = std::min(bw + shiftX, bw);
+			const double * prevRow = cached->values.data() + static_cast<size_t>(prevY) * bw;
+			std::copy(prevRow + coveredBegin - shiftX, prevRow + coveredEnd - shiftX, values + static_cast<size_t>(y) * bw + coveredBegin);
+			evaluateSpan(y, 0, coveredBegin);
+			evaluateSpan(y, coveredEnd, bw);
+		} else {
+			evaluateSpan(y, 0, bw);
+		}
+		if (cb) {
+			if (cb->getAbortFlag()) {
+				return nullptr;
+			} else {
+				cb->setPercentDone(y + 1, bh);
+			}
+		}
+	}
+
+	if (useCache) {
+		sampleCache.erase(functionKey);
+		sampleCache.insert(functionKey, samples, samples->values.size() * sizeof(double));
+	}
+	return samples;
 }
 
 template<class CType>
@@ -371,14 +449,18 @@ void FunctionRaster<CType>::draw(unsigned flags) {
 	if ((flags & DF_SHOW_AXIS) != 0) {
 		drawAxes();
 	}
+	const std::shared_ptr<const FunctionSamples> samples = evaluateSamples();
+	if (!samples) {
+		return;
+	}
+	const double * values = samples->values.data();
 	const double halfPenWidth = (pen.getWidth() / 2.0 + 1.0) * (1.0 / ((scale.x + scale.y) * 0.5));
 	const double fullColorRange = clamp(pen.getStrength(), 0.0, 1.0) * halfPenWidth;
 	const double halfToneRange = halfPenWidth - fullColorRange;
 	const CType penColor = pen.getColor();
 	for (int y = 0; y < bh; ++y) {
 		for (int x = 0; x < bw; ++x) {
-			const Vector2 sample = rasterToReal(Vector2(x, y) + Vector2(0.5f, 0.5f));
-			const double error = abs(fxy(sample.x, sample.y));
+			const double error = abs(values[y * bw + x]);
 			if (error <= halfPenWidth) {
 				const CType currentColor = rasterData[y * bw + x];
 				if (error <= fullColorRange) {
@@ -393,13 +475,6 @@ void FunctionRaster<CType>::draw(unsigned flags) {
 				}
 			}
 		}
-		if (cb) {
-			if (cb->getAbortFlag()) {
-				break;
-			} else {
-				cb->setPercentDone(y + 1, bh);
-			}
-		}
 	}
 }
 
@@ -408,136 +483,445 @@ template class FineFunctionRaster<Color>;
 template<class CType>
 FineFunctionRaster<CType>::FineFunctionRaster(int width, int height)
 	: GeometricPrimitive<CType>(width, height)
+	, treeOutput(false)
+	, incremental(true)
+	, renderer(RT_NEAREST)
+	, sampleCache(RasterCacheBudget)
 {}
 
 template<class CType>
-void FineFunctionRaster<CType>::setFunction(std::function<double(double, double)> _fxy) {
+void FineFunctionRaster<CType>::setFunction(std::function<double(double, double)> _fxy, const std::string& _functionKey) {
 	fxy = _fxy;
+	functionKey = _functionKey;
 }
 
 template<class CType>
-void FineFunctionRaster<CType>::draw(unsigned flags) {
-	if ((flags & DF_CLEAR) != 0) {
-		clear();
+void FineFunctionRaster<CType>::findCellIntersections(int x, int y, std::vector<CellIntersection>& output) const {
+	const int cell = y * bmp.getWidth() + x;
+	const float epsIntersection = 1.0e-6f;
+	const Vector2 base = rasterToReal(Vector2(x, y) + Vector2(0.5f, 0.5f));
+	const double evalBase = fxy(base.x, base.y);
+	// if the base evaluation is close to 0 it is a direct intersection
+	if (std::abs(evalBase) < epsIntersection) {
+		output.push_back(CellIntersection{ cell, base });
+	} else {
+		// otherwise check for horizontal and vertical intersection
+		const double nextX = base.x + 1.0f / scale.x;
+		const double evalHoriz = fxy(nextX, base.y);
+		// there is an intersection if the signs of the two evaluations differ
+		const bool ix = (evalBase * evalHoriz) < 0.0;
+		// if there is intersection - perform binary search to find the exact point
+		if (ix) {
+			double x0 = base.x;
+			double x1 = nextX;
+			double evalX0 = evalBase;
+			double evalX1 = evalHoriz;
+			double dx = (x0 + x1) * 0.5;
+			double evalDx = fxy(dx, base.y);
+			while (x1 - x0 > epsIntersection) {
+				if (std::abs(evalDx) < epsIntersection) {
+					// if there is a direct intersection - just break
+					break;
+				} else if (evalDx * evalX0 > 0.0) {
+					// then if the new evaluation has the same sign as the lower bound - increase the lower bound
+					x0 = dx;
+					evalX0 = evalDx;
+				} else {
+					// otherwise the upper bound must be lowered
+					x1 = dx;
+					evalX1 = evalDx;
+				}
+				dx = (x0 + x1) * 0.5;
+				evalDx = fxy(dx, base.y);
+			}
+			// now dx contains the midPoint of two close evaluations - use it directly
+			const Vector2 intersection(static_cast<float>(dx), base.y);
+			output.push_back(CellIntersection{ cell, intersection });
+		}
+		const double nextY = base.y + 1.0f / scale.y;
+		const double evalVert = fxy(base.x, nextY);
+		// there is an intersection if the signs of the two evaluations differ
+		const bool iy = (evalBase * evalVert) < 0.0;
+		if (iy) {
+			double y0 = base.y;
+			double y1 = nextY;
+			double evalY0 = evalBase;
+			double evalY1 = evalVert;
+			double dy = (y0 + y1) * 0.5;
+			double evalDy = fxy(base.y, dy);
+			while (y1 - y0 > epsIntersection) {
+				if (std::abs(evalDy) < epsIntersection) {
+					// if there is a direct intersection - just break
+					break;
+				} else if (evalDy * evalY0 > 0.0) {
+					// then if the new evaluation has the same sign as the lower bound - increase the lower bound
+					y0 = dy;
+					evalY0 = evalDy;
+				} else {
+					// otherwise the upper bound must be lowered
+					y1 = dy;
+					evalY1 = evalDy;
+				}
+				dy = (y0 + y1) * 0.5;
+				evalDy = fxy(base.x, dy);
+			}
+			// now dy contains the midPoint of two close evaluations - use it directly
+			const Vector2 intersection(base.x, static_cast<float>(dy));
+			output.push_back(CellIntersection{ cell, intersection });
+		}
 	}
-	const bool additive = ((flags & DF_ACCUMULATE) != 0);
+}
+
+template<class CType>
+std::shared_ptr<const typename FineFunctionRaster<CType>::IntersectionSamples> FineFunctionRaster<CType>::findIntersections() {
 	const int bw = bmp.getWidth();
 	const int bh = bmp.getHeight();
-	CType * rasterData = bmp.getDataPtr();
-	if ((flags & DF_SHOW_AXIS) != 0) {
-		drawAxes();
+	std::shared_ptr<IntersectionSamples> samples = std::make_shared<IntersectionSamples>();
+	samples->width = bw;
+	samples->height = bh;
+	samples->scale = scale;
+	samples->offset = offset;
+	std::vector<CellIntersection>& intersections = samples->intersections;
+
+	// the cells are the pixels, which have a right and a bottom neighbour
+	const int cellsWidth = bw - 1;
+	const int cellsHeight = bh - 1;
+	auto validCell = [cellsWidth, cellsHeight](int x, int y) {
+		return x >= 0 && x < cellsWidth && y >= 0 && y < cellsHeight;
+	};
+	// marks the cells, which have to be checked, if empty all cells are checked
+	std::vector<uint8> checkCells;
+	const bool useCache = (incremental && !functionKey.empty());
+	const std::shared_ptr<const IntersectionSamples> cached = (useCache ? sampleCache.find(functionKey) : nullptr);
+	int shiftX = 0;
+	int shiftY = 0;
+	// only a pan by whole pixels samples the same points, after a zoom the new samples may find intersections between
+	// the previous ones, so all cells are checked
+	if (cached && cached->width == bw && cached->height == bh && cellsWidth > 0 && cellsHeight > 0 &&
+		getPixelShift(cached->scale, cached->offset, shiftX, shiftY))
+	{
+		// keep the intersections of the cells remaining in the raster and check only the exposed ones
+		checkCells.resize(static_cast<size_t>(bw) * bh, 0);
+		for (const CellIntersection& ci : cached->intersections) {
+			const int x = ci.cell % bw + shiftX;
+			const int y = ci.cell / bw + shiftY;
+			if (validCell(x, y)) {
+				intersections.push_back(CellIntersection{ y * bw + x, ci.position });
+			}
+		}
+		for (int y = 0; y < cellsHeight; ++y) {
+			for (int x = 0; x < cellsWidth; ++x) {
+				checkCells[y * bw + x] = (validCell(x - shiftX, y - shiftY) ? 0 : 1);
+			}
+		}
 	}
 
-	const float topQtDimension = static_cast<float>(std::max(bw, bh));
-	// get the proper number of levels in order to have small number of points in the tree
-	const int qtLevels = QuadTree<Vector2>::getLevels(5.0f, static_cast<float>(topQtDimension)) - 1;
-	// quad tree containing all intersections
-	QuadTree<Vector2> plotQt(qtLevels, bw / (2.0f * scale.x), bh / (2.0f * scale.y), rasterToReal(Vector2(bw / 2, bh / 2)));
+	for (int y = 0; y < cellsHeight; ++y) {
+		for (int x = 0; x < cellsWidth; ++x) {
+			if (checkCells.empty() || checkCells[y * bw + x]) {
+				findCellIntersections(x, y, intersections);
+			}
+		}
+		if (cb) {
+			if (cb->getAbortFlag()) {
+				return nullptr;
+			} else {
+				cb->setPercentDone(y, bh * 2);
+			}
+		}
+	}
 
-	const float epsIntersection = 1.0e-6f;
-	// find all intersections
+	if (useCache) {
+		sampleCache.erase(functionKey);
+		sampleCache.insert(functionKey, samples, intersections.size() * sizeof(CellIntersection));
+	}
+	return samples;
+}
+
+template<class CType>
+bool FineFunctionRaster<CType>::extractContours() {
+	contours.clear();
+	const int bw = bmp.getWidth();
+	const int bh = bmp.getHeight();
+	if (bw < 2 || bh < 2) {
+		return true;
+	}
+	// sample the function in the pixel centers
+	std::vector<double> values(static_cast<size_t>(bw) * bh);
+	for (int y = 0; y < bh; ++y) {
+		for (int x = 0; x < bw; ++x) {
+			const Vector2 sample = rasterToReal(Vector2(x, y) + Vector2(0.5f, 0.5f));
+			values[y * bw + x] = fxy(sample.x, sample.y);
+		}
+		if (cb) {
+			if (cb->getAbortFlag()) {
+				return false;
+			} else {
+				cb->setPercentDone(y, bh * 2);
+			}
+		}
+	}
+
+	// a zero crossing on an edge of the sampling grid, shared by the (up to) two cells of the edge
+	struct Crossing {
+		Vector2 position; //!< in raster coordinates
+		int segments[2]; //!< the segments ending in the crossing (-1 if missing)
+	};
+	std::vector<Crossing> crossings;
+	std::vector<std::pair<int, int> > segments;
+	// the crossing of each edge - the horizontal edge starting at (x, y) is at 2 * (y * bw + x) and the vertical one is next to it
+	std::vector<int> edgeCrossings(static_cast<size_t>(bw) * bh * 2, -1);
+	auto getCrossing = [&](int x, int y, bool vertical) {
+		int& crossing = edgeCrossings[2 * (y * bw + x) + (vertical ? 1 : 0)];
+		if (crossing < 0) {
+			const double v0 = values[y * bw + x];
+			const double v1 = values[vertical ? (y + 1) * bw + x : y * bw + x + 1];
+			// the zero of the linear interpolation between the two samples
+			const float t = static_cast<float>(v0 / (v0 - v1));
+			crossing = static_cast<int>(crossings.size());
+			crossings.push_back(Crossing{ Vector2(x + 0.5f + (vertical ? 0.0f : t), y + 0.5f + (vertical ? t : 0.0f)), { -1, -1 } });
+		}
+		return crossing;
+	};
+	auto addSegment = [&](int a, int b) {
+		const int segment = static_cast<int>(segments.size());
+		segments.push_back(std::make_pair(a, b));
+		for (int c : { a, b }) {
+			crossings[c].segments[crossings[c].segments[0] < 0 ? 0 : 1] = segment;
+		}
+	};
+
+	// marching squares over the cells between four neighbouring samples
 	for (int y = 0; y < bh - 1; ++y) {
 		for (int x = 0; x < bw - 1; ++x) {
-			const Vector2 base = rasterToReal(Vector2(x, y) + Vector2(0.5f, 0.5f));
-			const double evalBase = fxy(base.x, base.y);
-			// if the base evaluation is close to 0 it is a direct intersection
-			if (std::abs(evalBase) < epsIntersection) {
-				plotQt.addElement(base, base);
-			} else {
-				// otherwise check for horizontal and vertical intersection
-				const double nextX = base.x + 1.0f / scale.x;
-				const double evalHoriz = fxy(nextX, base.y);
-				// there is an intersection if the signs of the two evaluations differ
-				const bool ix = (evalBase * evalHoriz) < 0.0;
-				// if there is intersection - perform binary search to find the exact point
-				if (ix) {
-					double x0 = base.x;
-					double x1 = nextX;
-					double evalX0 = evalBase;
-					double evalX1 = evalHoriz;
-					double dx = (x0 + x1) * 0.5;
-					double evalDx = fxy(dx, base.y);
-					while (x1 - x0 > epsIntersection) {
-						if (std::abs(evalDx) < epsIntersection) {
-							// if there is a direct intersection - just break
-							break;
-						} else if (evalDx * evalX0 > 0.0) {
-							// then if the new evaluation has the same sign as the lower bound - increase the lower bound
-							x0 = dx;
-							evalX0 = evalDx;
-						} else {
-							// otherwise the upper bound must be lowered
-							x1 = dx;
-							evalX1 = evalDx;
-						}
-						dx = (x0 + x1) * 0.5;
-						evalDx = fxy(dx, base.y);
-					}
-					// now dx contains the midPoint of two close evaluations - use it directly
-					const Vector2 intersection(static_cast<float>(dx), base.y);
-					plotQt.addElement(intersection, intersection);
+			const double v00 = values[y * bw + x];
+			const double v10 = values[y * bw + x + 1];
+			const double v11 = values[(y + 1) * bw + x + 1];
+			const double v01 = values[(y + 1) * bw + x];
+			if (!std::isfinite(v00) || !std::isfinite(v10) || !std::isfinite(v11) || !std::isfinite(v01)) {
+				continue;
+			}
+			// the corners below zero in clockwise order starting from the top left
+			const int cellCase = (v00 < 0.0 ? 1 : 0) | (v10 < 0.0 ? 2 : 0) | (v11 < 0.0 ? 4 : 0) | (v01 < 0.0 ? 8 : 0);
+			if (cellCase == 0 || cellCase == 15) {
+				continue;
+			}
+			auto top = [&]() { return getCrossing(x, y, false); };
+			auto right = [&]() { return getCrossing(x + 1, y, true); };
+			auto bottom = [&]() { return getCrossing(x, y + 1, false); };
+			auto left = [&]() { return getCrossing(x, y, true); };
+			switch (cellCase) {
+			case 1: case 14: addSegment(left(), top()); break;
+			case 2: case 13: addSegment(top(), right()); break;
+			case 3: case 12: addSegment(left(), right()); break;
+			case 4: case 11: addSegment(right(), bottom()); break;
+			case 6: case 9: addSegment(top(), bottom()); break;
+			case 7: case 8: addSegment(left(), bottom()); break;
+			case 5: case 10: {
+				// a saddle - the center of the cell decides which of the opposite corners are connected
+				const bool centerBelow = (v00 + v10 + v11 + v01) < 0.0;
+				if ((cellCase == 5) == centerBelow) {
+					addSegment(top(), right());
+					addSegment(left(), bottom());
+				} else {
+					addSegment(left(), top());
+					addSegment(right(), bottom());
 				}
-				const double nextY = base.y + 1.0f / scale.y;
-				const double evalVert = fxy(base.x, nextY);
-				// there is an intersection if the signs of the two evaluations differ
-				const bool iy = (evalBase * evalVert) < 0.0;
-				if (iy) {
-					double y0 = base.y;
-					double y1 = nextY;
-					double evalY0 = evalBase;
-					double evalY1 = evalVert;
-					double dy = (y0 + y1) * 0.5;
-					double evalDy = fxy(base.y, dy);
-					while (y1 - y0 > epsIntersection) {
-						if (std::abs(evalDy) < epsIntersection) {
-							// if there is a direct intersection - just break
-							break;
-						} else if (evalDy * evalY0 > 0.0) {
-							// then if the new evaluation has the same sign as the lower bound - increase the lower bound
-							y0 = dy;
-							evalY0 = evalDy;
-						} else {
-							// otherwise the upper bound must be lowered
-							y1 = dy;
-							evalY1 = evalDy;
-						}
-						dy = (y0 + y1) * 0.5;
-						evalDy = fxy(base.x, dy);
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+
+	// connect the segments to polylines - first the open ones starting from the crossings with a single segment,
+	// and then the closed ones from any segment left
+	std::vector<bool> visited(segments.size(), false);
+	auto tracePolyline = [&](int crossing, int segment) {
+		std::vector<Vector2> polyline;
+		polyline.push_back(rasterToReal(crossings[crossing].position));
+		while (segment >= 0 && !visited[segment]) {
+			visited[segment] = true;
+			const std::pair<int, int>& seg = segments[segment];
+			crossing = (seg.first == crossing ? seg.second : seg.first);
+			polyline.push_back(rasterToReal(crossings[crossing].position));
+			const int * next = crossings[crossing].segments;
+			segment = (next[0] == segment ? next[1] : next[0]);
+		}
+		contours.push_back(polyline);
+	};
+	for (int c = 0; c < static_cast<int>(crossings.size()); ++c) {
+		const int * segs = crossings[c].segments;
+		if (segs[1] < 0 && segs[0] >= 0 && !visited[segs[0]]) {
+			tracePolyline(c, segs[0]);
+		}
+	}
+	for (int s = 0; s < static_cast<int>(segments.size()); ++s) {
+		if (!visited[s]) {
+			tracePolyline(segments[s].first, s);
+		}
+	}
+	return true;
+}
+
+template<class CType>
+void FineFunctionRaster<CType>::drawContours(bool additive) {
+	const int bw = bmp.getWidth();
+	const int bh = bmp.getHeight();
+	CType * rasterData = bmp.getDataPtr();
+	// the pen is in pixels, one is added to properly color the edging pixels as in the nearest renderer
+	const float halfPenWidth = static_cast<float>(pen.getWidth() / 2.0) + 1.0f;
+	const float fullColorRange = static_cast<float>(clamp(pen.getStrength(), 0.0, 1.0) * halfPenWidth);
+	const float halfToneRange = halfPenWidth - fullColorRange;
+	const CType penColor = pen.getColor();
+
+	// the segments in raster coordinates together with the pixels in the reach of the pen
+	struct RasterSegment {
+		Vector2 a;
+		Vector2 b;
+		int x0, y0, x1, y1;
+	};
+	// the segments are binned to tiles of the raster, so the closest distances are kept for a single tile at a time
+	const int tileSide = 32;
+	const int tilesWidth = (bw + tileSide - 1) / tileSide;
+	const int tilesHeight = (bh + tileSide - 1) / tileSide;
+	std::vector<RasterSegment> segments;
+	std::vector<std::vector<int> > tileSegments(static_cast<size_t>(tilesWidth) * tilesHeight);
+	for (const auto& polyline : contours) {
+		for (size_t i = 1; i < polyline.size(); ++i) {
+			const Vector2 a = realToRaster(polyline[i - 1]);
+			const Vector2 b = realToRaster(polyline[i]);
+			const int x0 = std::max(static_cast<int>(std::floor(std::min(a.x, b.x) - halfPenWidth)), 0);
+			const int x1 = std::min(static_cast<int>(std::ceil(std::max(a.x, b.x) + halfPenWidth)), bw - 1);
+			const int y0 = std::max(static_cast<int>(std::floor(std::min(a.y, b.y) - halfPenWidth)), 0);
+			const int y1 = std::min(static_cast<int>(std::ceil(std::max(a.y, b.y) + halfPenWidth)), bh - 1);
+			if (x0 > x1 || y0 > y1) {
+				continue;
+			}
+			const int segment = static_cast<int>(segments.size());
+			segments.push_back(RasterSegment{ a, b, x0, y0, x1, y1 });
+			for (int ty = y0 / tileSide; ty <= y1 / tileSide; ++ty) {
+				for (int tx = x0 / tileSide; tx <= x1 / tileSide; ++tx) {
+					tileSegments[ty * tilesWidth + tx].push_back(segment);
+				}
+			}
+		}
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+	}
+
+	std::vector<float> closestDist(tileSide * tileSide);
+	for (int tile = 0; tile < static_cast<int>(tileSegments.size()); ++tile) {
+		const std::vector<int>& tileList = tileSegments[tile];
+		if (tileList.empty()) {
+			continue;
+		}
+		const int tileX = (tile % tilesWidth) * tileSide;
+		const int tileY = (tile / tilesWidth) * tileSide;
+		// the pixels of the tile in the reach of any of its segments
+		int minX = std::numeric_limits<int>::max();
+		int maxX = std::numeric_limits<int>::min();
+		int minY = std::numeric_limits<int>::max();
+		int maxY = std::numeric_limits<int>::min();
+		std::fill(closestDist.begin(), closestDist.end(), std::numeric_limits<float>::max());
+		for (int segment : tileList) {
+			const RasterSegment& seg = segments[segment];
+			const Vector2 ab = seg.b - seg.a;
+			const float abLengthSqr = ab.lengthSqr();
+			const int x0 = std::max(seg.x0, tileX);
+			const int x1 = std::min(seg.x1, tileX + tileSide - 1);
+			const int y0 = std::max(seg.y0, tileY);
+			const int y1 = std::min(seg.y1, tileY + tileSide - 1);
+			minX = std::min(minX, x0);
+			maxX = std::max(maxX, x1);
+			minY = std::min(minY, y0);
+			maxY = std::max(maxY, y1);
+			for (int y = y0; y <= y1; ++y) {
+				for (int x = x0; x <= x1; ++x) {
+					// the distance from the pixel center to the closest point of the segment
+					const Vector2 ap = Vector2(x + 0.5f, y + 0.5f) - seg.a;
+					const float t = (abLengthSqr > 0.0f ? clamp((ap * ab) / abLengthSqr, 0.0f, 1.0f) : 0.0f);
+					const float dist = (ap - ab * t).length();
+					float& pixelDist = closestDist[(y - tileY) * tileSide + x - tileX];
+					pixelDist = std::min(pixelDist, dist);
+				}
+			}
+		}
+		for (int y = minY; y <= maxY; ++y) {
+			for (int x = minX; x <= maxX; ++x) {
+				const float dist = closestDist[(y - tileY) * tileSide + x - tileX];
+				if (dist > halfPenWidth) {
+					continue;
+				}
+				CType& rdata = rasterData[y * bw + x];
+				if (dist <= fullColorRange) {
+					rdata = (additive ? rdata + penColor : penColor);
+				} else {
+					double amount = clamp(1.0 - (dist - fullColorRange) / halfToneRange, 0.0, 1.0);
+					if (additive) {
+						rdata += static_cast<CType>(penColor * amount);
+					} else {
+						rdata = static_cast<CType>(penColor * amount + rdata * (1.0 - amount));
 					}
-					// now dy contains the midPoint of two close evaluations - use it directly
-					const Vector2 intersection(base.x, static_cast<float>(dy));
-					plotQt.addElement(intersection, intersection);
 				}
 			}
 		}
-		if (cb) {
-			if (cb->getAbortFlag()) {
-				break;
-			} else {
-				cb->setPercentDone(y, bh * 2);
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+	}
+}
+
+template<class CType>
+void FineFunctionRaster<CType>::draw(unsigned flags) {
+	if ((flags & DF_CLEAR) != 0) {
+		clear();
+	}
+	const bool additive = ((flags & DF_ACCUMULATE) != 0);
+	const int bw = bmp.getWidth();
+	const int bh = bmp.getHeight();
+	CType * rasterData = bmp.getDataPtr();
+	if ((flags & DF_SHOW_AXIS) != 0) {
+		drawAxes();
+	}
+
+	if (renderer == RT_CONTOURS) {
+		if (extractContours()) {
+			drawContours(additive);
+			if (cb && !cb->getAbortFlag()) {
+				cb->setPercentDone(1, 1);
 			}
 		}
+		return;
 	}
 
-	if (cb && cb->getAbortFlag()) {
+	const std::shared_ptr<const IntersectionSamples> samples = findIntersections();
+	if (!samples) {
 		return;
 	}
 
+	const float topQtDimension = static_cast<float>(std::max(bw, bh));
+	// get the proper number of levels in order to have small number of points in the tree
+	const int qtLevels = QuadTree<Vector2>::getLevels(5.0f, static_cast<float>(topQtDimension)) - 1;
+	// quad tree containing all intersections, it is built at once from all of them
+	QuadTree<Vector2> plotQt(qtLevels, bw / (2.0f * scale.x), bh / (2.0f * scale.y), rasterToReal(Vector2(bw / 2, bh / 2)));
+	std::vector<QuadTree<Vector2>::QuadTreeElement> intersectionPoints;
+	intersectionPoints.reserve(samples->intersections.size());
+	for (const CellIntersection& ci : samples->intersections) {
+		intersectionPoints.push_back(QuadTree<Vector2>::QuadTreeElement(ci.position, ci.position));
+	}
+	plotQt.build(intersectionPoints);
+
 	const CType penColor = pen.getColor();
 	if (treeOutput) {
-		std::vector<const QuadTree<Vector2>*> intersections;
-		plotQt.getBottomTrees(intersections);
-		for (const auto& iqt : intersections) {
-			for (const auto& qte : *(iqt->getTreeElements())) {
-				const Vector2 rasterPos = realToRaster(qte.position);
-				const int dx = static_cast<int>(std::floor(rasterPos.x));
-				const int dy = static_cast<int>(std::floor(rasterPos.y));
-				if (dx >= 0 && dy >= 0 && dx < bw && dy < bh) {
-					rasterData[dy * bw + dx] = (additive ? rasterData[dy * bw + dx] + penColor : penColor);
-				}
-			}
-			if (cb && cb->getAbortFlag()) {
-				break;
+		for (const auto& qte : plotQt.getAllElements()) {
+			const Vector2 rasterPos = realToRaster(qte.position);
+			const int dx = static_cast<int>(std::floor(rasterPos.x));
+			const int dy = static_cast<int>(std::floor(rasterPos.y));
+			if (dx >= 0 && dy >= 0 && dx < bw && dy < bh) {
+				rasterData[dy * bw + dx] = (additive ? rasterData[dy * bw + dx] + penColor : penColor);
 			}
 		}
 		if (cb && !cb->getAbortFlag()) {
@@ -548,25 +932,12 @@ void FineFunctionRaster<CType>::draw(unsigned flags) {
 		const float halfPenWidth = (static_cast<float>(pen.getWidth() / 2.0) + 1.0f)  * (1.0f / ((scale.x + scale.y) * 0.5f)); // add one to properly color edging pixels
 		const float fullColorRange = static_cast<float>(clamp(pen.getStrength(), 0.0, 1.0) * halfPenWidth);
 		const float halfToneRange = halfPenWidth - fullColorRange;
-		std::vector<QuadTree<Vector2>::QuadTreeElement> intersections;
-		const Vector2 penHalfSize(halfPenWidth, halfPenWidth); // add one to have correct results for small pens
 		for (int y = 0; y < bh; ++y) {
 			for (int x = 0; x < bw; ++x) {
 				const Vector2 samplePos = rasterToReal(Vector2(x, y) + Vector2(0.5f, 0.5f));
-				const Rect pixelBBox(samplePos - penHalfSize, samplePos + penHalfSize);
-				intersections.clear();
-				plotQt.getElements(intersections, pixelBBox);
-				// now find the point closest to the current pixel
-				bool found = false; // may remain false if the elements are empty
-				float closestSquareDist = penHalfSize.lengthSqr(); // use square distance, it is enough for finding the closest
-				for (const auto& qte : intersections) {
-					const Vector2 vecToIntersect = qte.position - samplePos;
-					const float ptSquareDist = vecToIntersect.lengthSqr();
-					if (ptSquareDist <= closestSquareDist) {
-						found = true;
-						closestSquareDist = ptSquareDist;
-					}
-				}
+				// find the point closest to the current pixel, the ones further than the pen would not color it anyway
+				float closestSquareDist = 0.0f;
+				const bool found = (nullptr != plotQt.findNearest(samplePos, halfPenWidth, &closestSquareDist));
 				// now if a point was found calculate the actual distance and the coloring of the pixel
 				if (found) {
 					CType& rdata = rasterData[y * bw + x];
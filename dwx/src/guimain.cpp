@@ -8,6 +8,8 @@
 #include <wx/image.h>
 #include <wx/bitmap.h>
 #include <wx/dcbuffer.h>
+#include <wx/stdpaths.h>
+#include <wx/filename.h>
 
 #include "guimain.h"
 #include "wx_modes.h"
@@ -16,6 +18,7 @@
 
 #include "color.h"
 #include "bitmap.h"
+#include "fft_butterfly.h"
 
 class ViewApp : public wxApp {
 public:
@@ -53,6 +56,12 @@ bool ViewApp::OnInit() {
 	wxImage::AddHandler(new wxJPEGHandler);
 	wxImage::AddHandler(new wxBMPHandler);
 
+	// load the measured fft plans and keep measuring the new sizes
+	wxFileName wisdomFile(wxStandardPaths::Get().GetUserDataDir(), wxT("fft_wisdom.txt"));
+	if (wisdomFile.DirExists() || wisdomFile.Mkdir(wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+		FFTPlanner::get().setWisdomFile(std::string(wisdomFile.GetFullPath().mb_str()));
+	}
+
 	ViewFrame * frame = new ViewFrame(wxT("2d graphics"));
 	SetTopWindow(frame);
 	frame->Show();
@@ -0,0 +1,161 @@
+#include <cmath>
+#include <utility>
+
+#include "homography.h"
+
+bool Homography::inverse(Homography& result) const noexcept {
+	// the transposed cofactor matrix
+	const double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	const double c01 = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+	const double c02 = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+	const double c10 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	const double c11 = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+	const double c12 = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+	const double c20 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	const double c21 = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+	const double c22 = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+	const double det = m[0][0] * c00 + m[0][1] * c10 + m[0][2] * c20;
+	// relative to the scale of the elements, since the matrix is defined only up to a factor
+	double scale = 0.0;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			scale = std::fmax(scale, std::fabs(m[i][j]));
+		}
+	}
+	if (!(std::fabs(det) > 1e-12 * scale * scale * scale)) {
+		return false;
+	}
+	const double rdet = 1.0 / det;
+	result = Homography(
+		c00 * rdet, c01 * rdet, c02 * rdet,
+		c10 * rdet, c11 * rdet, c12 * rdet,
+		c20 * rdet, c21 * rdet, c22 * rdet
+	);
+	return true;
+}
+
+Homography operator * (const Homography& a, const Homography& b) noexcept {
+	Homography res;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			res.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+		}
+	}
+	return res;
+}
+
+// the similarity moving the centroid of the points to the origin with an average distance of sqrt(2) from it
+// this keeps the linear system well conditioned for points with large pixel coordinates
+static bool normalizePoints(const Vector2 points[4], Homography& transform) {
+	double cx = 0.0, cy = 0.0;
+	for (int i = 0; i < 4; ++i) {
+		cx += points[i].x;
+		cy += points[i].y;
+	}
+	cx *= 0.25;
+	cy *= 0.25;
+	double distance = 0.0;
+	for (int i = 0; i < 4; ++i) {
+		distance += std::hypot(points[i].x - cx, points[i].y - cy);
+	}
+	distance *= 0.25;
+	if (!(distance > 1e-9)) {
+		return false;
+	}
+	const double s = std::sqrt(2.0) / distance;
+	transform = Homography(
+		s, 0.0, -s * cx,
+		0.0, s, -s * cy,
+		0.0, 0.0, 1.0
+	);
+	return true;
+}
+
+// twice the smallest area of a triangle of normalized points still considered in general position
+static const double MinNormalizedArea = 1e-5;
+
+// the linear system is solvable for collinear points too, but then the transform is singular
+static bool arePointsInGeneralPosition(const double x[4], const double y[4]) {
+	for (int skip = 0; skip < 4; ++skip) {
+		const int a = (skip + 1) & 3;
+		const int b = (skip + 2) & 3;
+		const int c = (skip + 3) & 3;
+		const double area = (x[b] - x[a]) * (y[c] - y[a]) - (y[b] - y[a]) * (x[c] - x[a]);
+		if (!(std::fabs(area) > MinNormalizedArea)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Homography::fromPoints(const Vector2 src[4], const Vector2 dst[4], Homography& result) {
+	Homography srcNorm, dstNorm;
+	if (!normalizePoints(src, srcNorm) || !normalizePoints(dst, dstNorm)) {
+		return false;
+	}
+	double xs[4], ys[4], us[4], vs[4];
+	for (int i = 0; i < 4; ++i) {
+		if (!srcNorm.apply(src[i].x, src[i].y, xs[i], ys[i]) || !dstNorm.apply(dst[i].x, dst[i].y, us[i], vs[i])) {
+			return false;
+		}
+	}
+	if (!arePointsInGeneralPosition(xs, ys) || !arePointsInGeneralPosition(us, vs)) {
+		return false;
+	}
+	// two equations per correspondence for the eight unknowns with h22 = 1
+	double a[8][9];
+	for (int i = 0; i < 4; ++i) {
+		const double x = xs[i], y = ys[i], u = us[i], v = vs[i];
+		double * r0 = a[2 * i];
+		double * r1 = a[2 * i + 1];
+		r0[0] = x; r0[1] = y; r0[2] = 1.0; r0[3] = 0.0; r0[4] = 0.0; r0[5] = 0.0; r0[6] = -u * x; r0[7] = -u * y; r0[8] = u;
+		r1[0] = 0.0; r1[1] = 0.0; r1[2] = 0.0; r1[3] = x; r1[4] = y; r1[5] = 1.0; r1[6] = -v * x; r1[7] = -v * y; r1[8] = v;
+	}
+	// gaussian elimination with partial pivoting
+	for (int col = 0; col < 8; ++col) {
+		int pivot = col;
+		for (int row = col + 1; row < 8; ++row) {
+			if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) {
+				pivot = row;
+			}
+		}
+		if (!(std::fabs(a[pivot][col]) > 1e-10)) {
+			return false;
+		}
+		if (pivot != col) {
+			for (int j = 0; j < 9; ++j) {
+				std::swap(a[pivot][j], a[col][j]);
+			}
+		}
+		const double rp = 1.0 / a[col][col];
+		for (int row = 0; row < 8; ++row) {
+			if (row != col && a[row][col] != 0.0) {
+				const double f = a[row][col] * rp;
+				for (int j = col; j < 9; ++j) {
+					a[row][j] -= f * a[col][j];
+				}
+			}
+		}
+	}
+	Homography normalized(
+		a[0][8] / a[0][0], a[1][8] / a[1][1], a[2][8] / a[2][2],
+		a[3][8] / a[3][3], a[4][8] / a[4][4], a[5][8] / a[5][5],
+		a[6][8] / a[6][6], a[7][8] / a[7][7], 1.0
+	);
+	// undo the normalization: H = dstNorm^-1 * normalized * srcNorm
+	Homography dstDenorm;
+	if (!dstNorm.inverse(dstDenorm)) {
+		return false;
+	}
+	result = dstDenorm * normalized * srcNorm;
+	// rescaled so h22 is 1 when possible
+	if (std::fabs(result.m[2][2]) > 1e-12) {
+		const double r = 1.0 / result.m[2][2];
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j) {
+				result.m[i][j] *= r;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <utility>
+
+#include "hough.h"
+#include "constants.h"
+#include "fft_butterfly.h"
+#include "fft_image.h"
+#include "parallel.h"
+#include "progress.h"
+
+HoughAccumulator::HoughAccumulator(int imageWidth, int imageHeight, float _rhoResolution, float thetaResolution)
+	: rhoResolution(std::max(_rhoResolution, 0.01f))
+	, thetaBins(std::max(static_cast<int>(std::lround(180.0 / std::max(thetaResolution, 0.01f))), 1))
+	, rhoBins(1)
+	, rhoOffset(0.5f)
+{
+	// the points are inside the circle with the half diagonal as a radius, so zero rho is in the middle bin
+	const double halfDiagonal = std::sqrt(static_cast<double>(imageWidth) * imageWidth + static_cast<double>(imageHeight) * imageHeight) / 2.0;
+	const int halfRhoBins = static_cast<int>(std::ceil(halfDiagonal / rhoResolution));
+	rhoBins = 2 * halfRhoBins + 1;
+	rhoOffset = halfRhoBins + 0.5f;
+	cosTable.resize(thetaBins);
+	sinTable.resize(thetaBins);
+	for (int t = 0; t < thetaBins; ++t) {
+		const double theta = t * PI / thetaBins;
+		cosTable[t] = static_cast<float>(std::cos(theta) / rhoResolution);
+		sinTable[t] = static_cast<float>(std::sin(theta) / rhoResolution);
+	}
+	votes.resize(static_cast<size_t>(thetaBins) * rhoBins, 0);
+}
+
+bool HoughAccumulator::vote(const std::vector<Vector2>& points, ProgressCallback * cb) {
+	const int pointCount = static_cast<int>(points.size());
+	const int chunkCount = (thetaBins + ThetaChunkSize - 1) / ThetaChunkSize;
+	std::atomic<int> chunksDone(0);
+	parallelFor(chunkCount, [&](int chunk, int) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int t0 = chunk * ThetaChunkSize;
+		const int t1 = std::min(t0 + ThetaChunkSize, thetaBins);
+		for (int p0 = 0; p0 < pointCount; p0 += PointBlockSize) {
+			const int p1 = std::min(p0 + PointBlockSize, pointCount);
+			for (int t = t0; t < t1; ++t) {
+				uint32 * row = votes.data() + t * rhoBins;
+				const float c = cosTable[t];
+				const float s = sinTable[t];
+				for (int p = p0; p < p1; ++p) {
+					++row[static_cast<int>(points[p].x * c + points[p].y * s + rhoOffset)];
+				}
+			}
+		}
+		if (cb) {
+			cb->setPercentDone(++chunksDone, chunkCount);
+		}
+	});
+	return !(cb && cb->getAbortFlag());
+}
+
+bool HoughAccumulator::vote(const std::vector<HoughPoint>& points, float thetaWindow, ProgressCallback * cb) {
+	const int windowBins = static_cast<int>(std::ceil(std::max(thetaWindow, 0.0f) * thetaBins / 180.0f));
+	const int pointCount = static_cast<int>(points.size());
+	if (2 * windowBins + 1 >= thetaBins) {
+		std::vector<Vector2> positions(pointCount);
+		for (int p = 0; p < pointCount; ++p) {
+			positions[p] = points[p].position;
+		}
+		return vote(positions, cb);
+	}
+
+	// counting sort of the points by the theta bin of their gradient direction
+	std::vector<int> pointBins(pointCount);
+	std::vector<int> binStart(thetaBins + 1, 0);
+	for (int p = 0; p < pointCount; ++p) {
+		double theta = std::fmod(static_cast<double>(points[p].direction), PI);
+		if (theta < 0.0) {
+			theta += PI;
+		}
+		const int bin = static_cast<int>(theta * thetaBins / PI + 0.5) % thetaBins;
+		pointBins[p] = bin;
+		++binStart[bin + 1];
+	}
+	for (int t = 0; t < thetaBins; ++t) {
+		binStart[t + 1] += binStart[t];
+	}
+	std::vector<Vector2> sorted(pointCount);
+	std::vector<int> binFill(binStart.begin(), binStart.end() - 1);
+	for (int p = 0; p < pointCount; ++p) {
+		sorted[binFill[pointBins[p]]++] = points[p].position;
+	}
+
+	const int chunkCount = (thetaBins + ThetaChunkSize - 1) / ThetaChunkSize;
+	std::atomic<int> chunksDone(0);
+	parallelFor(chunkCount, [&](int chunk, int) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int t0 = chunk * ThetaChunkSize;
+		const int t1 = std::min(t0 + ThetaChunkSize, thetaBins);
+		for (int t = t0; t < t1; ++t) {
+			uint32 * row = votes.data() + t * rhoBins;
+			const float c = cosTable[t];
+			const float s = sinTable[t];
+			// the direction bins around theta, wrapping around PI
+			for (int db = t - windowBins; db <= t + windowBins; ++db) {
+				const int bin = (db + thetaBins) % thetaBins;
+				for (int p = binStart[bin]; p < binStart[bin + 1]; ++p) {
+					++row[static_cast<int>(sorted[p].x * c + sorted[p].y * s + rhoOffset)];
+				}
+			}
+		}
+		if (cb) {
+			cb->setPercentDone(++chunksDone, chunkCount);
+		}
+	});
+	return !(cb && cb->getAbortFlag());
+}
+
+std::vector<HoughLine> HoughAccumulator::findLines(int maxLines, uint32 minVotes, int suppressionRadius) const {
+	std::vector<HoughLine> lines;
+	if (maxLines <= 0) {
+		return lines;
+	}
+	const uint32 threshold = std::max<uint32>(minVotes, 1);
+	const int radius = clamp(suppressionRadius, 0, (thetaBins - 1) / 2);
+	// pairs of votes and accumulator offsets of the peaks found by each worker
+	std::vector<std::vector<std::pair<uint32, int> > > workerPeaks(getWorkerCount());
+	parallelFor(thetaBins, [&](int t, int worker) {
+		const uint32 * row = votes.data() + t * rhoBins;
+		for (int r = 0; r < rhoBins; ++r) {
+			const uint32 v = row[r];
+			if (v < threshold) {
+				continue;
+			}
+			const int offset = t * rhoBins + r;
+			bool isPeak = true;
+			for (int dt = -radius; dt <= radius && isPeak; ++dt) {
+				// past the ends of theta the lines continue with a negated rho
+				int nt = t + dt;
+				bool mirrored = false;
+				if (nt < 0) {
+					nt += thetaBins;
+					mirrored = true;
+				} else if (nt >= thetaBins) {
+					nt -= thetaBins;
+					mirrored = true;
+				}
+				for (int dr = -radius; dr <= radius; ++dr) {
+					int nr = r + dr;
+					if ((dt == 0 && dr == 0) || nr < 0 || nr >= rhoBins) {
+						continue;
+					}
+					if (mirrored) {
+						nr = rhoBins - 1 - nr;
+					}
+					const int neighbourOffset = nt * rhoBins + nr;
+					const uint32 nv = votes[neighbourOffset];
+					// ties go to the first bin, so a plateau gives a single peak
+					if (nv > v || (nv == v && neighbourOffset < offset)) {
+						isPeak = false;
+						break;
+					}
+				}
+			}
+			if (isPeak) {
+				workerPeaks[worker].push_back(std::make_pair(v, offset));
+			}
+		}
+	});
+
+	std::vector<std::pair<uint32, int> > peaks;
+	for (const auto& wp : workerPeaks) {
+		peaks.insert(peaks.end(), wp.begin(), wp.end());
+	}
+	const size_t lineCount = std::min(peaks.size(), static_cast<size_t>(maxLines));
+	std::partial_sort(peaks.begin(), peaks.begin() + lineCount, peaks.end(), [](const std::pair<uint32, int>& lhs, const std::pair<uint32, int>& rhs) {
+		return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+	});
+	const int halfRhoBins = rhoBins / 2;
+	for (size_t i = 0; i < lineCount; ++i) {
+		const int t = peaks[i].second / rhoBins;
+		const int r = peaks[i].second % rhoBins;
+		lines.push_back(HoughLine{ (r - halfRhoBins) * rhoResolution, static_cast<float>(t * PI / thetaBins), peaks[i].first });
+	}
+	return lines;
+}
+
+void HoughAccumulator::getVotesBitmap(Bitmap& out) const {
+	out.generateEmptyImage(thetaBins, rhoBins);
+	uint64 maxVotes = 1;
+	for (uint32 v : votes) {
+		maxVotes = std::max<uint64>(maxVotes, v);
+	}
+	Color * outData = out.getDataPtr();
+	for (int t = 0; t < thetaBins; ++t) {
+		const uint32 * row = votes.data() + t * rhoBins;
+		for (int r = 0; r < rhoBins; ++r) {
+			// the maximum is mapped to 255
+			const uint8 c = static_cast<uint8>((row[r] * 255ULL) / maxVotes);
+			outData[r * thetaBins + t] = Color(c, c, c);
+		}
+	}
+}
+
+void HoughAccumulator::clear() {
+	std::fill(votes.begin(), votes.end(), 0);
+}
+
+std::vector<HoughPoint> findEdgePoints(const Bitmap& bmp, GradientOperator op, float magnitudeThreshold) {
+	std::vector<HoughPoint> points;
+	if (!bmp.isOK() || bmp.getWidth() < 3 || bmp.getHeight() < 3) {
+		return points;
+	}
+	const int width = bmp.getWidth();
+	const int height = bmp.getHeight();
+	const Color * bmpData = bmp.getDataPtr();
+	std::vector<float> intensity(static_cast<size_t>(width) * height);
+	parallelFor(height, [&](int y, int) {
+		for (int x = y * width; x < (y + 1) * width; ++x) {
+			intensity[x] = bmpData[x].intensity();
+		}
+	});
+
+	// the weights of the smoothing across the derivative, normalized so a unit ramp has a unit gradient
+	const float side = (op == GO_SCHARR ? 3.0f : 1.0f);
+	const float middle = (op == GO_SCHARR ? 10.0f : 2.0f);
+	const float norm = 1.0f / (2.0f * (2.0f * side + middle));
+	const float thresholdSqr = magnitudeThreshold * magnitudeThreshold;
+	const Vector2 center(width * 0.5f, height * 0.5f);
+	// the points of blocks of rows are concatenated in order, so the result does not depend on the workers
+	const int RowBlockSize = 32;
+	const int blockCount = (height - 2 + RowBlockSize - 1) / RowBlockSize;
+	std::vector<std::vector<HoughPoint> > blockPoints(blockCount);
+	parallelFor(blockCount, [&](int block, int) {
+		const int y0 = 1 + block * RowBlockSize;
+		const int y1 = std::min(y0 + RowBlockSize, height - 1);
+		std::vector<HoughPoint>& bp = blockPoints[block];
+		for (int y = y0; y < y1; ++y) {
+			const float * up = intensity.data() + (y - 1) * width;
+			const float * row = up + width;
+			const float * down = row + width;
+			for (int x = 1; x < width - 1; ++x) {
+				const float gx = (side * (up[x + 1] - up[x - 1]) + middle * (row[x + 1] - row[x - 1]) + side * (down[x + 1] - down[x - 1])) * norm;
+				const float gy = (side * (down[x - 1] - up[x - 1]) + middle * (down[x] - up[x]) + side * (down[x + 1] - up[x + 1])) * norm;
+				if (gx * gx + gy * gy >= thresholdSqr) {
+					bp.push_back(HoughPoint{ Vector2(x + 0.5f, y + 0.5f) - center, std::atan2(gy, gx) });
+				}
+			}
+		}
+	});
+	for (const auto& bp : blockPoints) {
+		points.insert(points.end(), bp.begin(), bp.end());
+	}
+	return points;
+}
+
+void drawHoughLine(Bitmap& bmp, const HoughLine& line, const Color& color) {
+	if (!bmp.isOK()) {
+		return;
+	}
+	const int width = bmp.getWidth();
+	const int height = bmp.getHeight();
+	const float cx = width * 0.5f;
+	const float cy = height * 0.5f;
+	const float c = std::cos(line.theta);
+	const float s = std::sin(line.theta);
+	Color * bmpData = bmp.getDataPtr();
+	if (std::abs(s) >= std::abs(c)) {
+		// closer to horizontal - one pixel per column
+		for (int x = 0; x < width; ++x) {
+			const float px = x + 0.5f - cx;
+			const int y = static_cast<int>(std::floor((line.rho - px * c) / s + cy));
+			if (y >= 0 && y < height) {
+				bmpData[y * width + x] = color;
+			}
+		}
+	} else {
+		for (int y = 0; y < height; ++y) {
+			const float py = y + 0.5f - cy;
+			const int x = static_cast<int>(std::floor((line.rho - py * s) / c + cx));
+			if (x >= 0 && x < width) {
+				bmpData[y * width + x] = color;
+			}
+		}
+	}
+}
+
+// returns the (cached) spectra of two rings centered in (0, 0) of a plane with the given dimensions
+// the rings have a triangular profile one pixel wide around the radius and a unit sum, so the convolution is the
+// weighted fraction of the ring covered by edges; the two real rings are transformed together as a complex plane
+static void getRingSpectra(int radius0, int radius1, int width, int height, SpectrumCache<float>::SpectrumPtr spectra[2]) {
+	const int ringRadii[2] = { radius0, radius1 };
+	SpectrumKey keys[2];
+	bool missing = false;
+	for (int i = 0; i < 2; ++i) {
+		keys[i].name = "ring";
+		keys[i].source.assign(1, static_cast<float>(ringRadii[i]));
+		keys[i].width = width;
+		keys[i].height = height;
+		spectra[i] = SpectrumCache<float>::get().find(keys[i]);
+		missing = missing || !spectra[i];
+	}
+	if (!missing) {
+		return;
+	}
+	const int dimProd = width * height;
+	std::vector<TComplex<float> > packed(dimProd);
+	for (int i = 0; i < 2; ++i) {
+		const int r = ringRadii[i];
+		std::vector<std::pair<int, float> > weights;
+		float weightSum = 0.0f;
+		for (int dy = -r - 1; dy <= r + 1; ++dy) {
+			for (int dx = -r - 1; dx <= r + 1; ++dx) {
+				const float w = 1.0f - std::abs(std::sqrt(static_cast<float>(dx * dx + dy * dy)) - r);
+				if (w > 0.0f) {
+					const int x = ((dx % width) + width) % width;
+					const int y = ((dy % height) + height) % height;
+					weights.push_back(std::make_pair(y * width + x, w));
+					weightSum += w;
+				}
+			}
+		}
+		for (const auto& w : weights) {
+			if (i == 0) {
+				packed[w.first] += TComplex<float>(w.second / weightSum, 0.0f);
+			} else {
+				packed[w.first] += TComplex<float>(0.0f, w.second / weightSum);
+			}
+		}
+	}
+	std::vector<int> dims;
+	dims.push_back(height);
+	dims.push_back(width);
+	FFTCache<2, float>::get().getFFT(dims, false)->transform(packed.data(), packed.data());
+	for (int i = 0; i < 2; ++i) {
+		if (spectra[i]) {
+			continue;
+		}
+		std::shared_ptr<SpectrumCache<float>::Spectrum> spectrum = std::make_shared<SpectrumCache<float>::Spectrum>(dimProd);
+		TComplex<float> * spectrumData = spectrum->data();
+		for (int y = 0; y < height; ++y) {
+			const int my = (y == 0 ? 0 : height - y);
+			for (int x = 0; x < width; ++x) {
+				const int mx = (x == 0 ? 0 : width - x);
+				spectrumData[y * width + x] = unpackSpectrum(packed[y * width + x], packed[my * width + mx], i == 1);
+			}
+		}
+		spectra[i] = SpectrumCache<float>::get().insert(keys[i], spectrum);
+	}
+}
+
+CircleHoughAccumulator::CircleHoughAccumulator(int _width, int _height, int minRadius, int maxRadius, int radiusStep)
+	: width(_width)
+	, height(_height)
+	, bestScores(static_cast<size_t>(_width) * _height, 0.0f)
+	, bestRadii(static_cast<size_t>(_width) * _height, 0.0f)
+{
+	for (int r = std::max(minRadius, 1); r <= maxRadius; r += std::max(radiusStep, 1)) {
+		radii.push_back(r);
+	}
+}
+
+bool CircleHoughAccumulator::vote(const std::vector<HoughPoint>& points, ProgressCallback * cb) {
+	if (radii.empty() || width <= 0 || height <= 0) {
+		return true;
+	}
+	// the planes are padded with the largest radius, so the circular convolution does not wrap the votes
+	const int fftWidth = fftFriendlySize(width + radii.back() + 1);
+	const int fftHeight = fftFriendlySize(height + radii.back() + 1);
+	const int fftDimProd = fftWidth * fftHeight;
+	std::vector<int> dims;
+	dims.push_back(fftHeight);
+	dims.push_back(fftWidth);
+	const auto forwardFFT = FFTCache<2, float>::get().getFFT(dims, false);
+	const auto inverseFFT = FFTCache<2, float>::get().getFFT(dims, true);
+
+	std::vector<TComplex<float> > edgeSpectrum(fftDimProd);
+	const Vector2 center(width * 0.5f, height * 0.5f);
+	for (const HoughPoint& p : points) {
+		const int x = static_cast<int>(p.position.x + center.x);
+		const int y = static_cast<int>(p.position.y + center.y);
+		if (x >= 0 && x < width && y >= 0 && y < height) {
+			edgeSpectrum[y * fftWidth + x] = TComplex<float>(1.0f, 0.0f);
+		}
+	}
+	forwardFFT->transform(edgeSpectrum.data(), edgeSpectrum.data());
+	if (cb && cb->getAbortFlag()) {
+		return false;
+	}
+
+	const int pairCount = static_cast<int>(radii.size() + 1) / 2;
+	// every worker has a plane, a scratch buffer and its own best scores
+	const size_t workerMemory = static_cast<size_t>(fftDimProd) * 2 * sizeof(TComplex<float>) + bestScores.size() * 2 * sizeof(float);
+	const int workers = std::max(1, std::min({ getWorkerCount(), pairCount, static_cast<int>(ScratchBudget / workerMemory) }));
+	std::vector<std::vector<float> > workerScores(workers, std::vector<float>(bestScores.size(), 0.0f));
+	std::vector<std::vector<float> > workerRadii(workers, std::vector<float>(bestRadii.size(), 0.0f));
+	std::vector<std::vector<TComplex<float> > > planes(workers);
+	std::vector<std::vector<TComplex<float> > > scratches(workers);
+	const float inverseNorm = 1.0f / fftDimProd;
+	std::atomic<int> pairsDone(0);
+	parallelFor(pairCount, [&](int pair, int worker) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		std::vector<TComplex<float> >& plane = planes[worker];
+		std::vector<TComplex<float> >& scratch = scratches[worker];
+		if (plane.empty()) {
+			plane.resize(fftDimProd);
+			scratch.resize(fftDimProd);
+		}
+		const int r0 = radii[2 * pair];
+		const bool hasSecond = (2 * pair + 1 < static_cast<int>(radii.size()));
+		const int r1 = (hasSecond ? radii[2 * pair + 1] : r0);
+		SpectrumCache<float>::SpectrumPtr rings[2];
+		getRingSpectra(r0, r1, fftWidth, fftHeight, rings);
+		const TComplex<float> * ring0 = rings[0]->data();
+		const TComplex<float> * ring1 = rings[1]->data();
+		// the real part of the product is the convolution with the first ring and the imaginary one with the second
+		for (int i = 0; i < fftDimProd; ++i) {
+			const TComplex<float> filter = (hasSecond ? ring0[i] + TComplex<float>(-ring1[i].imag(), ring1[i].real()) : ring0[i]);
+			plane[i] = edgeSpectrum[i] * filter;
+		}
+		inverseFFT->transform(plane.data(), plane.data(), scratch.data());
+		float * scores = workerScores[worker].data();
+		float * scoreRadii = workerRadii[worker].data();
+		for (int y = 0; y < height; ++y) {
+			const TComplex<float> * row = plane.data() + y * fftWidth;
+			for (int x = 0; x < width; ++x) {
+				const int offset = y * width + x;
+				const float s0 = row[x].real() * inverseNorm;
+				if (s0 > scores[offset]) {
+					scores[offset] = s0;
+					scoreRadii[offset] = static_cast<float>(r0);
+				}
+				const float s1 = row[x].imag() * inverseNorm;
+				if (hasSecond && s1 > scores[offset]) {
+					scores[offset] = s1;
+					scoreRadii[offset] = static_cast<float>(r1);
+				}
+			}
+		}
+		if (cb) {
+			cb->setPercentDone(++pairsDone, pairCount);
+		}
+	}, workers);
+	if (cb && cb->getAbortFlag()) {
+		return false;
+	}
+
+	// ties go to the smaller radius, which is the one voted first
+	for (int w = 0; w < workers; ++w) {
+		const float * scores = workerScores[w].data();
+		const float * scoreRadii = workerRadii[w].data();
+		for (size_t i = 0; i < bestScores.size(); ++i) {
+			if (scores[i] > bestScores[i] || (scores[i] == bestScores[i] && scoreRadii[i] < bestRadii[i])) {
+				bestScores[i] = scores[i];
+				bestRadii[i] = scoreRadii[i];
+			}
+		}
+	}
+	return true;
+}
+
+std::vector<HoughCircle> CircleHoughAccumulator::findCircles(int maxCircles, float minScore, int suppressionRadius) const {
+	std::vector<HoughCircle> circles;
+	if (maxCircles <= 0) {
+		return circles;
+	}
+	const int radius = std::max(suppressionRadius, 0);
+	// pairs of scores and pixel offsets of the peaks found by each worker
+	std::vector<std::vector<std::pair<float, int> > > workerPeaks(getWorkerCount());
+	parallelFor(height, [&](int y, int worker) {
+		for (int x = 0; x < width; ++x) {
+			const int offset = y * width + x;
+			const float s = bestScores[offset];
+			if (s < minScore || s <= 0.0f) {
+				continue;
+			}
+			bool isPeak = true;
+			for (int ny = std::max(y - radius, 0); ny <= std::min(y + radius, height - 1) && isPeak; ++ny) {
+				for (int nx = std::max(x - radius, 0); nx <= std::min(x + radius, width - 1); ++nx) {
+					const int neighbourOffset = ny * width + nx;
+					const float ns = bestScores[neighbourOffset];
+					// ties go to the first pixel, so a plateau gives a single peak
+					if (ns > s || (ns == s && neighbourOffset < offset)) {
+						isPeak = false;
+						break;
+					}
+				}
+			}
+			if (isPeak) {
+				workerPeaks[worker].push_back(std::make_pair(s, offset));
+			}
+		}
+	});
+
+	std::vector<std::pair<float, int> > peaks;
+	for (const auto& wp : workerPeaks) {
+		peaks.insert(peaks.end(), wp.begin(), wp.end());
+	}
+	const size_t circleCount = std::min(peaks.size(), static_cast<size_t>(maxCircles));
+	std::partial_sort(peaks.begin(), peaks.begin() + circleCount, peaks.end(), [](const std::pair<float, int>& lhs, const std::pair<float, int>& rhs) {
+		return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+	});
+	for (size_t i = 0; i < circleCount; ++i) {
+		const int offset = peaks[i].second;
+		const Vector2 c((offset % width) + 0.5f, (offset / width) + 0.5f);
+		circles.push_back(HoughCircle{ c, bestRadii[offset], peaks[i].first });
+	}
+	return circles;
+}
+
+void CircleHoughAccumulator::getScoresBitmap(Bitmap& out) const {
+	out.generateEmptyImage(width, height);
+	float maxScore = 0.0f;
+	for (float s : bestScores) {
+		maxScore = std::max(maxScore, s);
+	}
+	const float scale = (maxScore > 0.0f ? 255.0f / maxScore : 0.0f);
+	Color * outData = out.getDataPtr();
+	for (size_t i = 0; i < bestScores.size(); ++i) {
+		const uint8 c = static_cast<uint8>(clamp(bestScores[i] * scale, 0.0f, 255.0f));
+		outData[i] = Color(c, c, c);
+	}
+}
+
+void drawHoughCircle(Bitmap& bmp, const HoughCircle& circle, const Color& color) {
+	if (!bmp.isOK()) {
+		return;
+	}
+	const int width = bmp.getWidth();
+	const int height = bmp.getHeight();
+	Color * bmpData = bmp.getDataPtr();
+	// about two steps per pixel of the circumference, so there are no gaps
+	const int steps = std::max(static_cast<int>(4.0 * PI * circle.radius), 8);
+	for (int i = 0; i < steps; ++i) {
+		const double angle = 2.0 * PI * i / steps;
+		const int x = static_cast<int>(std::floor(circle.center.x + circle.radius * std::cos(angle)));
+		const int y = static_cast<int>(std::floor(circle.center.y + circle.radius * std::sin(angle)));
+		if (x >= 0 && x < width && y >= 0 && y < height) {
+			bmpData[y * width + x] = color;
+		}
+	}
+}
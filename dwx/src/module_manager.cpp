@@ -27,6 +27,10 @@ const ModuleDescription MODULE_DESC[ModuleId::M_COUNT] = {
 	ModuleDescription(M_FFT_DOMAIN,           create<FFTDomainModule>,          "fft_domain",           "FFTDomain",            1, 1),
 	ModuleDescription(M_FFT_COMPRESSION,      create<FFTCompressionModule>,     "fft_compression",      "FFTCompression",       1, 1),
 	ModuleDescription(M_FFT_FILTER,           create<FFTFilter>,                "fft_filter",           "FFTFilter",            1, 1),
+	ModuleDescription(M_DENSITY_SAMPLING,     create<DensitySamplingModule>,    "density_sampling",     "Density Sampling",     1, 1),
+	ModuleDescription(M_CIRCLE_HOUGH,         create<CircleHoughModule>,        "circle_hough",         "Circle Hough",         1, 1),
+	ModuleDescription(M_WARP,                 create<WarpModule>,               "warp",                 "Warp",                 1, 1),
+	ModuleDescription(M_LAPLACIAN_PYRAMID,    create<LaplacianPyramidModule>,   "laplacian_pyramid",    "Laplacian Pyramid",    1, 1),
 };
 
 /* ModuleFactory */
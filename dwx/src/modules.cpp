@@ -4,18 +4,34 @@
 #include <algorithm>
 #include <chrono>
 #include <random>
+#include <limits>
+#include <sstream>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <cstring>
 #include <time.h>
 
 #include "util.h"
+#include "alias_table.h"
 #include "arithmetic.h"
 #include "modules.h"
 #include "progress.h"
+#include "pyramid.h"
 #include "vector2.h"
 #include "matrix2.h"
 #include "dcomplex.h"
 #include "convolution.h"
 #include "fft_butterfly.h"
+#include "fft_codec.h"
+#include "fft_image.h"
+#include "fft_out_of_core.h"
+#include "hough.h"
 #include "kmeans.h"
+#include "parallel.h"
+#include "philox.h"
+#include "random_sampler.h"
+#include "resample.h"
 
 ModuleBase::ProcessResult SimpleModule::runModule(unsigned flags) {
 	const bool hasInput = getInput();
@@ -52,7 +68,7 @@ void AsyncModule::moduleLoop(AsyncModule * k) {
 			State dirty = State::AKS_DIRTY;
 			k->state.compare_exchange_weak(dirty, State::AKS_RUNNING);
 			const auto start = std::chrono::steady_clock::now();
-			k->moduleImplementation(0);
+			k->runLevels();
 			const auto end = std::chrono::steady_clock::now();
 			if (k->cb) {
 				const int64 duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
@@ -74,6 +90,8 @@ bool AsyncModule::getAbortState() const {
 
 AsyncModule::AsyncModule()
 	: state(State::AKS_INIT)
+	, progressiveDivisor(1)
+	, previewInputId(0)
 	, loopThread(moduleLoop, this)
 {}
 
@@ -100,6 +118,95 @@ ModuleBase::ProcessResult AsyncModule::runModule(unsigned flags) {
 	return KPR_RUNNING;
 }
 
+// the output pixels of the previews are replicated back to the divisor x divisor blocks of their input
+static void upscalePreview(const Bitmap& preview, int divisor, Bitmap& output) {
+	const int previewWidth = preview.getWidth();
+	const int width = previewWidth * divisor;
+	const int height = preview.getHeight() * divisor;
+	output.generateEmptyImage(width, height, false);
+	const Color * previewData = preview.getDataPtr();
+	Color * outData = output.getDataPtr();
+	for (int y = 0; y < height; ++y) {
+		const Color * previewRow = previewData + (y / divisor) * previewWidth;
+		Color * outRow = outData + y * width;
+		if (y % divisor != 0) {
+			std::copy(outRow - width, outRow, outRow);
+			continue;
+		}
+		for (int x = 0; x < width; ++x) {
+			outRow[x] = previewRow[x / divisor];
+		}
+	}
+}
+
+void AsyncModule::PreviewOutputManager::setOutput(const Bitmap& outputBmp, int id) {
+	if (!target) {
+		return;
+	}
+	if (divisor > 1 && outputBmp.isOK()) {
+		Bitmap upscaled;
+		upscalePreview(outputBmp, divisor, upscaled);
+		target->setOutput(upscaled, id);
+	} else {
+		target->setOutput(outputBmp, id);
+	}
+}
+
+ModuleBase::ProcessResult AsyncModule::runLevels() {
+	bool progressive = false;
+	if (pman) {
+		pman->getBoolParam(progressive, "progressive");
+	}
+	if (progressive && oman) {
+		// the pyramid levels of the preview runs, the last run is always in full resolution
+		static const int previewLevels[] = { 3, 2 };
+		// all previews are taken from the pyramid of the same input, the modules without an input make their own
+		if (!iman || !iman->getInput(previewInput, previewInputId)) {
+			previewInput.freeMem();
+		}
+		OutputManager * const realOutput = oman;
+		previewOutput.target = realOutput;
+		ModuleBase::ProcessResult result = KPR_OK;
+		for (int level : previewLevels) {
+			// the inputs smaller than the divisor have no preview
+			if (previewInput.isOK() && !previewInput.getPyramidLevel(level)) {
+				continue;
+			}
+			progressiveDivisor = 1 << level;
+			previewOutput.divisor = progressiveDivisor;
+			oman = &previewOutput;
+			result = moduleImplementation(0);
+			oman = realOutput;
+			progressiveDivisor = 1;
+			if (result != KPR_OK || getAbortState()) {
+				break;
+			}
+		}
+		previewInput.freeMem();
+		if (result != KPR_OK || getAbortState()) {
+			return result;
+		}
+	}
+	return moduleImplementation(0);
+}
+
+bool AsyncModule::getInput() {
+	if (progressiveDivisor <= 1) {
+		return SimpleModule::getInput();
+	}
+	int level = 0;
+	while ((2 << level) <= progressiveDivisor) {
+		++level;
+	}
+	const std::shared_ptr<const Bitmap> preview = previewInput.getPyramidLevel(level);
+	if (!preview) {
+		return false;
+	}
+	bmp = *preview;
+	bmpId = previewInputId;
+	return true;
+}
+
 ModuleBase::ProcessResult IdentityModule::moduleImplementation(unsigned flags) {
 	return ModuleBase::KPR_OK;
 }
@@ -371,6 +478,10 @@ ModuleBase::ProcessResult FunctionRasterModule::moduleImplementation(unsigned fl
 	const DrawPen<Color> pen(penColor, penWidth, penStrenth);
 	raster->setPen(pen);
 
+	bool incremental = true;
+	pman->getBoolParam(incremental, "incremental");
+	raster->setIncremental(incremental);
+
 	std::string function;
 	pman->getStringParam(function, "function");
 	std::vector<std::string> functionList = splitString(function.c_str(), ';');
@@ -380,7 +491,6 @@ ModuleBase::ProcessResult FunctionRasterModule::moduleImplementation(unsigned fl
 	auto evalFunction = [&bee](double x, double y) -> double {
 		return bee.eval(EvaluationContext(x, y, 0));
 	};
-	raster->setFunction(evalFunction);
 
 	std::pair<ExpressionParseError, std::string> parseError;
 	unsigned drawFlags = dflags;
@@ -394,6 +504,8 @@ ModuleBase::ProcessResult FunctionRasterModule::moduleImplementation(unsigned fl
 			break;
 		}
 		bee = functionTree.getBinaryEvaluator();
+		// the expression identifies the cached samples of the function
+		raster->setFunction(evalFunction, functionList[i]);
 
 		raster->draw(drawFlags);
 		// after the first run, reset some of the draw flags
@@ -422,19 +534,20 @@ ModuleBase::ProcessResult FineFunctionRasterModule::moduleImplementation(unsigne
 		cb->setModuleName("Fine Function Raster");
 		cb->setPercentDone(0, 1);
 	}
-	const int pWidth = width;
-	const int pHeight = height;
 	pman->getIntParam(width, "width");
 	pman->getIntParam(height, "height");
-	bool dirtySize = (width != pWidth || height != pHeight);
-	if (dirtySize || !bmp.isOK()) {
-		raster->resize(width, height);
-		dirtySize = false;
+	// the preview levels are drawn in a fraction of the resolution over the same view
+	const int divisor = getProgressiveDivisor();
+	const int drawWidth = std::max(width / divisor, 1);
+	const int drawHeight = std::max(height / divisor, 1);
+	const Pixelmap<Color>& rasterBmp = raster->getBitmap();
+	if (rasterBmp.getWidth() != drawWidth || rasterBmp.getHeight() != drawHeight || !bmp.isOK()) {
+		raster->resize(drawWidth, drawHeight);
 	}
 
 	Vector2 scale(1.0f, 1.0f);
 	pman->getVectorParam(scale, "scale");
-	raster->setScale(scale);
+	raster->setScale(scale / static_cast<float>(divisor));
 
 	Vector2 offset(0.0f, 0.0f);
 	pman->getVectorParam(offset, "offset");
@@ -455,13 +568,22 @@ ModuleBase::ProcessResult FineFunctionRasterModule::moduleImplementation(unsigne
 	pman->getFloatParam(penWidth, "penWidth");
 	float penStrenth = 0.5;
 	pman->getFloatParam(penStrenth, "penStrength");
-	const DrawPen<Color> pen(penColor, penWidth, penStrenth);
+	const DrawPen<Color> pen(penColor, penWidth / divisor, penStrenth);
 	raster->setPen(pen);
 
 	bool treeOutput = false;
 	pman->getBoolParam(treeOutput, "outputTree");
 	raster->setTreeOutput(treeOutput);
 
+	unsigned renderer = FineFunctionRaster<Color>::RT_NEAREST;
+	pman->getEnumParam(renderer, "renderer");
+	raster->setRenderer(static_cast<FineFunctionRaster<Color>::RendererType>(renderer));
+
+	bool incremental = true;
+	pman->getBoolParam(incremental, "incremental");
+	// the preview levels would replace the cached samples of the full resolution
+	raster->setIncremental(incremental && divisor == 1);
+
 	std::string function;
 	pman->getStringParam(function, "function");
 	std::vector<std::string> functionList = splitString(function.c_str(), ';');
@@ -470,7 +592,6 @@ ModuleBase::ProcessResult FineFunctionRasterModule::moduleImplementation(unsigne
 	auto evalFunction = [&bee](double x, double y) -> double {
 		return bee.eval(EvaluationContext(x, y, 0));
 	};
-	raster->setFunction(evalFunction);
 
 	raster->setProgressCallback(cb);
 
@@ -486,6 +607,8 @@ ModuleBase::ProcessResult FineFunctionRasterModule::moduleImplementation(unsigne
 			break;
 		}
 		bee = functionTree.getBinaryEvaluator();
+		// the expression identifies the cached samples of the function
+		raster->setFunction(evalFunction, functionList[i]);
 
 		raster->draw(drawFlags);
 		// after the first run, reset some of the draw flags
@@ -506,48 +629,125 @@ ModuleBase::ProcessResult FineFunctionRasterModule::moduleImplementation(unsigne
 	return KPR_OK;
 }
 
-template<class RandGen, class DistWidth, class DistHeight>
-class RandomBmpSampler {
+// the linear congruential generator of the msvc rand(), but with its own state instead of a global one
+class CRandEngine {
+	uint32 state;
 public:
-	RandomBmpSampler(RandGen seed, DistWidth dw, DistHeight dh)
-		: rGen(seed)
-		, distWidth(dw)
-		, distHeight(dh)
+	using result_type = uint32;
+
+	static constexpr result_type min() {
+		return 0;
+	}
+
+	static constexpr result_type max() {
+		return 0x7fff;
+	}
+
+	explicit CRandEngine(uint32 seed = 1)
+		: state(seed)
 	{}
 
-	void sample(Pixelmap<TColor<double> >& output, const TColor<double> c, const int64 samples, ProgressCallback * cb) {
-		if (!output.isOK() || samples <= 0) {
-			return;
-		}
-		const int width = output.getWidth();
-		const int height = output.getHeight();
-		const int dimProd = width * height;
-		TColor<double> * outData = output.getDataPtr();
-		if (cb) {
-			for (int64 i = 0; i < samples && !cb->getAbortFlag(); ++i) {
-				const int x = static_cast<int>(std::round(distWidth(rGen)));
-				const int y = static_cast<int>(std::round(distHeight(rGen)));
-				if (x >= 0 && x < width && y >= 0 && y < height) {
-					outData[y * width + x] += c;
-				}
-				cb->setPercentDone(i, samples);
-			}
-		} else {
-			for (int64 i = 0; i < samples; ++i) {
-				const int x = static_cast<int>(std::round(distWidth(rGen)));
-				const int y = static_cast<int>(std::round(distHeight(rGen)));
-				if (x >= 0 && x < width && y >= 0 && y < height) {
-					outData[y * width + x] += c;
-				}
-			}
-		}
+	template<class SeedSeq>
+	explicit CRandEngine(SeedSeq& seq)
+		: state(1)
+	{
+		seq.generate(&state, &state + 1);
+	}
+
+	result_type operator()() noexcept {
+		state = state * 214013u + 2531011u;
+		return (state >> 16) & 0x7fff;
+	}
+};
+
+// the c-rand style distribution - offset + rand() % range
+class CRandDistribution {
+	int offset;
+	int range;
+public:
+	CRandDistribution(int _offset, int _range)
+		: offset(_offset)
+		, range(std::max(std::abs(_range), 1))
+	{}
+
+	template<class RandGen>
+	int operator()(RandGen& gen) {
+		return offset + static_cast<int>(gen() % range);
+	}
+
+	void reset() noexcept {}
+};
+
+// a point distribution with the density of the pixels of an image, sampled from an alias table over all pixels
+// the points are jittered uniformly inside the pixels and scaled to the output; needs an engine with 32-bit words
+class AliasPointDistribution {
+	std::shared_ptr<const AliasTable> table;
+	int width;
+	float scale;
+public:
+	AliasPointDistribution(std::shared_ptr<const AliasTable> _table, int _width, float _scale)
+		: table(_table)
+		, width(_width)
+		, scale(_scale)
+	{}
+
+	template<class RandGen>
+	void operator()(RandGen& rGen, int& x, int& y) {
+		const uint32 binWord = rGen();
+		const uint32 aliasWord = rGen();
+		const int pixel = table->sample(binWord, aliasWord);
+		// 24 bits of the words, so the jitter is strictly below one
+		const float jitterNorm = 1.0f / 16777216.0f;
+		x = static_cast<int>(((pixel % width) + (rGen() >> 8) * jitterNorm) * scale);
+		y = static_cast<int>(((pixel / width) + (rGen() >> 8) * jitterNorm) * scale);
 	}
-private:
-	RandGen rGen;
-	DistWidth distWidth;
-	DistHeight distHeight;
+
+	void reset() noexcept {}
 };
 
+// returns the base seeds of the sampler engines - a fixed seed makes the runs reproducible and zero picks a random one
+static std::vector<uint32> getSamplerSeeds(int64 seed) {
+	if (seed != 0) {
+		return { static_cast<uint32>(seed), static_cast<uint32>(static_cast<uint64>(seed) >> 32) };
+	}
+	std::random_device rDev;
+	return { rDev(), rDev(), rDev(), rDev(), rDev(), rDev(), rDev(), rDev() };
+}
+
+template<class DistWidth, class DistHeight>
+static void sampleRandomBmp(
+	unsigned randEngine,
+	const std::vector<uint32>& seeds,
+	DistWidth dWidth,
+	DistHeight dHeight,
+	Pixelmap<TColor<double> >& output,
+	const TColor<double> c,
+	const int64 samples,
+	ProgressCallback * cb)
+{
+	using PointDist = IndependentPointDistribution<DistWidth, DistHeight>;
+	const PointDist pd(dWidth, dHeight);
+	if (randEngine == RandomNoiseModule::RE_C_RAND) {
+		RandomBmpSampler<CRandEngine, PointDist> s(seeds, pd);
+		s.sample(output, c, samples, cb);
+	} else if (randEngine == RandomNoiseModule::RE_LINEAR_CONGRUENTIAL_GEN) {
+		RandomBmpSampler<std::minstd_rand, PointDist> s(seeds, pd);
+		s.sample(output, c, samples, cb);
+	} else if (randEngine == RandomNoiseModule::RE_MERSENNE_TWISTER) {
+		RandomBmpSampler<std::mt19937, PointDist> s(seeds, pd);
+		s.sample(output, c, samples, cb);
+	} else if (randEngine == RandomNoiseModule::RE_RANLUX) {
+		RandomBmpSampler<std::ranlux24, PointDist> s(seeds, pd);
+		s.sample(output, c, samples, cb);
+	} else if (randEngine == RandomNoiseModule::RE_KNUTH_B) {
+		RandomBmpSampler<std::knuth_b, PointDist> s(seeds, pd);
+		s.sample(output, c, samples, cb);
+	} else if (randEngine == RandomNoiseModule::RE_PHILOX) {
+		RandomBmpSampler<Philox4x32, PointDist> s(seeds, pd);
+		s.sample(output, c, samples, cb);
+	}
+}
+
 ModuleBase::ProcessResult RandomNoiseModule::moduleImplementation(unsigned flags) {
 	if (cb) {
 		cb->setModuleName("Fine Function Raster");
@@ -565,6 +765,7 @@ ModuleBase::ProcessResult RandomNoiseModule::moduleImplementation(unsigned flags
 	Color sampleColor(0xffffff);
 	unsigned randEngine = 0;
 	unsigned distribution = 0;
+	int64 seed = 0;
 	if (pman) {
 		pman->getIntParam(bmpWidth, "width");
 		pman->getIntParam(bmpHeight, "height");
@@ -578,6 +779,7 @@ ModuleBase::ProcessResult RandomNoiseModule::moduleImplementation(unsigned flags
 		pman->getColorParam(sampleColor, "sampleColor");
 		pman->getEnumParam(randEngine, "randEngine");
 		pman->getEnumParam(distribution, "distribution");
+		pman->getInt64Param(seed, "seed");
 		if (gradient < 1) {
 			gradient = 1;
 		}
@@ -587,170 +789,166 @@ ModuleBase::ProcessResult RandomNoiseModule::moduleImplementation(unsigned flags
 	const TColor<double> diffColor = (fgColor - bkgColor) / static_cast<double>(gradient);
 	Pixelmap<TColor<double> > sampledBmp(bmpWidth, bmpHeight);
 	sampledBmp.fill(bkgColor);
-	const int dimProd = bmpWidth * bmpHeight;
+	const std::vector<uint32> seeds = getSamplerSeeds(seed);
 	if (randEngine == RE_C_RAND) {
-		// c-rand
-		srand(static_cast<uint32>(time(NULL)));
-		TColor<double> * sampleData = sampledBmp.getDataPtr();
-		const int offsetX = static_cast<int>(mx);
-		const int rangeWidth = static_cast<int>(sx - mx);
-		const int offsetY = static_cast<int>(my);
-		const int rangeHeight = static_cast<int>(sy - my);
-		for (int64 i = 0; i < samples && !getAbortState(); ++i) {
-			const int x = offsetX + (rand() % rangeWidth);
-			const int y = offsetY + (rand() % rangeHeight);
-			if (x >= 0 && x < bmpWidth && y >= 0 && y < bmpHeight) {
-				sampleData[y * bmpWidth + x] += diffColor;
-			}
-			if (cb) {
-				cb->setPercentDone(i, samples);
-			}
-		}
-	} else {
-		std::random_device rDev;
-		std::seed_seq seed{ rDev(), rDev(), rDev(), rDev(), rDev(), rDev(), rDev(), rDev() };
-		if (distribution == D_UNIFORM) {
-			std::uniform_int_distribution<int> dWidth(static_cast<int>(mx), static_cast<int>(sx));
-			std::uniform_int_distribution<int> dHeight(static_cast<int>(my), static_cast<int>(sy));
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
-		} else if (distribution == D_NORMAL) {
-			std::normal_distribution<double> dWidth(mx, sx);
-			std::normal_distribution<double> dHeight(my, sy);
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
-		} else if (distribution == D_CHI_SQUARED) {
-			std::chi_squared_distribution<double> dWidth(mx);
-			std::chi_squared_distribution<double> dHeight(my);
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
-		} else if (distribution == D_LOG_NORMAL) {
-			std::lognormal_distribution<double> dWidth(mx, sx);
-			std::lognormal_distribution<double> dHeight(my, sy);
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
-		} else if (distribution == D_CAUCHY) {
-			std::cauchy_distribution<double> dWidth(mx, sx);
-			std::cauchy_distribution<double> dHeight(my, sy);
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
-		} else if (distribution == D_FISHER_F) {
-			std::fisher_f_distribution<double> dWidth(mx, sx);
-			std::fisher_f_distribution<double> dHeight(my, sy);
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
-		} else if (distribution == D_STUDENT_T) {
-			std::student_t_distribution<double> dWidth(mx);
-			std::student_t_distribution<double> dHeight(my);
-			if (randEngine == RE_LINEAR_CONGRUENTIAL_GEN) {
-				std::minstd_rand re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_MERSENNE_TWISTER) {
-				std::mt19937 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_RANLUX) {
-				std::ranlux24 re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			} else if (randEngine == RE_KNUTH_B) {
-				std::knuth_b re(seed);
-				RandomBmpSampler<decltype(re), decltype(dWidth), decltype(dHeight)> s(re, dWidth, dHeight);
-				s.sample(sampledBmp, diffColor, samples, cb);
-			}
+		// c-rand ignores the distribution and samples uniformly the [mx, sx) x [my, sy) rectangle
+		const CRandDistribution dWidth(static_cast<int>(mx), static_cast<int>(sx - mx));
+		const CRandDistribution dHeight(static_cast<int>(my), static_cast<int>(sy - my));
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_UNIFORM) {
+		std::uniform_int_distribution<int> dWidth(static_cast<int>(mx), static_cast<int>(sx));
+		std::uniform_int_distribution<int> dHeight(static_cast<int>(my), static_cast<int>(sy));
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_NORMAL) {
+		std::normal_distribution<double> dWidth(mx, sx);
+		std::normal_distribution<double> dHeight(my, sy);
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_CHI_SQUARED) {
+		std::chi_squared_distribution<double> dWidth(mx);
+		std::chi_squared_distribution<double> dHeight(my);
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_LOG_NORMAL) {
+		std::lognormal_distribution<double> dWidth(mx, sx);
+		std::lognormal_distribution<double> dHeight(my, sy);
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_CAUCHY) {
+		std::cauchy_distribution<double> dWidth(mx, sx);
+		std::cauchy_distribution<double> dHeight(my, sy);
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_FISHER_F) {
+		std::fisher_f_distribution<double> dWidth(mx, sx);
+		std::fisher_f_distribution<double> dHeight(my, sy);
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	} else if (distribution == D_STUDENT_T) {
+		std::student_t_distribution<double> dWidth(mx);
+		std::student_t_distribution<double> dHeight(my);
+		sampleRandomBmp(randEngine, seeds, dWidth, dHeight, sampledBmp, diffColor, samples, cb);
+	}
+	if (cb) {
+		cb->setPercentDone(1, 1);
+	}
+	bmp = sampledBmp;
+	SimpleModule::setOutput();
+	if (iman)
+		iman->moduleDone(KPR_OK);
+	return KPR_OK;
+}
+
+// the finalizer of murmur3 - every bit of the input affects all bits of the output
+static inline uint64 mixHash(uint64 h) noexcept {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+size_t DensitySamplingModule::TableKeyHash::operator()(const TableKey& key) const noexcept {
+	uint64 h = key.contentHash;
+	h = mixHash(h ^ key.density);
+	uint32 gammaBits = 0;
+	memcpy(&gammaBits, &key.gamma, sizeof(gammaBits));
+	h = mixHash(h ^ gammaBits);
+	return static_cast<size_t>(h);
+}
+
+std::shared_ptr<const AliasTable> DensitySamplingModule::getTable(DensityMode density, float gamma) {
+	const Bitmap& input = bmp;
+	const int dimProd = input.getDimensionProduct();
+	const Color * bmpData = input.getDataPtr();
+	// whole words of the pixels, each of them mixed before it is combined, so the hash is a lot faster than the table
+	// it only selects the bucket - the pixels of the key are still compared on lookup
+	const uint8 * bytes = reinterpret_cast<const uint8 *>(bmpData);
+	const size_t byteCount = dimProd * sizeof(Color);
+	uint64 contentHash = mixHash((static_cast<uint64>(input.getWidth()) << 32) | static_cast<uint32>(input.getHeight()));
+	size_t i = 0;
+	for (; i + sizeof(uint64) <= byteCount; i += sizeof(uint64)) {
+		uint64 word = 0;
+		memcpy(&word, bytes + i, sizeof(word));
+		contentHash = (contentHash ^ mixHash(word)) * 1099511628211ULL;
+	}
+	for (; i < byteCount; ++i) {
+		contentHash = (contentHash ^ mixHash(bytes[i])) * 1099511628211ULL;
+	}
+	contentHash = mixHash(contentHash);
+	// the key shares the pixels of the input only for the lookup, they are copied when the table is inserted
+	std::shared_ptr<const Bitmap> inputPixels(&input, [](const Bitmap *) {});
+	const TableKey lookupKey = { contentHash, inputPixels, static_cast<unsigned>(density), gamma };
+	std::shared_ptr<const AliasTable> table = tableCache.find(lookupKey);
+	if (table) {
+		return table;
+	}
+
+	// the densities of all intensities
+	float densityLut[256];
+	for (int v = 0; v < 256; ++v) {
+		const float intensity = (density == DM_INVERTED ? 255 - v : v) / 255.0f;
+		densityLut[v] = powf(intensity, gamma);
+	}
+	std::vector<float> weights(dimProd);
+	for (int p = 0; p < dimProd; ++p) {
+		weights[p] = densityLut[bmpData[p].intensityPerceptual()];
+	}
+	std::shared_ptr<AliasTable> newTable = std::make_shared<AliasTable>();
+	if (!newTable->build(weights.data(), dimProd)) {
+		return nullptr;
+	}
+	const TableKey key = { contentHash, std::make_shared<const Bitmap>(input), static_cast<unsigned>(density), gamma };
+	return tableCache.insert(key, newTable, newTable->getMemoryUsage() + byteCount);
+}
+
+ModuleBase::ProcessResult DensitySamplingModule::moduleImplementation(unsigned flags) {
+	const bool inputOk = getInput();
+	if (!inputOk || !bmp.isOK()) {
+		return KPR_INVALID_INPUT;
+	}
+	if (cb) {
+		cb->setModuleName("Density Sampling");
+		cb->setPercentDone(0, 1);
+	}
+	int64 samples = 1000000;
+	int gradient = 2;
+	float scale = 1.0f;
+	unsigned density = DM_INTENSITY;
+	float gamma = 1.0f;
+	Color background(0x000000);
+	Color sampleColor(0xffffff);
+	int64 seed = 0;
+	if (pman) {
+		pman->getInt64Param(samples, "samples");
+		pman->getIntParam(gradient, "gradient");
+		pman->getFloatParam(scale, "scale");
+		pman->getEnumParam(density, "density");
+		pman->getFloatParam(gamma, "gamma");
+		pman->getColorParam(background, "background");
+		pman->getColorParam(sampleColor, "sampleColor");
+		pman->getInt64Param(seed, "seed");
+		if (gradient < 1) {
+			gradient = 1;
 		}
 	}
+	const int outWidth = static_cast<int>(bmp.getWidth() * scale);
+	const int outHeight = static_cast<int>(bmp.getHeight() * scale);
+	if (outWidth <= 0 || outHeight <= 0 || gamma <= 0.0f) {
+		return KPR_INVALID_INPUT;
+	}
+
+	const TColor<double> bkgColor(background);
+	const TColor<double> fgColor(sampleColor);
+	const TColor<double> diffColor = (fgColor - bkgColor) / static_cast<double>(gradient);
+	Pixelmap<TColor<double> > sampledBmp(outWidth, outHeight);
+	sampledBmp.fill(bkgColor);
+	// a completely empty density leaves only the background
+	const std::shared_ptr<const AliasTable> table = getTable(static_cast<DensityMode>(density), gamma);
+	if (table) {
+		const AliasPointDistribution pd(table, bmp.getWidth(), scale);
+		RandomBmpSampler<Philox4x32, AliasPointDistribution> s(getSamplerSeeds(seed), pd);
+		s.sample(sampledBmp, diffColor, samples, cb);
+	}
+	if (getAbortState()) {
+		return KPR_ABORTED;
+	}
 	if (cb) {
 		cb->setPercentDone(1, 1);
 	}
@@ -761,6 +959,21 @@ ModuleBase::ProcessResult RandomNoiseModule::moduleImplementation(unsigned flags
 	return KPR_OK;
 }
 
+// keeps a random fraction of the points for the probabilistic Hough transform, the selection is the same on every run
+template<class Point>
+static void samplePoints(std::vector<Point>& points, float fraction) {
+	if (fraction >= 1.0f || points.empty()) {
+		return;
+	}
+	const size_t keep = static_cast<size_t>(points.size() * std::max(fraction, 0.0f));
+	std::minstd_rand rGen;
+	for (size_t i = 0; i < keep; ++i) {
+		std::uniform_int_distribution<size_t> pick(i, points.size() - 1);
+		std::swap(points[i], points[pick(rGen)]);
+	}
+	points.resize(keep);
+}
+
 ModuleBase::ProcessResult HoughModule::moduleImplementation(unsigned flags) {
 	const bool inputOk = getInput();
 	if (!inputOk || !bmp.isOK()) {
@@ -768,62 +981,141 @@ ModuleBase::ProcessResult HoughModule::moduleImplementation(unsigned flags) {
 	}
 	if (cb) {
 		cb->setModuleName("Hough Rho Theta");
+		cb->setPercentDone(0, 1);
+	}
+	unsigned edges = ED_SOBEL;
+	int threshold = 15;
+	float edgeThreshold = 32.0f;
+	float thetaWindow = 6.0f;
+	float sampling = 1.0f;
+	float rhoResolution = 2.0f;
+	float thetaResolution = 0.5f;
+	unsigned output = OT_ACCUMULATOR;
+	int maxLines = 10;
+	int minVotes = 0;
+	int suppression = 4;
+	Color lineColor(0xff0000);
+	if (pman) {
+		pman->getEnumParam(edges, "edges");
+		pman->getIntParam(threshold, "threshold");
+		pman->getFloatParam(edgeThreshold, "edgeThreshold");
+		pman->getFloatParam(thetaWindow, "thetaWindow");
+		pman->getFloatParam(sampling, "sampling");
+		pman->getFloatParam(rhoResolution, "rhoResolution");
+		pman->getFloatParam(thetaResolution, "thetaResolution");
+		pman->getEnumParam(output, "output");
+		pman->getIntParam(maxLines, "maxLines");
+		pman->getIntParam(minVotes, "minVotes");
+		pman->getIntParam(suppression, "suppression");
+		pman->getColorParam(lineColor, "lineColor");
+	}
+	if (rhoResolution <= 0.0f || thetaResolution <= 0.0f) {
+		return KPR_INVALID_INPUT;
 	}
 	const int bw = bmp.getWidth();
 	const int bh = bmp.getHeight();
-	const int hs = 2; // decrease size a bit
-	const int hh = int(sqrt(bw * bw + bh * bh)) / hs;
-	const int hw = hh;
-	Function<uint64> aps; // projected space
-	aps.resize(hw, hh);
-	float ro = 0.0f; // roVec length - directly used in lambda
-	float thetaRad = 0.0f; // the theta angle in radians
-	const int cx = hw / 2;
-	aps.setFunction(
-		[cx, hw](int x) -> float { return toRadians((x + cx) * 180.0f / float(hw)); }, // has to map from [-cx, cx) -> [0, 2*PI)
-		[&ro, &thetaRad](float x) -> float { return ro * cos(thetaRad - x); } // directly from the Hough Rho-Theta definition
-		);
-	const uint64 pc = 1; // we'll use it for addition - so it has to be one
-	aps.setPen(pc);
-	const Vector2 center(bw / 2 + .5f, bh / 2 + .5f);
-	const Color * bmpData = bmp.getDataPtr();
-	const int maxDim = bh * bw;
-	for (int y = 0; y < bh && !getAbortState(); ++y) {
-		for (int x = 0; x < bw && !getAbortState(); ++x) {
-			// check if the pixel has intensity below threshhold
-			if (bmpData[y * bw + x].intensity() < 15) {
-				Vector2 p(x + .5f, y + .5f);
-				Vector2 roVec = p - center;
-				ro = roVec.length() / hs; // this is the length to the segment - ro
-				thetaRad = atan2(roVec.y, roVec.x);
-				aps.draw(DrawFlags::DF_ACCUMULATE);
-			}
-			if (cb) {
-				cb->setPercentDone(y * bw + x, maxDim);
+	HoughAccumulator accumulator(bw, bh, rhoResolution, thetaResolution);
+	bool voted = false;
+	if (edges == ED_THRESHOLD) {
+		// the pixels below the intensity threshold vote, with coordinates relative to the center of the image
+		std::vector<Vector2> points;
+		const Color * bmpData = static_cast<const Bitmap&>(bmp).getDataPtr();
+		const Vector2 center(bw * 0.5f, bh * 0.5f);
+		for (int y = 0; y < bh; ++y) {
+			for (int x = 0; x < bw; ++x) {
+				if (bmpData[y * bw + x].intensity() < threshold) {
+					points.push_back(Vector2(x + 0.5f, y + 0.5f) - center);
+				}
 			}
 		}
+		samplePoints(points, sampling);
+		voted = accumulator.vote(points, cb);
+	} else {
+		std::vector<HoughPoint> points = findEdgePoints(bmp, (edges == ED_SCHARR ? GO_SCHARR : GO_SOBEL), edgeThreshold);
+		samplePoints(points, sampling);
+		voted = accumulator.vote(points, thetaWindow, cb);
+	}
+	if (!voted || getAbortState()) {
+		return KPR_ABORTED;
 	}
 	// directly set the output because it will be destroyed after this function exits
-	if (oman && !getAbortState()) {
-		const Pixelmap<uint64>& pmp = aps.getBitmap();
-		Bitmap bmpOut(pmp.getWidth(), pmp.getHeight());
-		const int dim = pmp.getWidth() * pmp.getHeight();
-		const uint64 * pmpData = pmp.getDataPtr();
-		uint64 maxValue = 1;
-		for (int i = 0; i < dim; ++i) {
-			maxValue = std::max(maxValue, pmpData[i]);
-		}
-		Color * bmpOutData = bmpOut.getDataPtr();
-		for (int i = 0; i < dim; ++i) {
-			const uint8 c = static_cast<uint8>((pmpData[i] * 255) / maxValue);
-			bmpOutData[i] = Color(c, c, c);
-		}
-		// so the maximum value has to be mapped to 255 -> multiply by 255 and divide by the max value
-		oman->setOutput(bmpOut, 1); // the zero is important
+	if (oman) {
+		if (output == OT_LINES) {
+			Bitmap bmpOut = bmp;
+			const std::vector<HoughLine> lines = accumulator.findLines(maxLines, static_cast<uint32>(std::max(minVotes, 0)), suppression);
+			for (const HoughLine& line : lines) {
+				drawHoughLine(bmpOut, line, lineColor);
+			}
+			oman->setOutput(bmpOut, bmpId);
+		} else {
+			Bitmap bmpOut;
+			accumulator.getVotesBitmap(bmpOut);
+			oman->setOutput(bmpOut, 1); // the zero is important
+		}
+	}
+	if (cb) {
+		cb->setPercentDone(1, 1);
 	}
 	return ModuleBase::KPR_OK;
 }
 
+ModuleBase::ProcessResult CircleHoughModule::moduleImplementation(unsigned flags) {
+	const bool inputOk = getInput();
+	if (!inputOk || !bmp.isOK()) {
+		return KPR_INVALID_INPUT;
+	}
+	if (cb) {
+		cb->setModuleName("Circle Hough");
+		cb->setPercentDone(0, 1);
+	}
+	unsigned edges = 0;
+	float edgeThreshold = 32.0f;
+	int minRadius = 10;
+	int maxRadius = 50;
+	int radiusStep = 1;
+	unsigned output = OT_CIRCLES;
+	int maxCircles = 10;
+	float minScore = 0.3f;
+	int suppression = 8;
+	Color circleColor(0xff0000);
+	if (pman) {
+		pman->getEnumParam(edges, "edges");
+		pman->getFloatParam(edgeThreshold, "edgeThreshold");
+		pman->getIntParam(minRadius, "minRadius");
+		pman->getIntParam(maxRadius, "maxRadius");
+		pman->getIntParam(radiusStep, "radiusStep");
+		pman->getEnumParam(output, "output");
+		pman->getIntParam(maxCircles, "maxCircles");
+		pman->getFloatParam(minScore, "minScore");
+		pman->getIntParam(suppression, "suppression");
+		pman->getColorParam(circleColor, "circleColor");
+	}
+	if (minRadius < 1 || maxRadius < minRadius || radiusStep < 1) {
+		return KPR_INVALID_INPUT;
+	}
+	const std::vector<HoughPoint> points = findEdgePoints(bmp, (edges == 1 ? GO_SCHARR : GO_SOBEL), edgeThreshold);
+	CircleHoughAccumulator accumulator(bmp.getWidth(), bmp.getHeight(), minRadius, maxRadius, radiusStep);
+	if (!accumulator.vote(points, cb) || getAbortState()) {
+		return KPR_ABORTED;
+	}
+	Bitmap bmpOut;
+	if (output == OT_ACCUMULATOR) {
+		accumulator.getScoresBitmap(bmpOut);
+	} else {
+		bmpOut = bmp;
+		for (const HoughCircle& circle : accumulator.findCircles(maxCircles, minScore, suppression)) {
+			drawHoughCircle(bmpOut, circle, circleColor);
+		}
+	}
+	if (oman) {
+		oman->setOutput(bmpOut, bmpId);
+	}
+	if (cb) {
+		cb->setPercentDone(1, 1);
+	}
+	return KPR_OK;
+}
+
 ModuleBase::ProcessResult RotationModule::moduleImplementation(unsigned flags) {
 	const bool inputOk = getInput();
 	if (!inputOk || !bmp.isOK()) {
@@ -845,32 +1137,7 @@ ModuleBase::ProcessResult RotationModule::moduleImplementation(unsigned flags) {
 	// check if the rotation is close to a multiple of a right angle
 	Bitmap bmpOut;
 	if ((roundedAngle % 90) == 0) {
-		int rightTurns = (roundedAngle / 90) % 4;
-		if (rightTurns < 0) {
-			rightTurns += 4;
-		}
-		if (rightTurns == 0) {
-			// identity
-			bmpOut = bmp;
-		} else if (rightTurns == 2) {
-			// easiest change is to mirror the image accross both axis
-			bmp.mirror(bmpOut, PA_BOTH);
-		} else {
-			// else some pixels need reordering
-			bmpOut.generateEmptyImage(bh, bw, false);
-			const Color * bmpData = bmp.getDataPtr();
-			Color * bmpOutData = bmpOut.getDataPtr();
-			const int startX = (rightTurns == 1 ? bw - 1 : 0);
-			const int startY = (rightTurns == 1 ? 0 : bh - 1);
-			const int stepX = (rightTurns == 1 ? -1 : 1);
-			const int stepY = (rightTurns == 1 ? 1 : -1);
-			// the bounds are reversed because of the rotation
-			for (int y = 0, sx = startX; y < bw; ++y, sx += stepX) {
-				for (int x = 0, sy = startY; x < bh; ++x, sy += stepY) {
-					bmpOutData[y * bh + x] = bmpData[sy * bw + sx];
-				}
-			}
-		}
+		rotateRightAngle(bmp, bmpOut, roundedAngle / 90);
 	} else {
 		const Matrix2 rot(rotationMatrix(angle));
 		const Matrix2 invRot(transpose(rot)); // since this is rotation, the inverse is the transposed matrix
@@ -894,38 +1161,23 @@ ModuleBase::ProcessResult RotationModule::moduleImplementation(unsigned flags) {
 		const int obw = static_cast<int>(ceilf(maxX) - floorf(minX));
 		const int obh = static_cast<int>(ceilf(maxY) - floorf(minY));
 		bmpOut.generateEmptyImage(obw, obh, false);
-		Color * bmpData = bmpOut.getDataPtr();
-		const int ocx = obw / 2;
-		const int ocy = obh / 2;
 		EdgeFillType edge = EdgeFillType::EFT_BLANK;
 		unsigned filterType = 0;
+		unsigned method = TM_MAPPING;
 		if (pman) {
 			unsigned edgeType = 0;
 			if (pman->getEnumParam(edgeType, "edge")) {
 				edge = static_cast<EdgeFillType>(edgeType);
 			}
 			pman->getEnumParam(filterType, "filterType");
+			pman->getEnumParam(method, "method");
 		}
-		if (0 == filterType) {
-			for (int y = 0; y < obh && !getAbortState(); ++y) {
-				for (int x = 0; x < obw && !getAbortState(); ++x) {
-					const Vector2 origin = invRot * Vector2(x - ocx + 0.5f, y - ocy + 0.5f);
-					bmpData[y * obw + x] = bmp.getBilinearFilteredPixel<TColor<double> >(origin.x + cx, origin.y + cy, edge);
-				}
-				if (cb) {
-					cb->setPercentDone(y, obh);
-				}
-			}
-		} else if (1 == filterType) {
-			for (int y = 0; y < obh && !getAbortState(); ++y) {
-				for (int x = 0; x < obw && !getAbortState(); ++x) {
-					const Vector2 origin = invRot * Vector2(x - ocx + 0.5f, y - ocy + 0.5f);
-					bmpData[y * obw + x] = bmp.getBicubicFilteredPixel<TColor<double> >(origin.x + cx, origin.y + cy, edge);
-				}
-				if (cb) {
-					cb->setPercentDone(y, obh);
-				}
-			}
+		const ResampleFilter filter = (1 == filterType ? RF_BICUBIC : RF_BILINEAR);
+		const bool done = (TM_SHEARS == method ?
+			rotateShears(bmp, bmpOut, angle, filter, edge, cb) :
+			resampleAffine(bmp, bmpOut, invRot, filter, edge, cb));
+		if (!done || getAbortState()) {
+			return KPR_ABORTED;
 		}
 	}
 	if (cb) {
@@ -976,38 +1228,135 @@ ModuleBase::ProcessResult ShearModule::moduleImplementation(unsigned flags) {
 	const int obw = static_cast<int>(ceilf(maxX) - floorf(minX));
 	const int obh = static_cast<int>(ceilf(maxY) - floorf(minY));
 	Bitmap bmpOut(obw, obh);
-	Color * bmpData = bmpOut.getDataPtr();
-	const int ocx = obw / 2;
-	const int ocy = obh / 2;
 	EdgeFillType edge = EdgeFillType::EFT_BLANK;
 	unsigned filterType = 0;
+	unsigned method = TM_MAPPING;
 	if (pman) {
 		unsigned edgeType = 0;
 		if (pman->getEnumParam(edgeType, "edge")) {
 			edge = static_cast<EdgeFillType>(edgeType);
 		}
 		pman->getEnumParam(filterType, "filterType");
+		pman->getEnumParam(method, "method");
+	}
+	const ResampleFilter filter = (1 == filterType ? RF_BICUBIC : RF_BILINEAR);
+	// the inverse of the shear is the vertical one after the horizontal one, both negated
+	const bool done = (TM_SHEARS == method ?
+		resampleShears(bmp, bmpOut, 0.0f, -vertical, -horizontal, filter, edge, cb) :
+		resampleAffine(bmp, bmpOut, invShear, filter, edge, cb));
+	if (!done || getAbortState()) {
+		return KPR_ABORTED;
 	}
-	if (0 == filterType) {
-		for (int y = 0; y < obh && !getAbortState(); ++y) {
-			for (int x = 0; x < obw && !getAbortState(); ++x) {
-				const Vector2 origin = invShear * Vector2(x - ocx + 0.5f, y - ocy + 0.5f);
-				bmpData[y * obw + x] = bmp.getBilinearFilteredPixel<TColor<double> >(origin.x + cx, origin.y + cy, edge);
-			}
-			if (cb) {
-				cb->setPercentDone(y, obh);
-			}
+	if (cb) {
+		cb->setPercentDone(1, 1);
+	}
+	if (oman) {
+		oman->setOutput(bmpOut, 1);
+	}
+	return ModuleBase::KPR_OK;
+}
+
+size_t WarpModule::TableKeyHash::operator()(const TableKey& key) const noexcept {
+	uint64 h = 14695981039346656037ULL;
+	auto hashBytes = [&h](const void * bytes, size_t count) {
+		const uint8 * ptr = reinterpret_cast<const uint8 *>(bytes);
+		for (size_t i = 0; i < count; ++i) {
+			h = (h ^ ptr[i]) * 1099511628211ULL;
 		}
-	} else if (1 == filterType) {
-		for (int y = 0; y < obh && !getAbortState(); ++y) {
-			for (int x = 0; x < obw && !getAbortState(); ++x) {
-				const Vector2 origin = invShear * Vector2(x - ocx + 0.5f, y - ocy + 0.5f);
-				bmpData[y * obw + x] = bmp.getBicubicFilteredPixel<TColor<double> >(origin.x + cx, origin.y + cy, edge);
-			}
-			if (cb) {
-				cb->setPercentDone(y, obh);
+	};
+	hashBytes(key.inverse, sizeof(key.inverse));
+	hashBytes(&key.width, sizeof(key.width));
+	hashBytes(&key.height, sizeof(key.height));
+	return static_cast<size_t>(h);
+}
+
+std::shared_ptr<const RemapTable> WarpModule::getTable(const Homography& inverse, int width, int height) {
+	TableKey key;
+	memcpy(key.inverse, inverse.m, sizeof(key.inverse));
+	key.width = width;
+	key.height = height;
+	std::shared_ptr<const RemapTable> table = tableCache.find(key);
+	if (table) {
+		return table;
+	}
+	std::shared_ptr<RemapTable> newTable = std::make_shared<RemapTable>(inverse, width, height);
+	return tableCache.insert(key, newTable, newTable->getMemoryUsage());
+}
+
+ModuleBase::ProcessResult WarpModule::moduleImplementation(unsigned flags) {
+	const bool inputOk = getInput();
+	if (!inputOk || !bmp.isOK()) {
+		return KPR_INVALID_INPUT;
+	}
+	if (cb) {
+		cb->setModuleName("Warp");
+		cb->setPercentDone(0, 1);
+	}
+	std::string matrixStr = "1;0;0;0;1;0;0;0;1";
+	std::string cornersStr;
+	int width = 0;
+	int height = 0;
+	EdgeFillType edge = EdgeFillType::EFT_BLANK;
+	unsigned filterType = 0;
+	if (pman) {
+		pman->getStringParam(matrixStr, "matrix");
+		pman->getStringParam(cornersStr, "corners");
+		pman->getIntParam(width, "width");
+		pman->getIntParam(height, "height");
+		unsigned edgeType = 0;
+		if (pman->getEnumParam(edgeType, "edge")) {
+			edge = static_cast<EdgeFillType>(edgeType);
+		}
+		pman->getEnumParam(filterType, "filterType");
+	}
+	if (width <= 0) {
+		width = bmp.getWidth();
+	}
+	if (height <= 0) {
+		height = bmp.getHeight();
+	}
+	Homography inverse;
+	if (!cornersStr.empty()) {
+		const std::vector<std::string> corners = splitString(cornersStr.c_str(), ';');
+		if (corners.size() != 4) {
+			return KPR_INVALID_INPUT;
+		}
+		Vector2 src[4];
+		for (int i = 0; i < 4; ++i) {
+			const std::vector<std::string> coords = splitString(corners[i].c_str(), ',');
+			if (coords.size() != 2) {
+				return KPR_INVALID_INPUT;
 			}
+			src[i] = Vector2(static_cast<float>(atof(coords[0].c_str())), static_cast<float>(atof(coords[1].c_str())));
+		}
+		const Vector2 dst[4] = {
+			Vector2(0, 0),
+			Vector2(width, 0),
+			Vector2(width, height),
+			Vector2(0, height)
+		};
+		// the table needs the mapping from the output back to the input
+		if (!Homography::fromPoints(dst, src, inverse)) {
+			return KPR_INVALID_INPUT;
+		}
+	} else {
+		const std::vector<std::string> values = splitString(matrixStr.c_str(), ';');
+		if (values.size() != 6 && values.size() != 9) {
+			return KPR_INVALID_INPUT;
+		}
+		// an affine matrix has an implicit last row
+		Homography forward;
+		for (int i = 0; i < static_cast<int>(values.size()); ++i) {
+			forward.m[i / 3][i % 3] = atof(values[i].c_str());
 		}
+		if (!forward.inverse(inverse)) {
+			return KPR_INVALID_INPUT;
+		}
+	}
+	const std::shared_ptr<const RemapTable> table = getTable(inverse, width, height);
+	Bitmap bmpOut;
+	if (!table->apply(bmp, bmpOut, (1 == filterType ? RF_BICUBIC : RF_BILINEAR), edge, cb) || getAbortState()) {
+		return KPR_ABORTED;
 	}
 	if (cb) {
 		cb->setPercentDone(1, 1);
@@ -1018,29 +1367,136 @@ ModuleBase::ProcessResult ShearModule::moduleImplementation(unsigned flags) {
 	return ModuleBase::KPR_OK;
 }
 
-ModuleBase::ProcessResult HistogramModule::moduleImplementation(unsigned flags) {
+ModuleBase::ProcessResult LaplacianPyramidModule::moduleImplementation(unsigned flags) {
 	const bool inputOk = getInput();
 	if (!inputOk || !bmp.isOK()) {
 		return KPR_INVALID_INPUT;
 	}
 	if (cb) {
-		cb->setModuleName("Histogram");
+		cb->setModuleName("Laplacian Pyramid");
+		cb->setPercentDone(0, 1);
 	}
-	int outWidth = 512;
-	int outHeight = 255;
-	int smooths = 1;
-	std::string vecStr;
+	unsigned mode = PM_DETAIL;
+	int levelCount = 0;
+	std::string gainsStr = "1.5;1.25";
+	unsigned maskType = BM_VERTICAL;
+	float split = 0.5f;
 	if (pman) {
-		pman->getIntParam(outWidth, "width");
-		pman->getIntParam(outHeight, "height");
-		pman->getIntParam(smooths, "smooths");
-		pman->getStringParam(vecStr, "vector");
-	}
-	const int histCount = smooths + 1;
-	if (histCount <= 0) {
-		return KPR_INVALID_INPUT;
+		pman->getEnumParam(mode, "mode");
+		pman->getIntParam(levelCount, "levels");
+		pman->getStringParam(gainsStr, "gains");
+		pman->getEnumParam(maskType, "mask");
+		pman->getFloatParam(split, "split");
+	}
+	if (PM_CAPTURE == mode) {
+		captured = bmp;
+		if (oman) {
+			oman->setOutput(bmp, 1);
+		}
+		return ModuleBase::KPR_OK;
 	}
-	Bitmap bmpOut(outWidth, outHeight);
+	const int width = bmp.getWidth();
+	const int height = bmp.getHeight();
+	LaplacianPyramid pyramid;
+	if (!pyramid.build(bmp, levelCount, cb) || getAbortState()) {
+		return KPR_ABORTED;
+	}
+	if (PM_DETAIL == mode) {
+		std::vector<float> gains;
+		if (!gainsStr.empty()) {
+			const std::vector<std::string> values = splitString(gainsStr.c_str(), ';');
+			for (const std::string& value : values) {
+				gains.push_back(static_cast<float>(atof(value.c_str())));
+			}
+		}
+		pyramid.scaleDetails(gains);
+	} else {
+		if (!captured.isOK()) {
+			return KPR_INVALID_INPUT;
+		}
+		Bitmap second;
+		if (captured.getWidth() != width || captured.getHeight() != height) {
+			second.generateEmptyImage(width, height, false);
+			if (!resampleScale(captured, second, SF_MITCHELL, cb) || getAbortState()) {
+				return KPR_ABORTED;
+			}
+		} else {
+			second = captured;
+		}
+		LaplacianPyramid secondPyramid;
+		if (!secondPyramid.build(second, pyramid.getLevelCount(), cb) || getAbortState()) {
+			return KPR_ABORTED;
+		}
+		// the hard mask is smoothed by its own Gaussian pyramid, so it blends the low frequencies over a wider seam
+		PyramidImage mask;
+		mask.resize(width, height, 1);
+		const float cx = width * 0.5f;
+		const float cy = height * 0.5f;
+		const float invRx = 1.0f / std::max(split * cx, 0.5f);
+		const float invRy = 1.0f / std::max(split * cy, 0.5f);
+		parallelFor(height, [&](int y, int) {
+			float * row = mask.row(y);
+			const float py = y + 0.5f;
+			for (int x = 0; x < width; ++x) {
+				const float px = x + 0.5f;
+				bool inside = false;
+				if (BM_VERTICAL == maskType) {
+					inside = px < split * width;
+				} else if (BM_HORIZONTAL == maskType) {
+					inside = py < split * height;
+				} else {
+					const float dx = (px - cx) * invRx;
+					const float dy = (py - cy) * invRy;
+					inside = dx * dx + dy * dy < 1.0f;
+				}
+				row[x] = (inside ? 1.0f : 0.0f);
+			}
+		});
+		std::vector<PyramidImage> maskPyramid;
+		buildGaussianPyramid(mask, pyramid.getLevelCount(), maskPyramid);
+		LaplacianPyramid blended;
+		if (!blended.blend(secondPyramid, pyramid, maskPyramid)) {
+			return KPR_INVALID_INPUT;
+		}
+		pyramid = std::move(blended);
+	}
+	if (getAbortState()) {
+		return KPR_ABORTED;
+	}
+	Bitmap bmpOut;
+	pyramid.collapse(bmpOut);
+	if (cb) {
+		cb->setPercentDone(1, 1);
+	}
+	if (oman) {
+		oman->setOutput(bmpOut, 1);
+	}
+	return ModuleBase::KPR_OK;
+}
+
+ModuleBase::ProcessResult HistogramModule::moduleImplementation(unsigned flags) {
+	const bool inputOk = getInput();
+	if (!inputOk || !bmp.isOK()) {
+		return KPR_INVALID_INPUT;
+	}
+	if (cb) {
+		cb->setModuleName("Histogram");
+	}
+	int outWidth = 512;
+	int outHeight = 255;
+	int smooths = 1;
+	std::string vecStr;
+	if (pman) {
+		pman->getIntParam(outWidth, "width");
+		pman->getIntParam(outHeight, "height");
+		pman->getIntParam(smooths, "smooths");
+		pman->getStringParam(vecStr, "vector");
+	}
+	const int histCount = smooths + 1;
+	if (histCount <= 0) {
+		return KPR_INVALID_INPUT;
+	}
+	Bitmap bmpOut(outWidth, outHeight);
 	if (!bmpOut.isOK()) {
 		return KPR_INVALID_INPUT;
 	}
@@ -1118,7 +1574,7 @@ ModuleBase::ProcessResult ThresholdModule::moduleImplementation(unsigned flags)
 		pman->getIntParam(upper, "upper");
 	}
 	Bitmap bmpOut(w, h);
-	const Color* inData = bmp.getDataPtr();
+	const Color* inData = static_cast<const Bitmap&>(bmp).getDataPtr();
 	Color* outData = bmpOut.getDataPtr();
 	const int n = w * h;
 	for (int i = 0; i < n; ++i) {
@@ -1166,34 +1622,33 @@ ModuleBase::ProcessResult DownScaleModule::moduleImplementation(unsigned flags)
 	}
 	int width = 0;
 	int height = 0;
-	unsigned meduimType = 0;
+	unsigned filterType = SF_BOX;
 	if (pman) {
 		pman->getIntParam(width, "width");
 		pman->getIntParam(height, "height");
-		pman->getEnumParam(meduimType, "medium");
+		pman->getEnumParam(filterType, "filterType");
 	}
-	Bitmap out;
-	bool res = false;
-	if (0 == meduimType) {
-		res = bmp.downscale<TColor<uint16> >(out, width, height);
-	} else if (1 == meduimType) {
-		res = bmp.downscale<Color>(out, width, height);
-	} else if (2 == meduimType) {
-		res = bmp.downscale<TColor<float> >(out, width, height);
-	} else if (3 == meduimType) {
-		res = bmp.downscale<TColor<double> >(out, width, height);
+	if (width <= 0 || width > bmp.getWidth() || height <= 0 || height > bmp.getHeight()) {
+		return KPR_INVALID_INPUT;
+	}
+	// the scaling starts from the smallest level of the pyramid of the input, which is still at least as large as the output
+	// the levels drop the odd last rows and columns, so the scale is kept relative to the whole input
+	const int levelIndex = bmp.getPyramidLevelFor(width, height);
+	const std::shared_ptr<const Bitmap> level = bmp.getPyramidLevel(levelIndex);
+	const double levelScale = static_cast<double>(1 << levelIndex);
+	const double scaleX = bmp.getWidth() / (width * levelScale);
+	const double scaleY = bmp.getHeight() / (height * levelScale);
+	Bitmap out(width, height);
+	if (!resampleScale(level ? *level : bmp, out, scaleX, scaleY, static_cast<ScaleFilter>(filterType), cb) || getAbortState()) {
+		return KPR_ABORTED;
 	}
 	if (cb) {
 		cb->setPercentDone(1, 1);
 	}
-	if (res) {
-		if (oman) {
-			oman->setOutput(out, 1);
-		}
-		return KPR_OK;
-	} else {
-		return KPR_FATAL_ERROR;
+	if (oman) {
+		oman->setOutput(out, 1);
 	}
+	return KPR_OK;
 }
 
 ModuleBase::ProcessResult UpScaleModule::moduleImplementation(unsigned flags) {
@@ -1207,26 +1662,26 @@ ModuleBase::ProcessResult UpScaleModule::moduleImplementation(unsigned flags) {
 	}
 	int width = 0;
 	int height = 0;
-	unsigned filterType = UpscaleFiltering::UF_BILINEAR;
+	unsigned filterType = SF_TRIANGLE;
 	if (pman) {
 		pman->getIntParam(width, "width");
 		pman->getIntParam(height, "height");
 		pman->getEnumParam(filterType, "filterType");
 	}
-	Bitmap out;
-	bool res = false;
-	res = bmp.upscale<TColor<double> >(out, width, height, static_cast<UpscaleFiltering>(filterType));
+	if (width < bmp.getWidth() || height < bmp.getHeight()) {
+		return KPR_INVALID_INPUT;
+	}
+	Bitmap out(width, height);
+	if (!resampleScale(bmp, out, static_cast<ScaleFilter>(filterType), cb) || getAbortState()) {
+		return KPR_ABORTED;
+	}
 	if (cb) {
 		cb->setPercentDone(1, 1);
 	}
-	if (res) {
-		if (oman) {
-			oman->setOutput(out, 1);
-		}
-		return KPR_OK;
-	} else {
-		return KPR_FATAL_ERROR;
+	if (oman) {
+		oman->setOutput(out, 1);
 	}
+	return KPR_OK;
 }
 
 ModuleBase::ProcessResult RelocateModule::moduleImplementation(unsigned flags) {
@@ -1388,7 +1843,7 @@ ModuleBase::ProcessResult KMeansModule::moduleImplementation(unsigned flags) {
 	}
 	const int bmpDims = bmp.getDimensionProduct();
 	std::unique_ptr<Vector<3, double>[] > valArray(new Vector<3, double>[bmpDims]);
-	const Color * bmpData = bmp.getDataPtr();
+	const Color * bmpData = static_cast<const Bitmap&>(bmp).getDataPtr();
 	// convert the colors to 3-dimensional vectors
 	for (int i = 0; i < bmpDims; ++i) {
 		const TColor<double> c = static_cast<TColor<double> >(bmpData[i]);
@@ -1423,6 +1878,143 @@ ModuleBase::ProcessResult KMeansModule::moduleImplementation(unsigned flags) {
 	}
 }
 
+template<class T>
+bool FFTDomainModule::computeDomain(const Bitmap& input, bool logScale, Bitmap& out) {
+	const int width = input.getWidth();
+	const int height = input.getHeight();
+	ColorSpectrum<T> spectrum(width, height);
+
+	if (getAbortState()) {
+		return false;
+	}
+
+	spectrum.forward(input);
+
+	const int dimProd = input.getDimensionProduct();
+	std::unique_ptr<T[]> magnitudes(new T[dimProd * ColorChannel::CC_COUNT]);
+	T minValue = std::numeric_limits<T>::max();
+	T maxValue = std::numeric_limits<T>::lowest();
+
+	for (int i = 0; i < ColorChannel::CC_COUNT && !getAbortState(); ++i) {
+		if (cb)
+			cb->setPercentDone(i, ColorChannel::CC_COUNT);
+
+		// remap all values to their absolute value and find their range
+		T * channelMagnitudes = magnitudes.get() + i * dimProd;
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				const T coeffAbs = spectrum.getCoefficient(static_cast<ColorChannel>(i), x, y).abs();
+				const T magnitude = (logScale ? std::log(coeffAbs) : coeffAbs);
+				channelMagnitudes[y * width + x] = magnitude;
+				if (std::isfinite(magnitude)) {
+					minValue = std::min(minValue, magnitude);
+					maxValue = std::max(maxValue, magnitude);
+				}
+			}
+		}
+	}
+
+	if (getAbortState()) {
+		return false;
+	}
+
+	// as a final step normalize all the values
+	out.generateEmptyImage(width, height);
+	Color * outData = out.getDataPtr();
+	const T valRangeRecip = (maxValue > minValue ? static_cast<T>(255) / (maxValue - minValue) : static_cast<T>(0));
+	for (int i = 0; i < ColorChannel::CC_COUNT; ++i) {
+		const T * channelMagnitudes = magnitudes.get() + i * dimProd;
+		for (int j = 0; j < dimProd; ++j) {
+			outData[j][i] = static_cast<uint8>(clamp((channelMagnitudes[j] - minValue) * valRangeRecip, static_cast<T>(0), static_cast<T>(255)));
+		}
+	}
+	return true;
+}
+
+template<class T>
+ModuleBase::ProcessResult FFTDomainModule::computeDomainOutOfCore(const Bitmap& input, bool logScale, size_t ramBudget, Bitmap& out) {
+	const int width = input.getWidth();
+	const int height = input.getHeight();
+	// the channels are packed as in the ColorSpectrum - red and green in the first plane and blue in the second
+	OutOfCoreFFT2D<T> planeRG(width, height, ramBudget);
+	OutOfCoreFFT2D<T> planeB(width, height, ramBudget);
+	if (!planeRG.create() || !planeB.create()) {
+		return KPR_FATAL_ERROR;
+	}
+
+	const Color * inData = input.getDataPtr();
+	TComplex<T> * dataRG = planeRG.getData();
+	TComplex<T> * dataB = planeB.getData();
+	const T colorNorm = static_cast<T>(1.0 / 255.0);
+	for (int y = 0; y < height; ++y) {
+		const size_t rowOffset = static_cast<size_t>(y) * width;
+		for (int x = 0; x < width; ++x) {
+			const Color& c = inData[rowOffset + x];
+			dataRG[rowOffset + x] = TComplex<T>(c.r * colorNorm, c.g * colorNorm);
+			dataB[rowOffset + x] = TComplex<T>(c.b * colorNorm, static_cast<T>(0));
+		}
+	}
+
+	const auto abortCheck = [this]() {
+		return getAbortState();
+	};
+	if (cb)
+		cb->setPercentDone(0, 4);
+	if (!planeRG.transform(false, abortCheck)) {
+		return KPR_ABORTED;
+	}
+	if (cb)
+		cb->setPercentDone(1, 4);
+	if (!planeB.transform(false, abortCheck)) {
+		return KPR_ABORTED;
+	}
+
+	// the magnitudes are not stored, but computed twice - once for their range and once for the output
+	auto channelMagnitude = [&](int cc, int x, int y) {
+		const size_t offset = static_cast<size_t>(y) * width + x;
+		TComplex<T> coeff;
+		if (cc == ColorChannel::CC_BLUE) {
+			coeff = dataB[offset];
+		} else {
+			const int mx = (x == 0 ? 0 : width - x);
+			const int my = (y == 0 ? 0 : height - y);
+			coeff = unpackSpectrum(dataRG[offset], dataRG[static_cast<size_t>(my) * width + mx], cc == ColorChannel::CC_GREEN);
+		}
+		return (logScale ? std::log(coeff.abs()) : coeff.abs());
+	};
+
+	if (cb)
+		cb->setPercentDone(2, 4);
+	T minValue = std::numeric_limits<T>::max();
+	T maxValue = std::numeric_limits<T>::lowest();
+	for (int y = 0; y < height && !getAbortState(); ++y) {
+		for (int x = 0; x < width; ++x) {
+			for (int cc = 0; cc < ColorChannel::CC_COUNT; ++cc) {
+				const T magnitude = channelMagnitude(cc, x, y);
+				if (std::isfinite(magnitude)) {
+					minValue = std::min(minValue, magnitude);
+					maxValue = std::max(maxValue, magnitude);
+				}
+			}
+		}
+	}
+
+	if (cb)
+		cb->setPercentDone(3, 4);
+	out.generateEmptyImage(width, height);
+	Color * outData = out.getDataPtr();
+	const T valRangeRecip = (maxValue > minValue ? static_cast<T>(255) / (maxValue - minValue) : static_cast<T>(0));
+	for (int y = 0; y < height && !getAbortState(); ++y) {
+		for (int x = 0; x < width; ++x) {
+			Color& c = outData[static_cast<size_t>(y) * width + x];
+			for (int cc = 0; cc < ColorChannel::CC_COUNT; ++cc) {
+				c[cc] = static_cast<uint8>(clamp((channelMagnitude(cc, x, y) - minValue) * valRangeRecip, static_cast<T>(0), static_cast<T>(255)));
+			}
+		}
+	}
+	return (getAbortState() ? KPR_ABORTED : KPR_OK);
+}
+
 ModuleBase::ProcessResult FFTDomainModule::moduleImplementation(unsigned flags) {
 	const bool inputOk = getInput();
 	if (!inputOk || !bmp.isOK()) {
@@ -1436,11 +2028,20 @@ ModuleBase::ProcessResult FFTDomainModule::moduleImplementation(unsigned flags)
 	bool centralize = true;
 	bool squareDim = false;
 	bool powerOf2Flag = false;
+	unsigned precision = FP_DOUBLE;
+	bool outOfCore = false;
+	int ramBudgetMB = 256;
 	if (pman) {
 		pman->getBoolParam(logScale, "logScale");
 		pman->getBoolParam(centralize, "centralized");
 		pman->getBoolParam(squareDim, "squareDimension");
 		pman->getBoolParam(powerOf2Flag, "powerOf2");
+		pman->getEnumParam(precision, "precision");
+		pman->getBoolParam(outOfCore, "outOfCore");
+		pman->getIntParam(ramBudgetMB, "ramBudgetMB");
+	}
+	if (outOfCore && ramBudgetMB < 1) {
+		return KPR_INVALID_INPUT;
 	}
 
 	const int width = bmp.getWidth();
@@ -1453,95 +2054,34 @@ ModuleBase::ProcessResult FFTDomainModule::moduleImplementation(unsigned flags)
 	const int fftDimW = (squareDim ? fftDim : (powerOf2Flag ? fftWidth : width));
 	const int fftDimH = (squareDim ? fftDim : (powerOf2Flag ? fftHeight : height));
 
-	Pixelmap<TColor<Complex> > bmpComplex(bmp);
+	Bitmap expanded(bmp);
 	// if the width and height for the fft differ - expand the bitmap
 	if (width != fftDimW || height != fftDimH) {
 		const int relocationX = (fftDimW - width) / 2;
 		const int relocationY = (fftDimH - height) / 2;
 		const int widthExpansion = fftDimW - width;
 		const int heightExpansion = fftDimH - height;
-		bmpComplex.expand(widthExpansion, heightExpansion, relocationX, relocationY, EFT_TILE);
+		expanded.expand(widthExpansion, heightExpansion, relocationX, relocationY, EFT_TILE);
 	}
-	Pixelmap<TColor<Complex> > outComplex(fftDimW, fftDimH);
-
-	std::vector<int> dims;
-	dims.push_back(fftDimH);
-	dims.push_back(fftDimW);
-
-	const FFT2D& forward = FFTCache<2>::get().getFFT(dims, false);
-
-	if (getAbortState()) {
-		return KPR_ABORTED;
-	}
-
-	const int dimProd = bmpComplex.getDimensionProduct();
-	std::unique_ptr<Complex[]> inChannel(new Complex[dimProd]);
-	std::unique_ptr<Complex[]> frequencyChannel(new Complex[dimProd]);
-
-	for (int i = 0; i < ColorChannel::CC_COUNT && !getAbortState(); ++i) {
-		if (cb)
-			cb->setPercentDone(i, ColorChannel::CC_COUNT);
-
-		// get the current channel
-		bmpComplex.getChannel(inChannel.get(), static_cast<ColorChannel>(i));
 
-		// run the forward fft
-		forward.transform(inChannel.get(), frequencyChannel.get());
-
-		// set the channel to the output pixelmap
-		outComplex.setChannel(frequencyChannel.get(), static_cast<ColorChannel>(i));
-	}
-
-	// now remap all values to their absolute value
-	outComplex.remap([](TColor<Complex> in) {
-		return TColor<Complex>(
-			Complex(abs(in.r), 0.0),
-			Complex(abs(in.g), 0.0),
-			Complex(abs(in.b), 0.0)
-		);
-	});
-
-	if (logScale) {
-		outComplex.remap([](TColor<Complex> in) {
-			return TColor<Complex>(
-				Complex(std::log(in.r.real()), 0.0),
-				Complex(std::log(in.g.real()), 0.0),
-				Complex(std::log(in.b.real()), 0.0)
-				);
-		});
-	}
-
-	if (getAbortState()) {
-		return KPR_ABORTED;
-	}
-
-	// as a final step normalize all the values
-	TColor<Complex> * outData = outComplex.getDataPtr();
-	double minValue = Inf;
-	double maxValue = 0.0;
-	for (int i = 0; i < dimProd; ++i) {
-		const TColor<Complex>& c = outData[i];
-		for (int ci = 0; ci < 3; ++ci) {
-			if (c[ci].real() > maxValue) {
-				maxValue = c[ci].real();
-			} else if(c[ci].real() < minValue) {
-				minValue = c[ci].real();
-			}
+	Bitmap out;
+	if (outOfCore) {
+		const size_t ramBudget = static_cast<size_t>(ramBudgetMB) << 20;
+		const ModuleBase::ProcessResult result = (precision == FP_FLOAT ?
+			computeDomainOutOfCore<float>(expanded, logScale, ramBudget, out) :
+			computeDomainOutOfCore<double>(expanded, logScale, ramBudget, out));
+		if (result != KPR_OK) {
+			return result;
+		}
+	} else {
+		const bool computed = (precision == FP_FLOAT ?
+			computeDomain<float>(expanded, logScale, out) :
+			computeDomain<double>(expanded, logScale, out));
+		if (!computed) {
+			return KPR_ABORTED;
 		}
 	}
 
-	const double valRange = maxValue - minValue;
-	const double valRangeRecip = 1.0 / valRange;
-	outComplex.remap([minValue,valRangeRecip](TColor<Complex> in) {
-		return TColor<Complex>(
-			Complex((in.r.real() - minValue) * valRangeRecip, 0.0),
-			Complex((in.g.real() - minValue) * valRangeRecip, 0.0),
-			Complex((in.b.real() - minValue) * valRangeRecip, 0.0)
-			);
-	});
-
-	Bitmap out(outComplex);
-
 	// make relocations after it is converted to standart uint8 space to save memory
 	if (centralize) {
 		out.relocate(out.getWidth() / 2, out.getHeight() / 2);
@@ -1561,6 +2101,52 @@ ModuleBase::ProcessResult FFTDomainModule::moduleImplementation(unsigned flags)
 	}
 }
 
+template<class T>
+bool FFTCompressionModule::compress(const Bitmap& input, int compWidth, int compHeight, Bitmap& out) {
+	const int width = input.getWidth();
+	const int height = input.getHeight();
+	ColorSpectrum<T> spectrum(width, height);
+
+	if (getAbortState()) {
+		return false;
+	}
+
+	if (cb)
+		cb->setPercentDone(0, 2);
+
+	spectrum.forward(input);
+
+	// compute the x and y coordinates that will mark the zoroing to simulate compression
+	const int compWidthRemainder = width - compWidth;
+	const int compHeightRemainder = height - compHeight;
+	const int compX = (width - compWidthRemainder) / 2;
+	const int compY = (height - compHeightRemainder) / 2;
+	auto inStrips = [=](int x, int y) {
+		return (y > compY && y < compY + compHeightRemainder) || (x > compX && x < compX + compWidthRemainder);
+	};
+	// now zero out all coefficients in the two strips - a coefficient is zeroed together with its mirror,
+	// so the spectrum keeps the symmetry of a real signal and the packed channels remain separable
+	for (int y = 0; y < height; ++y) {
+		const int my = (y == 0 ? 0 : height - y);
+		for (int x = 0; x < width; ++x) {
+			const int mx = (x == 0 ? 0 : width - x);
+			if (inStrips(x, y) || inStrips(mx, my)) {
+				spectrum.zeroCoefficient(x, y);
+			}
+		}
+	}
+
+	if (getAbortState()) {
+		return false;
+	}
+
+	if (cb)
+		cb->setPercentDone(1, 2);
+
+	// run the inverse fft over the compressed spectrum
+	return spectrum.inverse(out);
+}
+
 ModuleBase::ProcessResult FFTCompressionModule::moduleImplementation(unsigned flags) {
 	const bool inputOk = getInput();
 	if (!inputOk || !bmp.isOK()) {
@@ -1570,10 +2156,18 @@ ModuleBase::ProcessResult FFTCompressionModule::moduleImplementation(unsigned fl
 		cb->setModuleName("FFTCompression");
 	}
 	float percent = 100.0f;
+	unsigned precision = FP_DOUBLE;
+	unsigned mode = CM_SIMULATE;
+	float quantStep = 1.0f;
+	std::string outputFile;
 	if (pman) {
 		pman->getFloatParam(percent, "compressPercent");
+		pman->getEnumParam(precision, "precision");
+		pman->getEnumParam(mode, "mode");
+		pman->getFloatParam(quantStep, "quantStep");
+		pman->getStringParam(outputFile, "outputFile");
 	}
-	if (percent < 0.0f || percent > 100.0f) {
+	if (percent < 0.0f || percent > 100.0f || (mode == CM_CODEC && quantStep <= 0.0f)) {
 		return KPR_INVALID_INPUT;
 	}
 	const int width = bmp.getWidth();
@@ -1583,95 +2177,175 @@ ModuleBase::ProcessResult FFTCompressionModule::moduleImplementation(unsigned fl
 	const int compWidth = static_cast<int>(ceilf(width * ratio));
 	const int compHeight = static_cast<int>(ceilf(height * ratio));
 
-	Pixelmap<TColor<Complex> > bmpComplex(bmp);
-	Pixelmap<TColor<Complex> > bmpCompressed(width, height);
-	Pixelmap<TColor<Complex> > outComplex(width, height);
+	Bitmap out;
+	if (mode == CM_CODEC) {
+		if (cb)
+			cb->setPercentDone(0, 2);
+		// the stream is kept in memory unless a file is given
+		std::unique_ptr<std::iostream> stream;
+		if (outputFile.empty()) {
+			stream.reset(new std::stringstream(std::ios::in | std::ios::out | std::ios::binary));
+		} else {
+			stream.reset(new std::fstream(outputFile, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc));
+		}
+		const bool encoded = stream->good() && (precision == FP_FLOAT ?
+			FFTCodec<float>::encode(bmp, compWidth, compHeight, quantStep, *stream) :
+			FFTCodec<double>::encode(bmp, compWidth, compHeight, quantStep, *stream));
+		if (!encoded) {
+			return KPR_FATAL_ERROR;
+		}
+		const std::streamoff encodedSize = stream->tellp();
+		if (getAbortState()) {
+			return KPR_ABORTED;
+		}
+		if (cb)
+			cb->setPercentDone(1, 2);
+		stream->seekg(0);
+		const bool decoded = (precision == FP_FLOAT ?
+			FFTCodec<float>::decode(*stream, out) :
+			FFTCodec<double>::decode(*stream, out));
+		if (!decoded) {
+			return KPR_FATAL_ERROR;
+		}
+		if (cb) {
+			const double rawSize = static_cast<double>(width) * height * ColorChannel::CC_COUNT;
+			cb->setModuleName("FFTCompression " + std::to_string(encodedSize) + " bytes (" + std::to_string(encodedSize * 100.0 / rawSize) + "% of raw)");
+		}
+	} else {
+		const bool compressed = (precision == FP_FLOAT ?
+			compress<float>(bmp, compWidth, compHeight, out) :
+			compress<double>(bmp, compWidth, compHeight, out));
+		if (!compressed) {
+			return KPR_ABORTED;
+		}
+	}
+
+	if (cb)
+		cb->setPercentDone(1, 1);
 
-	std::vector<int> dims;
-	dims.push_back(height);
-	dims.push_back(width);
+	bool res = true;
+	if (res) {
+		if (oman) {
+			oman->setOutput(out, bmpId);
+		}
+		return KPR_OK;
+	} else {
+		return KPR_FATAL_ERROR;
+	}
+}
 
-	const FFT2D& forward = FFTCache<2>::get().getFFT(dims, false);
-	const FFT2D& inverse = FFTCache<2>::get().getFFT(dims, true);
+// returns the (cached) spectrum of the kernel mapped to an image with the given dimensions with its center in (0, 0)
+// the spectrum depends only on the (already normalized) contents of the kernel and the dimensions
+template<class T>
+static typename SpectrumCache<T>::SpectrumPtr getKernelSpectrum(const ConvolutionKernel& ck, int width, int height) {
+	const int ckSide = ck.getSide();
+	const float * kernelData = ck.getDataPtr();
+	SpectrumKey filterKey;
+	filterKey.name = "kernel";
+	filterKey.source.assign(kernelData, kernelData + ckSide * ckSide);
+	filterKey.width = width;
+	filterKey.height = height;
+	typename SpectrumCache<T>::SpectrumPtr filterFreq = SpectrumCache<T>::get().find(filterKey);
+	if (!filterFreq) {
+		// map the small filter to an image sized one, wrapping around the edges
+		std::shared_ptr<typename SpectrumCache<T>::Spectrum> filterSpectrum = std::make_shared<typename SpectrumCache<T>::Spectrum>(width * height);
+		TComplex<T> * filterFullMap = filterSpectrum->data();
+		for (int ky = 0; ky < ckSide; ++ky) {
+			const int y = ((ky - ckSide / 2) % height + height) % height;
+			for (int kx = 0; kx < ckSide; ++kx) {
+				const int x = ((kx - ckSide / 2) % width + width) % width;
+				filterFullMap[y * width + x] += TComplex<T>(static_cast<T>(kernelData[ky * ckSide + kx]), static_cast<T>(0));
+			}
+		}
 
-	if (getAbortState()) {
-		return KPR_ABORTED;
+		// and transform it to the frequency domain in place
+		std::vector<int> dims;
+		dims.push_back(height);
+		dims.push_back(width);
+		FFTCache<2, T>::get().getFFT(dims, false)->transform(filterFullMap, filterFullMap);
+		filterFreq = SpectrumCache<T>::get().insert(filterKey, filterSpectrum);
 	}
+	return filterFreq;
+}
 
-	const int dimProd = bmpComplex.getDimensionProduct();
-	std::unique_ptr<Complex[]> fftInChannel(new Complex[dimProd]);
-	std::unique_ptr<Complex[]> fftOutChannel(new Complex[dimProd]);
+template<class T>
+bool FFTFilter::applyFilter(const Bitmap& input, const ConvolutionKernel& ck, Bitmap& out) {
+	const int width = input.getWidth();
+	const int height = input.getHeight();
+	ColorSpectrum<T> spectrum(width, height);
 
-	for (int i = 0; i < ColorChannel::CC_COUNT && !getAbortState(); ++i) {
-		if (cb)
-			cb->setPercentDone(i, 2 * ColorChannel::CC_COUNT);
+	if (getAbortState()) {
+		return false;
+	}
 
-		// get the current channel
-		bmpComplex.getChannel(fftInChannel.get(), static_cast<ColorChannel>(i));
+	const typename SpectrumCache<T>::SpectrumPtr filterFreq = getKernelSpectrum<T>(ck, width, height);
 
-		// run the forward fft
-		forward.transform(fftInChannel.get(), fftOutChannel.get());
+	if (cb)
+		cb->setPercentDone(1, 3);
 
-		// set the channel to the compressed pixelmap
-		bmpCompressed.setChannel(fftOutChannel.get(), static_cast<ColorChannel>(i));
-	}
+	// run the forward fft over all channels, apply the filter and inverse them back to the pixel domain
+	spectrum.forward(input);
 
-	// compute the x and y coordinates that will mark the zoroing to simulate compression
-	const int compWidthRemainder = width - compWidth;
-	const int compHeightRemainder = height - compHeight;
-	const int compX = (width - compWidthRemainder) / 2;
-	const int compY = (height - compHeightRemainder) / 2;
-	// now zero out all pixel which are in the two strips
-	TColor<Complex> * compData = bmpCompressed.getDataPtr();
-	for (int y = 0; y < height; ++y) {
-		// if this row is in the cropped area - zero the whole row
-		if (y > compY && y < compY + compHeightRemainder) {
-			memset(compData + y * width, 0, width * sizeof(TColor<Complex>));
-		} else {
-			// else go through the columns
-			for (int x = 0; x < width; ++x) {
-				if (x > compX && x < compX + compWidthRemainder) {
-					compData[y * width + x] = TColor<Complex>();
-				}
-			}
-		}
+	if (getAbortState()) {
+		return false;
 	}
 
-	// now after the compression is simulated - make the inverse transform over the compressed pixelmap
-	for (int i = 0; i < ColorChannel::CC_COUNT && !getAbortState(); ++i) {
-		if (cb)
-			cb->setPercentDone(ColorChannel::CC_COUNT + i, 2 * ColorChannel::CC_COUNT);
+	spectrum.multiply(filterFreq->data());
 
-		// get the current channel
-		bmpCompressed.getChannel(fftInChannel.get(), static_cast<ColorChannel>(i));
+	if (cb)
+		cb->setPercentDone(2, 3);
 
-		// run the inverse fft - fftOutChannel is already initialized
-		inverse.transform(fftInChannel.get(), fftOutChannel.get());
+	return spectrum.inverse(out);
+}
 
-		// set the channel to the output pixelmap and use it before the actual compress
-		outComplex.setChannel(fftOutChannel.get(), static_cast<ColorChannel>(i));
-	}
+template<class T>
+bool FFTFilter::applyFilterTiled(const Bitmap& input, const ConvolutionKernel& ck, int tileSize, Bitmap& out) {
+	const int width = input.getWidth();
+	const int height = input.getHeight();
+	const int ckSide = ck.getSide();
+	const int ckHalf = ckSide / 2;
+	// the tile has to contain the output block and the apron needed by the kernel
+	const int fftSide = fftFriendlySize(tileSize + ckSide - 1);
+	const int blockSide = fftSide - (ckSide - 1); //!< the valid output pixels of a tile
+	const int apron = ckSide - 1 - ckHalf; //!< the offset of the valid output inside the tile
 
-	// noramlize the output since it will be with scaled values
-	const double normFactor = 1.0 / dimProd;
-	outComplex.remap([normFactor](TColor<Complex> in) {
-		return in * normFactor;
-	});
+	if (getAbortState()) {
+		return false;
+	}
 
-	Bitmap out(outComplex);
+	const typename SpectrumCache<T>::SpectrumPtr filterFreq = getKernelSpectrum<T>(ck, fftSide, fftSide);
+	const TComplex<T> * filterFreqData = filterFreq->data();
 
-	if (cb)
-		cb->setPercentDone(1, 1);
+	const int tilesX = (width + blockSide - 1) / blockSide;
+	const int tilesY = (height + blockSide - 1) / blockSide;
+	const int tileCount = tilesX * tilesY;
+	const int workers = std::min(getWorkerCount(), tileCount);
+	// every worker owns its own tile spectrum, so the memory is bounded by the tile size and not the image size
+	std::vector<std::unique_ptr<ColorSpectrum<T> > > workerSpectra(workers);
+	for (auto& tileSpectrum : workerSpectra) {
+		tileSpectrum.reset(new ColorSpectrum<T>(fftSide, fftSide));
+	}
 
-	bool res = true;
-	if (res) {
-		if (oman) {
-			oman->setOutput(out, bmpId);
+	out.generateEmptyImage(width, height);
+	std::atomic<int> tilesDone(0);
+	parallelFor(tileCount, [&](int tile, int worker) {
+		if (getAbortState()) {
+			return;
 		}
-		return KPR_OK;
-	} else {
-		return KPR_FATAL_ERROR;
-	}
+		ColorSpectrum<T>& tileSpectrum = *workerSpectra[worker];
+		const int blockX = (tile % tilesX) * blockSide;
+		const int blockY = (tile / tilesX) * blockSide;
+		const int blockWidth = std::min(blockSide, width - blockX);
+		const int blockHeight = std::min(blockSide, height - blockY);
+		// the tile is sampled with wrapping, so the result matches the circular convolution over the whole image
+		tileSpectrum.forward(input, blockX - apron, blockY - apron);
+		tileSpectrum.multiply(filterFreqData);
+		tileSpectrum.inverse(out, apron, apron, blockWidth, blockHeight, blockX, blockY);
+		if (cb) {
+			cb->setPercentDone(++tilesDone, tileCount);
+		}
+	}, workers);
+	return !getAbortState();
 }
 
 ModuleBase::ProcessResult FFTFilter::moduleImplementation(unsigned flags) {
@@ -1685,94 +2359,40 @@ ModuleBase::ProcessResult FFTFilter::moduleImplementation(unsigned flags) {
 	ConvolutionKernel ck;
 	bool normalizeKernel;
 	float normalizationValue = 1.0f;
+	unsigned precision = FP_DOUBLE;
+	unsigned mode = FM_FULL;
+	int tileSize = 512;
 	if (pman) {
 		pman->getCKernelParam(ck, "kernelFFT");
 		pman->getBoolParam(normalizeKernel, "normalizeKernel");
 		pman->getFloatParam(normalizationValue, "normalizationValue");
+		pman->getEnumParam(precision, "precision");
+		pman->getEnumParam(mode, "mode");
+		pman->getIntParam(tileSize, "tileSize");
+	}
+	if (mode == FM_TILED && tileSize < 1) {
+		return KPR_INVALID_INPUT;
 	}
 
 	if (normalizeKernel) {
 		ck.normalize(normalizationValue);
 	}
 
-	const int width = bmp.getWidth();
-	const int height = bmp.getHeight();
-
-	const int ckSide = ck.getSide();
-	Pixelmap<Complex> filterMap(ckSide, ckSide);
-	Pixelmap<Complex> filterFullMap(width, height); //!< will be as big as the image
-	Pixelmap<TColor<Complex> > bmpComplex(bmp);
-	Pixelmap<TColor<Complex> > outComplex(width, height);
-
-	std::vector<int> dims;
-	dims.push_back(height);
-	dims.push_back(width);
-
-	const int dimProd = bmpComplex.getDimensionProduct();
-	const FFT2D& forward = FFTCache<2>::get().getFFT(dims, false);
-	const FFT2D& inverse = FFTCache<2>::get().getFFT(dims, true);
-
-	if (getAbortState()) {
-		return KPR_ABORTED;
-	}
-
-	const int ckSquared = ckSide * ckSide;
-	const float * kernelData = ck.getDataPtr();
-	Complex * filterData = filterMap.getDataPtr();
-	// initialize the filter and transform it to the frequency domain
-	for (int i = 0; i < ckSquared; ++i) {
-		filterData[i] = Complex(kernelData[i], 0.0);
+	Bitmap out;
+	bool filtered = false;
+	if (mode == FM_TILED) {
+		filtered = (precision == FP_FLOAT ?
+			applyFilterTiled<float>(bmp, ck, tileSize, out) :
+			applyFilterTiled<double>(bmp, ck, tileSize, out));
+	} else {
+		filtered = (precision == FP_FLOAT ?
+			applyFilter<float>(bmp, ck, out) :
+			applyFilter<double>(bmp, ck, out));
 	}
-	// now we have to map the small filter to the big filter map
-	filterFullMap.drawBitmap(filterMap, 0, 0);
-	// and finally relocate the filter in such a way that the center is in (0, 0)
-	filterFullMap.relocate(width - ckSide / 2, height - ckSide / 2);
-
-	std::unique_ptr<Complex[]> filterFreq(new Complex[dimProd]);
-	forward.transform(filterFullMap.getDataPtr(), filterFreq.get());
-
-	// allocate operating buffers for the pixelmap channels
-	std::unique_ptr<Complex[]> fftInChannel(new Complex[dimProd]); //!< the input channel for the fft
-	std::unique_ptr<Complex[]> fftIntermediate(new Complex[dimProd]); //!< intermediate channel in frequency domain (filter is applied to it)
-	std::unique_ptr<Complex[]> fftOutChannel(new Complex[dimProd]); //!< the output channle from the inverse fft
-
-	// now run the filter over all the channels of the pixelmap
-	for (int i = 0; i < ColorChannel::CC_COUNT && !getAbortState(); ++i) {
-		if (cb)
-			cb->setPercentDone(i * 3, 3 * ColorChannel::CC_COUNT);
-
-		// get the current channel
-		bmpComplex.getChannel(fftInChannel.get(), static_cast<ColorChannel>(i));
-
-		// run the forward fft
-		forward.transform(fftInChannel.get(), fftIntermediate.get());
-
-		// now apply the filter
-		for (int j = 0; j < dimProd; ++j) {
-			fftIntermediate[j] = filterFreq[j] * fftIntermediate[j];
-		}
-
-		if (cb)
-			cb->setPercentDone(i * 3 + 1, 3 * ColorChannel::CC_COUNT);
-
-		// now inverse the channel back to the pixel domain
-		inverse.transform(fftIntermediate.get(), fftOutChannel.get());
-
-		// set the channel to the final output pixelmap
-		outComplex.setChannel(fftOutChannel.get(), static_cast<ColorChannel>(i));
-
-		if (cb)
-			cb->setPercentDone(i * 3 + 2, 3 * ColorChannel::CC_COUNT);
+	if (!filtered) {
+		return KPR_ABORTED;
 	}
 
-	// noramlize the output since it will be with scaled values
-	const double normFactor = 1.0 / dimProd;
-	outComplex.remap([normFactor](TColor<Complex> in) {
-		return in * normFactor;
-	});
-
-	Bitmap out(outComplex);
-
 	if (cb)
 		cb->setPercentDone(1, 1);
 
@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cmath>
+
+#include "pyramid.h"
+#include "parallel.h"
+#include "progress.h"
+#include "util.h"
+
+namespace {
+
+const int RowBlockSize = 16;
+const int ChunkSize = 1 << 16; //!< the values of a task of the per value operations
+
+// the vertical taps of the reduction, with a weight sum of 16
+void reduceColumns(const float * r0, const float * r1, const float * r2, const float * r3, const float * r4, float * out, int count) {
+	for (int i = 0; i < count; ++i) {
+		out[i] = (r0[i] + r4[i]) + 4.0f * (r1[i] + r3[i]) + 6.0f * r2[i];
+	}
+}
+
+// the horizontal taps of the reduction at every other pixel
+void reduceRow(const float * in, float * out, int width, int outWidth, int channels) {
+	const float norm = 1.0f / 256.0f;
+	auto reducePixel = [=](int x) {
+		int taps[5];
+		for (int m = 0; m < 5; ++m) {
+			taps[m] = clamp(2 * x + m - 2, 0, width - 1) * channels;
+		}
+		for (int c = 0; c < channels; ++c) {
+			out[x * channels + c] = ((in[taps[0] + c] + in[taps[4] + c]) + 4.0f * (in[taps[1] + c] + in[taps[3] + c]) + 6.0f * in[taps[2] + c]) * norm;
+		}
+	};
+	// the pixels with all taps inside the row
+	const int interior0 = std::min(1, outWidth);
+	const int interior1 = std::max(interior0, std::min(outWidth, (width - 3) / 2 + 1));
+	for (int x = 0; x < interior0; ++x) {
+		reducePixel(x);
+	}
+	for (int x = interior0; x < interior1; ++x) {
+		const float * p = in + (2 * x - 2) * channels;
+		float * o = out + x * channels;
+		for (int c = 0; c < channels; ++c) {
+			o[c] = ((p[c] + p[4 * channels + c]) + 4.0f * (p[channels + c] + p[3 * channels + c]) + 6.0f * p[2 * channels + c]) * norm;
+		}
+	}
+	for (int x = interior1; x < outWidth; ++x) {
+		reducePixel(x);
+	}
+}
+
+// interpolates a row to twice the density - the even pixels are (1, 6, 1) / 8 around the source pixel and the odd
+// ones are the average of the two source pixels around them
+void expandRow(const float * in, float * out, int width, int outWidth, int channels) {
+	for (int x = 0; x < outWidth; ++x) {
+		const int i = x / 2;
+		const float * center = in + i * channels;
+		const float * next = in + std::min(i + 1, width - 1) * channels;
+		float * o = out + x * channels;
+		if (x & 1) {
+			for (int c = 0; c < channels; ++c) {
+				o[c] = 0.5f * (center[c] + next[c]);
+			}
+		} else {
+			const float * prev = in + std::max(i - 1, 0) * channels;
+			for (int c = 0; c < channels; ++c) {
+				o[c] = 0.125f * (prev[c] + next[c]) + 0.75f * center[c];
+			}
+		}
+	}
+}
+
+void expandColumnsEven(const float * prev, const float * center, const float * next, float * out, int count) {
+	for (int i = 0; i < count; ++i) {
+		out[i] = 0.125f * (prev[i] + next[i]) + 0.75f * center[i];
+	}
+}
+
+void expandColumnsOdd(const float * center, const float * next, float * out, int count) {
+	for (int i = 0; i < count; ++i) {
+		out[i] = 0.5f * (center[i] + next[i]);
+	}
+}
+
+// calls func(begin, end) over chunks of the values of the image in parallel
+template<class Func>
+void parallelValues(size_t count, Func func) {
+	const int chunks = static_cast<int>((count + ChunkSize - 1) / ChunkSize);
+	parallelFor(chunks, [&](int chunk, int) {
+		const size_t begin = static_cast<size_t>(chunk) * ChunkSize;
+		func(begin, std::min(count, begin + ChunkSize));
+	});
+}
+
+} // namespace
+
+int getPyramidLevelCount(int width, int height, int minSide) {
+	int count = 1;
+	while (std::min(width, height) >= 2 * std::max(minSide, 1)) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		++count;
+	}
+	return count;
+}
+
+void pyramidReduce(const PyramidImage& src, PyramidImage& dst) {
+	const int w = src.width;
+	const int h = src.height;
+	const int channels = src.channels;
+	const int dw = (w + 1) / 2;
+	const int dh = (h + 1) / 2;
+	dst.resize(dw, dh, channels);
+	const int rowValues = w * channels;
+	const int blockCount = (dh + RowBlockSize - 1) / RowBlockSize;
+	const int workerCount = getWorkerCount();
+	std::vector<std::vector<float> > buffers(workerCount);
+	parallelFor(blockCount, [&](int block, int worker) {
+		std::vector<float>& columns = buffers[worker];
+		columns.resize(rowValues);
+		const int yEnd = std::min(dh, (block + 1) * RowBlockSize);
+		for (int y = block * RowBlockSize; y < yEnd; ++y) {
+			const float * r[5];
+			for (int m = 0; m < 5; ++m) {
+				r[m] = src.row(clamp(2 * y + m - 2, 0, h - 1));
+			}
+			reduceColumns(r[0], r[1], r[2], r[3], r[4], columns.data(), rowValues);
+			reduceRow(columns.data(), dst.row(y), w, dw, channels);
+		}
+	}, workerCount);
+}
+
+void pyramidExpand(const PyramidImage& src, int width, int height, PyramidImage& dst) {
+	const int sh = src.height;
+	const int channels = src.channels;
+	dst.resize(width, height, channels);
+	const int rowValues = width * channels;
+	const int blockCount = (height + RowBlockSize - 1) / RowBlockSize;
+	const int workerCount = getWorkerCount();
+	std::vector<std::vector<float> > buffers(workerCount);
+	parallelFor(blockCount, [&](int block, int worker) {
+		const int y0 = block * RowBlockSize;
+		const int y1 = std::min(height, y0 + RowBlockSize);
+		// the source rows read by the block, expanded horizontally once
+		const int first = std::max(y0 / 2 - 1, 0);
+		const int last = std::min((y1 - 1) / 2 + 1, sh - 1);
+		std::vector<float>& rows = buffers[worker];
+		rows.resize(static_cast<size_t>(last - first + 1) * rowValues);
+		for (int j = first; j <= last; ++j) {
+			expandRow(src.row(j), rows.data() + static_cast<size_t>(j - first) * rowValues, src.width, width, channels);
+		}
+		auto expandedRow = [&](int j) {
+			return rows.data() + static_cast<size_t>(clamp(j, 0, sh - 1) - first) * rowValues;
+		};
+		for (int y = y0; y < y1; ++y) {
+			const int j = y / 2;
+			if (y & 1) {
+				expandColumnsOdd(expandedRow(j), expandedRow(j + 1), dst.row(y), rowValues);
+			} else {
+				expandColumnsEven(expandedRow(j - 1), expandedRow(j), expandedRow(j + 1), dst.row(y), rowValues);
+			}
+		}
+	}, workerCount);
+}
+
+void bitmapToPyramidImage(const Bitmap& bmp, PyramidImage& out) {
+	out.resize(bmp.getWidth(), bmp.getHeight(), 3);
+	const uint8 * src = reinterpret_cast<const uint8 *>(bmp.getDataPtr());
+	float * dst = out.data.data();
+	parallelValues(out.data.size(), [=](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			dst[i] = src[i];
+		}
+	});
+}
+
+void pyramidImageToBitmap(const PyramidImage& img, Bitmap& out) {
+	out.generateEmptyImage(img.width, img.height, false);
+	const float * src = img.data.data();
+	uint8 * dst = reinterpret_cast<uint8 *>(out.getDataPtr());
+	parallelValues(img.data.size(), [=](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			dst[i] = static_cast<uint8>(clamp(src[i] + 0.5f, 0.0f, 255.0f));
+		}
+	});
+}
+
+void buildGaussianPyramid(const PyramidImage& image, int levelCount, std::vector<PyramidImage>& levels) {
+	levels.resize(std::max(levelCount, 1));
+	levels[0] = image;
+	for (int k = 1; k < static_cast<int>(levels.size()); ++k) {
+		pyramidReduce(levels[k - 1], levels[k]);
+	}
+}
+
+bool LaplacianPyramid::build(const Bitmap& bmp, int levelCount, ProgressCallback * cb) {
+	levels.clear();
+	if (!bmp.isOK()) {
+		return false;
+	}
+	const int maxLevels = getPyramidLevelCount(bmp.getWidth(), bmp.getHeight(), 1);
+	const int count = (levelCount > 0 ? std::min(levelCount, maxLevels) : getPyramidLevelCount(bmp.getWidth(), bmp.getHeight()));
+	levels.resize(count);
+	PyramidImage current;
+	bitmapToPyramidImage(bmp, current);
+	PyramidImage expanded;
+	for (int k = 0; k + 1 < count; ++k) {
+		if (cb && cb->getAbortFlag()) {
+			return false;
+		}
+		PyramidImage next;
+		pyramidReduce(current, next);
+		pyramidExpand(next, current.width, current.height, expanded);
+		float * detail = current.data.data();
+		const float * lowPass = expanded.data.data();
+		parallelValues(current.data.size(), [=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				detail[i] -= lowPass[i];
+			}
+		});
+		levels[k] = std::move(current);
+		current = std::move(next);
+		if (cb) {
+			cb->setPercentDone(k + 1, count);
+		}
+	}
+	levels[count - 1] = std::move(current);
+	return !(cb && cb->getAbortFlag());
+}
+
+void LaplacianPyramid::collapse(Bitmap& out) const {
+	if (levels.empty()) {
+		out.freeMem();
+		return;
+	}
+	PyramidImage result = levels.back();
+	PyramidImage expanded;
+	for (int k = static_cast<int>(levels.size()) - 2; k >= 0; --k) {
+		const PyramidImage& detail = levels[k];
+		pyramidExpand(result, detail.width, detail.height, expanded);
+		float * sum = expanded.data.data();
+		const float * details = detail.data.data();
+		parallelValues(expanded.data.size(), [=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				sum[i] += details[i];
+			}
+		});
+		std::swap(result, expanded);
+	}
+	pyramidImageToBitmap(result, out);
+}
+
+void LaplacianPyramid::scaleDetails(const std::vector<float>& gains) {
+	const int detailLevels = std::min(static_cast<int>(gains.size()), getLevelCount() - 1);
+	for (int k = 0; k < detailLevels; ++k) {
+		const float gain = gains[k];
+		float * values = levels[k].data.data();
+		parallelValues(levels[k].data.size(), [=](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				values[i] *= gain;
+			}
+		});
+	}
+}
+
+bool LaplacianPyramid::blend(const LaplacianPyramid& a, const LaplacianPyramid& b, const std::vector<PyramidImage>& maskPyramid) {
+	const int count = a.getLevelCount();
+	if (count == 0 || count != b.getLevelCount() || static_cast<int>(maskPyramid.size()) < count) {
+		return false;
+	}
+	for (int k = 0; k < count; ++k) {
+		const PyramidImage& la = a.levels[k];
+		const PyramidImage& lb = b.levels[k];
+		const PyramidImage& mask = maskPyramid[k];
+		if (la.width != lb.width || la.height != lb.height || la.channels != lb.channels ||
+			mask.width != la.width || mask.height != la.height || mask.channels != 1) {
+			return false;
+		}
+	}
+	std::vector<PyramidImage> blended(count);
+	for (int k = 0; k < count; ++k) {
+		const PyramidImage& la = a.levels[k];
+		const int channels = la.channels;
+		blended[k].resize(la.width, la.height, channels);
+		const float * va = la.data.data();
+		const float * vb = b.levels[k].data.data();
+		const float * weights = maskPyramid[k].data.data();
+		float * out = blended[k].data.data();
+		const size_t pixels = static_cast<size_t>(la.width) * la.height;
+		parallelValues(pixels, [=](size_t begin, size_t end) {
+			for (size_t p = begin; p < end; ++p) {
+				const float m = weights[p];
+				for (int c = 0; c < channels; ++c) {
+					const size_t i = p * channels + c;
+					out[i] = vb[i] + m * (va[i] - vb[i]);
+				}
+			}
+		});
+	}
+	levels = std::move(blended);
+	return true;
+}
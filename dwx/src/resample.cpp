@@ -0,0 +1,880 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "resample.h"
+#include "constants.h"
+#include "parallel.h"
+#include "progress.h"
+
+namespace {
+
+const int FixedShift = 32; //!< the fractional bits of the source coordinates
+const int64 FixedOne = static_cast<int64>(1) << FixedShift;
+const int PhaseBits = 8; //!< the fractional bits of the interpolation weights
+const int PhaseCount = 1 << PhaseBits;
+const int CubicWeightBits = 12;
+const int CubicRowShift = 4; //!< drops bits after the horizontal pass of the bicubic filter, so the vertical one fits in 32 bits
+const int RowBlockSize = 32;
+const int TileWidth = 256;
+const int TransposeBlockSize = 32;
+const int ShearMargin = 4; //!< the blank pixels around the intermediate images of the shears, more than the taps of any filter
+const int ScaleWeightBits = 14;
+const int ScaleIntermediateBits = 6; //!< the fractional bits of the horizontal pass, so the overshoot of the filters still fits in 16 bits
+const int ScaleBlockRows = 32;
+
+static_assert(sizeof(Color) == 3, "the rows are resampled as flat arrays of channels");
+
+inline int fixedFloor(int64 c) noexcept {
+	return static_cast<int>(c >> FixedShift);
+}
+
+inline int fixedPhase(int64 c) noexcept {
+	return static_cast<int>((c >> (FixedShift - PhaseBits)) & (PhaseCount - 1));
+}
+
+// the Catmull-Rom weights of cubicInterpolate for all phases, scaled to sum exactly to 1 << CubicWeightBits
+struct CubicWeights {
+	int32 w[PhaseCount][4];
+
+	CubicWeights() {
+		const double scale = 1 << CubicWeightBits;
+		for (int i = 0; i < PhaseCount; ++i) {
+			const double x = static_cast<double>(i) / PhaseCount;
+			const double x2 = x * x;
+			const double x3 = x2 * x;
+			w[i][0] = static_cast<int32>(std::lround(0.5 * (-x + 2.0 * x2 - x3) * scale));
+			w[i][2] = static_cast<int32>(std::lround(0.5 * (x + 4.0 * x2 - 3.0 * x3) * scale));
+			w[i][3] = static_cast<int32>(std::lround(0.5 * (x3 - x2) * scale));
+			w[i][1] = (1 << CubicWeightBits) - w[i][0] - w[i][2] - w[i][3];
+		}
+	}
+};
+
+const CubicWeights& getCubicWeights() {
+	static const CubicWeights weights;
+	return weights;
+}
+
+// narrows [x0, x1) to the pixels of the row with lo <= start + x * step < hi, which is a single span since the coordinate is linear
+void clipSpan(int64 start, int64 step, int64 lo, int64 hi, int& x0, int& x1) {
+	auto inside = [=](int x) {
+		const int64 c = start + x * step;
+		return lo <= c && c < hi;
+	};
+	if (step != 0) {
+		// the estimate is widened, so it only has to be shrunk to the exact span
+		const double a = static_cast<double>(lo - start) / static_cast<double>(step);
+		const double b = static_cast<double>(hi - start) / static_cast<double>(step);
+		const double first = std::floor(std::min(a, b)) - 1.0;
+		const double last = std::ceil(std::max(a, b)) + 1.0;
+		x0 = static_cast<int>(std::max(static_cast<double>(x0), std::min(first, static_cast<double>(x1))));
+		x1 = static_cast<int>(std::min(static_cast<double>(x1), std::max(last, static_cast<double>(x0))));
+	}
+	while (x0 < x1 && !inside(x0)) {
+		++x0;
+	}
+	while (x1 > x0 && !inside(x1 - 1)) {
+		--x1;
+	}
+}
+
+// the pixel at the source coordinates in fixed point, all taps have to be inside the source
+inline void bilinearPixel(const Color * src, int srcWidth, int64 fx, int64 fy, Color& out) noexcept {
+	const Color * p = src + static_cast<int64>(fixedFloor(fy)) * srcWidth + fixedFloor(fx);
+	const uint32 u = fixedPhase(fx);
+	const uint32 v = fixedPhase(fy);
+	const uint32 iu = PhaseCount - u;
+	const uint32 iv = PhaseCount - v;
+	for (int c = 0; c < 3; ++c) {
+		// both rows fit in 16 bits
+		const uint32 top = p[0][c] * iu + p[1][c] * u;
+		const uint32 bottom = p[srcWidth][c] * iu + p[srcWidth + 1][c] * u;
+		out[c] = static_cast<uint8>((top * iv + bottom * v + (1 << (2 * PhaseBits - 1))) >> (2 * PhaseBits));
+	}
+}
+
+inline void bicubicPixel(const Color * src, int srcWidth, int64 fx, int64 fy, Color& out) noexcept {
+	const CubicWeights& weights = getCubicWeights();
+	const int finalShift = 2 * CubicWeightBits - CubicRowShift;
+	const Color * p = src + static_cast<int64>(fixedFloor(fy) - 1) * srcWidth + fixedFloor(fx) - 1;
+	const int32 * wx = weights.w[fixedPhase(fx)];
+	const int32 * wy = weights.w[fixedPhase(fy)];
+	for (int c = 0; c < 3; ++c) {
+		int32 sum = 0;
+		for (int k = 0; k < 4; ++k) {
+			const Color * row = p + k * srcWidth;
+			const int32 h = row[0][c] * wx[0] + row[1][c] * wx[1] + row[2][c] * wx[2] + row[3][c] * wx[3];
+			sum += ((h + (1 << (CubicRowShift - 1))) >> CubicRowShift) * wy[k];
+		}
+		out[c] = static_cast<uint8>(clamp((sum + (1 << (finalShift - 1))) >> finalShift, 0, 255));
+	}
+}
+
+void bilinearSpan(const Color * src, int srcWidth, Color * out, int count, int64 fx, int64 fy, int64 dx, int64 dy) {
+	for (int i = 0; i < count; ++i, fx += dx, fy += dy) {
+		bilinearPixel(src, srcWidth, fx, fy, out[i]);
+	}
+}
+
+void bicubicSpan(const Color * src, int srcWidth, Color * out, int count, int64 fx, int64 fy, int64 dx, int64 dy) {
+	for (int i = 0; i < count; ++i, fx += dx, fy += dy) {
+		bicubicPixel(src, srcWidth, fx, fy, out[i]);
+	}
+}
+
+// copies count pixels with the given stride of the input to consecutive pixels of the output
+// the pointers are passed by value, so the compiler does not reload them after every stored byte
+void copyColumn(const Color * in, int64 stride, Color * out, int count) {
+	for (int i = 0; i < count; ++i) {
+		out[i] = in[i * stride];
+	}
+}
+
+// copies a block of the input to its transposed place in the output, both pointers are at the top left corners
+void transposeBlock(const Color * in, int64 inStride, Color * out, int64 outStride, int blockWidth, int blockHeight) {
+	for (int i = 0; i < blockWidth; ++i) {
+		Color * outRow = out + i * outStride;
+		const Color * inColumn = in + i;
+		for (int j = 0; j < blockHeight; ++j) {
+			outRow[j] = inColumn[j * inStride];
+		}
+	}
+}
+
+// resamples the row at x + shift for every output pixel x, as the filtered getters of the pixelmap do - the output pixels
+// sampled outside of the input row are blank and the taps of the others beyond the row are replaced by the tap of the sample point
+// the shift is the same for the whole row, so are the weights, and the interior is processed as a flat array of channels
+void shiftRow(const Color * src, int srcWidth, Color * dst, int dstWidth, double shift, ResampleFilter filter) {
+	const int64 fixedShift = std::llround(shift * PhaseCount);
+	const int k = static_cast<int>(fixedShift >> PhaseBits);
+	const int phase = static_cast<int>(fixedShift & (PhaseCount - 1));
+	const bool bicubic = (filter == RF_BICUBIC);
+	const int tapCount = (bicubic ? 4 : 2);
+	const int tapsBefore = (bicubic ? 1 : 0);
+	const int weightBits = (bicubic ? CubicWeightBits : PhaseBits);
+	int32 w[4] = { PhaseCount - phase, phase, 0, 0 };
+	if (bicubic) {
+		std::copy(getCubicWeights().w[phase], getCubicWeights().w[phase] + 4, w);
+	}
+	// the output pixels with all taps inside the input
+	const int x0 = clamp(tapsBefore - k, 0, dstWidth);
+	const int x1 = clamp(srcWidth - tapCount + tapsBefore + 1 - k, x0, dstWidth);
+	auto edgePixel = [&](int x) {
+		for (int c = 0; c < 3; ++c) {
+			int32 sum = 0;
+			for (int t = 0; t < tapCount; ++t) {
+				const int i = x + k - tapsBefore + t;
+				sum += src[(i >= 0 && i < srcWidth ? i : x + k)][c] * w[t];
+			}
+			dst[x][c] = static_cast<uint8>(clamp((sum + (1 << (weightBits - 1))) >> weightBits, 0, 255));
+		}
+	};
+	// the output pixels sampled outside of the input are blank
+	const int blank0 = clamp(-k, 0, x0);
+	const int blank1 = clamp(srcWidth - k, x1, dstWidth);
+	std::fill(dst, dst + blank0, Color());
+	for (int x = blank0; x < x0; ++x) {
+		edgePixel(x);
+	}
+	const uint8 * in = reinterpret_cast<const uint8 *>(src + x0 + k - tapsBefore);
+	uint8 * out = reinterpret_cast<uint8 *>(dst + x0);
+	const int count = (x1 - x0) * 3;
+	if (bicubic) {
+		const int32 w0 = w[0];
+		const int32 w1 = w[1];
+		const int32 w2 = w[2];
+		const int32 w3 = w[3];
+		for (int i = 0; i < count; ++i) {
+			const int32 v = (in[i] * w0 + in[i + 3] * w1 + in[i + 6] * w2 + in[i + 9] * w3 + (1 << (CubicWeightBits - 1))) >> CubicWeightBits;
+			out[i] = static_cast<uint8>(v < 0 ? 0 : (v > 255 ? 255 : v));
+		}
+	} else {
+		const uint16 w0 = static_cast<uint16>(w[0]);
+		const uint16 w1 = static_cast<uint16>(w[1]);
+		for (int i = 0; i < count; ++i) {
+			// fits in 16 bits
+			out[i] = static_cast<uint8>(static_cast<uint16>(in[i] * w0 + in[i + 3] * w1 + (1 << (PhaseBits - 1))) >> PhaseBits);
+		}
+	}
+	for (int x = x1; x < blank1; ++x) {
+		edgePixel(x);
+	}
+	std::fill(dst + blank1, dst + dstWidth, Color());
+}
+
+// resamples every row of the source to the same row of the destination (the heights must match), the destination pixel
+// with relative coordinates (x, y) takes the source row at relative x + shear * y + offset
+// the coordinates are relative to the centers, with the pixel i of a row of width w at i - w / 2 + 0.5
+bool shearRows(const Bitmap& src, Bitmap& dst, double shear, double offset, ResampleFilter filter, ProgressCallback * cb, int stage, int stageCount) {
+	const int sw = src.getWidth();
+	const int dw = dst.getWidth();
+	const int h = dst.getHeight();
+	const Color * srcData = src.getDataPtr();
+	Color * dstData = dst.getDataPtr();
+	const double baseShift = (-(dw / 2) + 0.5) + offset + (sw / 2) - 0.5;
+	const int blockCount = (h + RowBlockSize - 1) / RowBlockSize;
+	std::atomic<int> blocksDone(0);
+	parallelFor(blockCount, [&](int block, int) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int yEnd = std::min(h, (block + 1) * RowBlockSize);
+		for (int y = block * RowBlockSize; y < yEnd; ++y) {
+			const double shift = baseShift + shear * (y - h / 2 + 0.5);
+			shiftRow(srcData + static_cast<int64>(y) * sw, sw, dstData + static_cast<int64>(y) * dw, dw, shift, filter);
+		}
+		if (cb) {
+			cb->setPercentDone(static_cast<int64>(stage) * blockCount + (++blocksDone), static_cast<int64>(stageCount) * blockCount);
+		}
+	});
+	return !(cb && cb->getAbortFlag());
+}
+
+// the same as shearRows for the columns (the widths must match), the destination pixel with relative coordinates (x, y)
+// takes the source column at relative y + shear * x + offset
+// strips of columns are transposed to rows of a buffer of the worker, shifted there and transposed back to the destination,
+// so the 1D kernel still runs over contiguous memory and the whole image is never transposed
+bool shearColumns(const Bitmap& src, Bitmap& dst, double shear, double offset, ResampleFilter filter, ProgressCallback * cb, int stage, int stageCount) {
+	const int w = dst.getWidth();
+	const int sh = src.getHeight();
+	const int dh = dst.getHeight();
+	const Color * srcData = src.getDataPtr();
+	Color * dstData = dst.getDataPtr();
+	const double baseShift = (-(dh / 2) + 0.5) + offset + (sh / 2) - 0.5;
+	const int stripCount = (w + TransposeBlockSize - 1) / TransposeBlockSize;
+	const int workerCount = getWorkerCount();
+	std::vector<std::vector<Color> > buffers(workerCount);
+	std::atomic<int> stripsDone(0);
+	parallelFor(stripCount, [&](int strip, int worker) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int x = strip * TransposeBlockSize;
+		const int stripWidth = std::min(w - x, TransposeBlockSize);
+		std::vector<Color>& buffer = buffers[worker];
+		buffer.resize(static_cast<size_t>(TransposeBlockSize) * (sh + dh));
+		Color * columns = buffer.data();
+		Color * sheared = columns + static_cast<int64>(TransposeBlockSize) * sh;
+		for (int y = 0; y < sh; y += TransposeBlockSize) {
+			transposeBlock(srcData + static_cast<int64>(y) * w + x, w, columns + y, sh, stripWidth, std::min(sh - y, TransposeBlockSize));
+		}
+		for (int i = 0; i < stripWidth; ++i) {
+			const double shift = baseShift + shear * (x + i - w / 2 + 0.5);
+			shiftRow(columns + static_cast<int64>(i) * sh, sh, sheared + static_cast<int64>(i) * dh, dh, shift, filter);
+		}
+		for (int y = 0; y < dh; y += TransposeBlockSize) {
+			transposeBlock(sheared + y, dh, dstData + static_cast<int64>(y) * w + x, w, std::min(dh - y, TransposeBlockSize), stripWidth);
+		}
+		if (cb) {
+			cb->setPercentDone(static_cast<int64>(stage) * stripCount + (++stripsDone), static_cast<int64>(stageCount) * stripCount);
+		}
+	}, workerCount);
+	return !(cb && cb->getAbortFlag());
+}
+
+// the output sampled at X(p1) * Y(q) * X(p2) * r + offset of the input, with r and the result relative to the centers as in shearRows
+bool shearPasses(const Bitmap& input, Bitmap& output, double p1, double q, double p2, double offsetX, double offsetY, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb) {
+	const int obw = output.getWidth();
+	const int obh = output.getHeight();
+	if (!input.isOK() || !output.isOK()) {
+		return false;
+	}
+	const Bitmap * source = &input;
+	Bitmap expanded;
+	if (EFT_BLANK != edge) {
+		// expand the input over the footprint of the output with a margin for the taps of all passes
+		const double m00 = 1.0 + p1 * q;
+		const double m01 = p2 * (1.0 + p1 * q) + p1;
+		const double m10 = q;
+		const double m11 = 1.0 + q * p2;
+		const double rx = obw / 2 + ShearMargin;
+		const double ry = obh / 2 + ShearMargin;
+		const double extentX = std::fabs(m00) * rx + std::fabs(m01) * ry + std::fabs(offsetX);
+		const double extentY = std::fabs(m10) * rx + std::fabs(m11) * ry + std::fabs(offsetY);
+		const int padX = std::max(0, static_cast<int>(std::ceil(extentX - input.getWidth() / 2)) + 2 * ShearMargin);
+		const int padY = std::max(0, static_cast<int>(std::ceil(extentY - input.getHeight() / 2)) + 2 * ShearMargin);
+		if (padX > 0 || padY > 0) {
+			input.expand(expanded, 2 * padX, 2 * padY, padX, padY, edge);
+			source = &expanded;
+		}
+	}
+	const int stageCount = 3;
+	// the intermediate images keep the rows of the previous pass and are wide enough for all columns read by the next one
+	const int shearedWidth = obw + static_cast<int>(std::ceil(std::fabs(p2) * obh)) + 2 * ShearMargin;
+	Bitmap rows;
+	rows.generateEmptyImage(shearedWidth, source->getHeight(), false);
+	if (!shearRows(*source, rows, p1, offsetX - p1 * offsetY, filter, cb, 0, stageCount)) {
+		return false;
+	}
+	expanded.freeMem();
+	Bitmap sheared;
+	sheared.generateEmptyImage(shearedWidth, obh, false);
+	if (!shearColumns(rows, sheared, q, offsetY, filter, cb, 1, stageCount)) {
+		return false;
+	}
+	rows.freeMem();
+	return shearRows(sheared, output, p2, 0.0, filter, cb, 2, stageCount);
+}
+
+// the value of the scaling filter at a distance in pixels of its own scale
+double scaleKernel(ScaleFilter filter, double x) {
+	x = std::fabs(x);
+	switch (filter) {
+	case SF_BOX:
+		return (x < 0.5 ? 1.0 : (x == 0.5 ? 0.5 : 0.0));
+	case SF_TRIANGLE:
+		return std::max(1.0 - x, 0.0);
+	case SF_MITCHELL: {
+		// B = C = 1 / 3
+		const double x2 = x * x;
+		const double x3 = x2 * x;
+		if (x < 1.0) {
+			return (7.0 * x3 - 12.0 * x2 + 16.0 / 3.0) / 6.0;
+		} else if (x < 2.0) {
+			return (-7.0 / 3.0 * x3 + 12.0 * x2 - 20.0 * x + 32.0 / 3.0) / 6.0;
+		}
+		return 0.0;
+	}
+	case SF_LANCZOS3: {
+		if (x < 1e-9) {
+			return 1.0;
+		} else if (x >= 3.0) {
+			return 0.0;
+		}
+		const double px = PI * x;
+		return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+	}
+	}
+	return 0.0;
+}
+
+double scaleKernelRadius(ScaleFilter filter) {
+	switch (filter) {
+	case SF_BOX:
+		return 0.5;
+	case SF_TRIANGLE:
+		return 1.0;
+	case SF_MITCHELL:
+		return 2.0;
+	case SF_LANCZOS3:
+		return 3.0;
+	}
+	return 1.0;
+}
+
+// the polyphase weights of resampling a line of pixels with the given input pixels per output pixel - every output pixel
+// reads taps consecutive pixels of the input from its start; the taps beyond the input are folded in the edge pixels
+struct ScaleWeights {
+	int taps;
+	std::vector<int> start;
+	std::vector<int16> weights; //!< taps for each output pixel, with a sum of exactly 1 << ScaleWeightBits
+
+	ScaleWeights(int srcLength, int dstLength, double scale, ScaleFilter filter)
+		: taps(1)
+		, start(dstLength)
+	{
+		if (srcLength == dstLength && 1.0 == scale) {
+			// the axis is not scaled
+			weights.assign(dstLength, static_cast<int16>(1 << ScaleWeightBits));
+			for (int i = 0; i < dstLength; ++i) {
+				start[i] = i;
+			}
+			return;
+		}
+		// the filter is stretched over the input when downscaling, so it also averages the dropped frequencies
+		const double filterScale = std::max(scale, 1.0);
+		const double support = scaleKernelRadius(filter) * filterScale;
+		taps = std::min(srcLength, static_cast<int>(std::ceil(2.0 * support)) + 1);
+		weights.assign(static_cast<size_t>(dstLength) * taps, 0);
+		std::vector<double> tapWeights(taps);
+		for (int i = 0; i < dstLength; ++i) {
+			// the center of the output pixel in the continuous coordinates of the input
+			const double center = (i + 0.5) * scale;
+			const int first = static_cast<int>(std::floor(center - support));
+			start[i] = clamp(first, 0, srcLength - taps);
+			std::fill(tapWeights.begin(), tapWeights.end(), 0.0);
+			double sum = 0.0;
+			for (int j = first; j <= first + taps; ++j) {
+				const double w = scaleKernel(filter, (j + 0.5 - center) / filterScale);
+				if (w != 0.0) {
+					const int k = clamp(j, 0, srcLength - 1) - start[i];
+					if (k >= 0 && k < taps) {
+						tapWeights[k] += w;
+						sum += w;
+					}
+				}
+			}
+			int16 * iw = &weights[static_cast<size_t>(i) * taps];
+			if (!(std::fabs(sum) > 1e-9)) {
+				iw[clamp(static_cast<int>(center) - start[i], 0, taps - 1)] = static_cast<int16>(1 << ScaleWeightBits);
+				continue;
+			}
+			// the rounding error is added to the largest weight, so the flat areas stay exact
+			int total = 0;
+			int largest = 0;
+			for (int k = 0; k < taps; ++k) {
+				iw[k] = static_cast<int16>(std::lround(tapWeights[k] / sum * (1 << ScaleWeightBits)));
+				total += iw[k];
+				if (iw[k] > iw[largest]) {
+					largest = k;
+				}
+			}
+			iw[largest] += static_cast<int16>((1 << ScaleWeightBits) - total);
+		}
+	}
+};
+
+// the horizontal pass of a row to the intermediate values with ScaleIntermediateBits of fraction
+void scaleRow(const uint8 * src, int16 * dst, int dstWidth, const int * start, const int16 * weights, int taps) {
+	const int shift = ScaleWeightBits - ScaleIntermediateBits;
+	const int32 rounding = 1 << (shift - 1);
+	for (int x = 0; x < dstWidth; ++x, weights += taps) {
+		const uint8 * p = src + start[x] * 3;
+		int32 s0 = rounding;
+		int32 s1 = rounding;
+		int32 s2 = rounding;
+		for (int k = 0; k < taps; ++k, p += 3) {
+			s0 += p[0] * weights[k];
+			s1 += p[1] * weights[k];
+			s2 += p[2] * weights[k];
+		}
+		dst[3 * x + 0] = static_cast<int16>(s0 >> shift);
+		dst[3 * x + 1] = static_cast<int16>(s1 >> shift);
+		dst[3 * x + 2] = static_cast<int16>(s2 >> shift);
+	}
+}
+
+// adds a weighted intermediate row to the accumulators of an output row
+void accumulateRow(const int16 * src, int32 * acc, int count, int32 weight) {
+	for (int i = 0; i < count; ++i) {
+		acc[i] += src[i] * weight;
+	}
+}
+
+void storeRow(const int32 * acc, uint8 * dst, int count) {
+	const int shift = ScaleWeightBits + ScaleIntermediateBits;
+	for (int i = 0; i < count; ++i) {
+		dst[i] = static_cast<uint8>(clamp(acc[i] >> shift, 0, 255));
+	}
+}
+
+} // namespace
+
+bool resampleAffine(const Bitmap& input, Bitmap& output, const Matrix2& inverse, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb) {
+	const int bw = input.getWidth();
+	const int bh = input.getHeight();
+	const int obw = output.getWidth();
+	const int obh = output.getHeight();
+	if (!input.isOK() || !output.isOK() || bw <= 0 || bh <= 0) {
+		return false;
+	}
+	const Color * src = input.getDataPtr();
+	Color * dst = output.getDataPtr();
+	const double cx = bw / 2;
+	const double cy = bh / 2;
+	const double ocx = obw / 2;
+	const double ocy = obh / 2;
+	const double m00 = inverse.m[0][0];
+	const double m01 = inverse.m[0][1];
+	const double m10 = inverse.m[1][0];
+	const double m11 = inverse.m[1][1];
+	const int64 dx = std::llround(m00 * FixedOne);
+	const int64 dy = std::llround(m10 * FixedOne);
+	// the coordinates with all taps of the filter inside the input
+	const int tapsBefore = (filter == RF_BICUBIC ? 1 : 0);
+	const int tapsAfter = (filter == RF_BICUBIC ? 2 : 1);
+	const int64 loX = tapsBefore * FixedOne;
+	const int64 loY = tapsBefore * FixedOne;
+	const int64 hiX = static_cast<int64>(bw - tapsAfter) * FixedOne;
+	const int64 hiY = static_cast<int64>(bh - tapsAfter) * FixedOne;
+	auto getFiltered = [&](int64 fx, int64 fy) {
+		const float x = static_cast<float>(static_cast<double>(fx) / FixedOne);
+		const float y = static_cast<float>(static_cast<double>(fy) / FixedOne);
+		return (filter == RF_BICUBIC ?
+			input.getBicubicFilteredPixel<TColor<double> >(x, y, edge) :
+			input.getBilinearFilteredPixel<TColor<double> >(x, y, edge));
+	};
+	// the spans of a row, in order: blank, filtered with edge handling, interior, filtered with edge handling, blank
+	struct RowSpans {
+		int64 fx;
+		int64 fy;
+		int valid0;
+		int interior0;
+		int interior1;
+		int valid1;
+	};
+	auto processRange = [&](const RowSpans& row, Color * out, int x0, int x1) {
+		if (x0 < row.valid0) {
+			std::fill(out + x0, out + std::min(x1, row.valid0), Color());
+		}
+		for (int x = std::max(x0, row.valid0); x < std::min(x1, row.interior0); ++x) {
+			out[x] = getFiltered(row.fx + x * dx, row.fy + x * dy);
+		}
+		const int i0 = std::max(x0, row.interior0);
+		const int i1 = std::min(x1, row.interior1);
+		if (i0 < i1) {
+			const int64 sx = row.fx + i0 * dx;
+			const int64 sy = row.fy + i0 * dy;
+			if (filter == RF_BICUBIC) {
+				bicubicSpan(src, bw, out + i0, i1 - i0, sx, sy, dx, dy);
+			} else {
+				bilinearSpan(src, bw, out + i0, i1 - i0, sx, sy, dx, dy);
+			}
+		}
+		for (int x = std::max(x0, row.interior1); x < std::min(x1, row.valid1); ++x) {
+			out[x] = getFiltered(row.fx + x * dx, row.fy + x * dy);
+		}
+		if (row.valid1 < x1) {
+			std::fill(out + std::max(x0, row.valid1), out + x1, Color());
+		}
+	};
+	const int blockCount = (obh + RowBlockSize - 1) / RowBlockSize;
+	std::atomic<int> blocksDone(0);
+	parallelFor(blockCount, [&](int block, int) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int yBegin = block * RowBlockSize;
+		const int yEnd = std::min(obh, yBegin + RowBlockSize);
+		RowSpans rows[RowBlockSize];
+		for (int y = yBegin; y < yEnd; ++y) {
+			RowSpans& row = rows[y - yBegin];
+			const double rx = -ocx + 0.5;
+			const double ry = y - ocy + 0.5;
+			row.fx = std::llround((m00 * rx + m01 * ry + cx) * FixedOne);
+			row.fy = std::llround((m10 * rx + m11 * ry + cy) * FixedOne);
+			// with blank edges the pixels mapped outside of the input are known to be blank
+			row.valid0 = 0;
+			row.valid1 = obw;
+			if (EFT_BLANK == edge) {
+				clipSpan(row.fx, dx, 0, static_cast<int64>(bw) * FixedOne, row.valid0, row.valid1);
+				clipSpan(row.fy, dy, 0, static_cast<int64>(bh) * FixedOne, row.valid0, row.valid1);
+			}
+			row.interior0 = row.valid0;
+			row.interior1 = row.valid1;
+			clipSpan(row.fx, dx, loX, hiX, row.interior0, row.interior1);
+			clipSpan(row.fy, dy, loY, hiY, row.interior0, row.interior1);
+			if (row.interior0 >= row.interior1) {
+				row.interior0 = row.interior1 = row.valid1;
+			}
+		}
+		// the block is traversed in tiles of columns, so the source lines read by a rotated row are still cached for the next one
+		for (int x0 = 0; x0 < obw; x0 += TileWidth) {
+			const int x1 = std::min(obw, x0 + TileWidth);
+			for (int y = yBegin; y < yEnd; ++y) {
+				processRange(rows[y - yBegin], dst + static_cast<int64>(y) * obw, x0, x1);
+			}
+		}
+		if (cb) {
+			cb->setPercentDone(++blocksDone, blockCount);
+		}
+	});
+	return !(cb && cb->getAbortFlag());
+}
+
+void rotateRightAngle(const Bitmap& input, Bitmap& output, int rightTurns) {
+	rightTurns %= 4;
+	if (rightTurns < 0) {
+		rightTurns += 4;
+	}
+	if (rightTurns == 0) {
+		// identity
+		output = input;
+		return;
+	} else if (rightTurns == 2) {
+		// easiest change is to mirror the image accross both axis
+		input.mirror(output, PA_BOTH);
+		return;
+	}
+	// else some pixels need reordering - the output rows are the input columns
+	const int bw = input.getWidth();
+	const int bh = input.getHeight();
+	output.generateEmptyImage(bh, bw, false);
+	const Color * bmpData = input.getDataPtr();
+	Color * bmpOutData = output.getDataPtr();
+	const int blockRows = (bw + TransposeBlockSize - 1) / TransposeBlockSize;
+	parallelFor(blockRows, [&](int block, int) {
+		const int yBegin = block * TransposeBlockSize;
+		const int yEnd = std::min(bw, yBegin + TransposeBlockSize);
+		for (int xBegin = 0; xBegin < bh; xBegin += TransposeBlockSize) {
+			const int count = std::min(bh - xBegin, TransposeBlockSize);
+			for (int y = yBegin; y < yEnd; ++y) {
+				// the output row is an input column, read downwards for a right turn and upwards for a left one
+				if (rightTurns == 1) {
+					copyColumn(bmpData + static_cast<int64>(xBegin) * bw + (bw - 1 - y), bw, bmpOutData + static_cast<int64>(y) * bh + xBegin, count);
+				} else {
+					copyColumn(bmpData + static_cast<int64>(bh - 1 - xBegin) * bw + y, -bw, bmpOutData + static_cast<int64>(y) * bh + xBegin, count);
+				}
+			}
+		}
+	});
+}
+
+void transposeBitmap(const Bitmap& input, Bitmap& output) {
+	const int bw = input.getWidth();
+	const int bh = input.getHeight();
+	output.generateEmptyImage(bh, bw, false);
+	const Color * in = input.getDataPtr();
+	Color * out = output.getDataPtr();
+	const int blockColumns = (bw + TransposeBlockSize - 1) / TransposeBlockSize;
+	parallelFor(blockColumns, [&](int block, int) {
+		const int x = block * TransposeBlockSize;
+		const int blockWidth = std::min(bw - x, TransposeBlockSize);
+		for (int y = 0; y < bh; y += TransposeBlockSize) {
+			transposeBlock(in + static_cast<int64>(y) * bw + x, bw, out + static_cast<int64>(x) * bh + y, bh, blockWidth, std::min(bh - y, TransposeBlockSize));
+		}
+	});
+}
+
+bool resampleShears(const Bitmap& input, Bitmap& output, float firstRowShear, float columnShear, float secondRowShear, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb) {
+	// resampleAffine samples the pixel (x, y) of the input at (x, y) instead of its center, which is half a pixel of offset
+	return shearPasses(input, output, firstRowShear, columnShear, secondRowShear, 0.5, 0.5, filter, edge, cb);
+}
+
+bool rotateShears(const Bitmap& input, Bitmap& output, float angle, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb) {
+	if (!input.isOK()) {
+		return false;
+	}
+	const int turns = static_cast<int>(std::lround(angle / (PI / 2.0)));
+	const double residual = angle - turns * (PI / 2.0);
+	const int rightTurns = ((turns % 4) + 4) % 4;
+	// the input index of a pixel of the turned image is turnMatrices[rightTurns] * index + b
+	static const int turnMatrices[4][2][2] = {
+		{ {  1,  0 }, {  0,  1 } },
+		{ {  0, -1 }, {  1,  0 } },
+		{ { -1,  0 }, {  0, -1 } },
+		{ {  0,  1 }, { -1,  0 } },
+	};
+	const int (&a)[2][2] = turnMatrices[rightTurns];
+	const int bw = input.getWidth();
+	const int bh = input.getHeight();
+	const int b[2] = {
+		(rightTurns == 1 || rightTurns == 2 ? bw - 1 : 0),
+		(rightTurns >= 2 ? bh - 1 : 0),
+	};
+	const Bitmap * source = &input;
+	Bitmap turned;
+	if (rightTurns != 0) {
+		rotateRightAngle(input, turned, rightTurns);
+		source = &turned;
+	}
+	// the same mapping in coordinates relative to the centers has an offset, which is moved to the turned image
+	const double turnedCenter[2] = { source->getWidth() / 2 - 0.5, source->getHeight() / 2 - 0.5 };
+	const double inputCenter[2] = { bw / 2 - 0.5, bh / 2 - 0.5 };
+	double remaining[2];
+	for (int i = 0; i < 2; ++i) {
+		const double turnOffset = a[i][0] * turnedCenter[0] + a[i][1] * turnedCenter[1] + b[i] - inputCenter[i];
+		remaining[i] = 0.5 - turnOffset;
+	}
+	// a is orthogonal, so its inverse is the transposed one
+	const double offsetX = a[0][0] * remaining[0] + a[1][0] * remaining[1];
+	const double offsetY = a[0][1] * remaining[0] + a[1][1] * remaining[1];
+	const double shear = -std::tan(residual / 2.0);
+	return shearPasses(*source, output, shear, std::sin(residual), shear, offsetX, offsetY, filter, edge, cb);
+}
+
+// the constants are passed by reference to std::min, so they need a definition before c++17
+constexpr int RemapTable::TileSize;
+constexpr int RemapTable::FractionBits;
+
+RemapTable::RemapTable(const Homography& inverse, int _width, int _height)
+	: width(std::max(_width, 0))
+	, height(std::max(_height, 0))
+	, tilesX((width + TileSize - 1) / TileSize)
+	, tilesY((height + TileSize - 1) / TileSize)
+	, entries(static_cast<size_t>(width) * height)
+	, bounds(static_cast<size_t>(tilesX) * tilesY)
+{
+	// the matrix is defined up to a factor, so its sign is chosen to put the center of the output in front of the projection
+	Homography h = inverse;
+	const double centerW = h.m[2][0] * width * 0.5 + h.m[2][1] * height * 0.5 + h.m[2][2];
+	if (centerW < 0.0) {
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j) {
+				h.m[i][j] = -h.m[i][j];
+			}
+		}
+	}
+	// within the range of the fixed point with a margin for the taps of the filters
+	const double limit = static_cast<double>((1 << (31 - FractionBits)) - 16);
+	const double scale = static_cast<double>(1 << FractionBits);
+	parallelFor(tilesX * tilesY, [&](int tile, int) {
+		const int tx = tile % tilesX;
+		const int ty = tile / tilesX;
+		const int x0 = tx * TileSize;
+		const int y0 = ty * TileSize;
+		const int tileWidth = std::min(TileSize, width - x0);
+		const int tileHeight = std::min(TileSize, height - y0);
+		Entry * e = entries.data() + tileOffset(tx, ty);
+		TileBounds b = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN, false };
+		for (int y = 0; y < tileHeight; ++y) {
+			for (int x = 0; x < tileWidth; ++x, ++e) {
+				double sx, sy;
+				// the getters have the center of the pixel at its index
+				if (h.apply(x0 + x + 0.5, y0 + y + 0.5, sx, sy) && std::fabs(sx - 0.5) < limit && std::fabs(sy - 0.5) < limit) {
+					e->x = static_cast<int32>(std::lround((sx - 0.5) * scale));
+					e->y = static_cast<int32>(std::lround((sy - 0.5) * scale));
+					b.minX = std::min(b.minX, e->x);
+					b.minY = std::min(b.minY, e->y);
+					b.maxX = std::max(b.maxX, e->x);
+					b.maxY = std::max(b.maxY, e->y);
+				} else {
+					e->x = e->y = InvalidCoord;
+					b.hasInvalid = true;
+				}
+			}
+		}
+		bounds[tile] = b;
+	});
+}
+
+bool RemapTable::apply(const Bitmap& input, Bitmap& output, ResampleFilter filter, EdgeFillType edge, ProgressCallback * cb) const {
+	const int bw = input.getWidth();
+	const int bh = input.getHeight();
+	if (!input.isOK() || bw <= 0 || bh <= 0 || width <= 0 || height <= 0) {
+		return false;
+	}
+	if (output.getWidth() != width || output.getHeight() != height) {
+		output.generateEmptyImage(width, height, false);
+	}
+	const Color * src = input.getDataPtr();
+	Color * dst = output.getDataPtr();
+	const int fixedScale = 1 << (FixedShift - FractionBits);
+	// the coordinates with all taps of the filter inside the input
+	const int tapsBefore = (filter == RF_BICUBIC ? 1 : 0);
+	const int tapsAfter = (filter == RF_BICUBIC ? 2 : 1);
+	// an input too large for the fixed point is always sampled with the getters
+	const bool fixedInput = (bw < (1 << (31 - FractionBits)) && bh < (1 << (31 - FractionBits)));
+	const int32 loX = tapsBefore << FractionBits;
+	const int32 loY = tapsBefore << FractionBits;
+	const int32 hiX = (fixedInput ? (bw - tapsAfter) << FractionBits : 0);
+	const int32 hiY = (fixedInput ? (bh - tapsAfter) << FractionBits : 0);
+	auto isInterior = [&](int32 x, int32 y) {
+		return fixedInput && x >= loX && x < hiX && y >= loY && y < hiY;
+	};
+	auto samplePixel = [&](const Entry& e, Color& out) {
+		if (e.x == InvalidCoord) {
+			out = Color();
+		} else if (isInterior(e.x, e.y)) {
+			const int64 fx = static_cast<int64>(e.x) * fixedScale;
+			const int64 fy = static_cast<int64>(e.y) * fixedScale;
+			if (filter == RF_BICUBIC) {
+				bicubicPixel(src, bw, fx, fy, out);
+			} else {
+				bilinearPixel(src, bw, fx, fy, out);
+			}
+		} else {
+			const float x = static_cast<float>(e.x) / (1 << FractionBits);
+			const float y = static_cast<float>(e.y) / (1 << FractionBits);
+			out = (filter == RF_BICUBIC ?
+				input.getBicubicFilteredPixel<TColor<double> >(x, y, edge) :
+				input.getBilinearFilteredPixel<TColor<double> >(x, y, edge));
+		}
+	};
+	const int tileCount = tilesX * tilesY;
+	std::atomic<int> tilesDone(0);
+	parallelFor(tileCount, [&](int tile, int) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int tx = tile % tilesX;
+		const int ty = tile / tilesX;
+		const int x0 = tx * TileSize;
+		const int y0 = ty * TileSize;
+		const int tileWidth = std::min(TileSize, width - x0);
+		const int tileHeight = std::min(TileSize, height - y0);
+		const Entry * e = entries.data() + tileOffset(tx, ty);
+		const TileBounds& b = bounds[tile];
+		const bool interior = !b.hasInvalid && isInterior(b.minX, b.minY) && isInterior(b.maxX, b.maxY);
+		for (int y = 0; y < tileHeight; ++y, e += tileWidth) {
+			Color * out = dst + static_cast<int64>(y0 + y) * width + x0;
+			if (interior && filter == RF_BICUBIC) {
+				for (int x = 0; x < tileWidth; ++x) {
+					bicubicPixel(src, bw, static_cast<int64>(e[x].x) * fixedScale, static_cast<int64>(e[x].y) * fixedScale, out[x]);
+				}
+			} else if (interior) {
+				for (int x = 0; x < tileWidth; ++x) {
+					bilinearPixel(src, bw, static_cast<int64>(e[x].x) * fixedScale, static_cast<int64>(e[x].y) * fixedScale, out[x]);
+				}
+			} else {
+				for (int x = 0; x < tileWidth; ++x) {
+					samplePixel(e[x], out[x]);
+				}
+			}
+		}
+		if (cb) {
+			cb->setPercentDone(++tilesDone, tileCount);
+		}
+	});
+	return !(cb && cb->getAbortFlag());
+}
+
+bool resampleScale(const Bitmap& input, Bitmap& output, ScaleFilter filter, ProgressCallback * cb) {
+	if (!input.isOK() || !output.isOK() || output.getWidth() <= 0 || output.getHeight() <= 0) {
+		return false;
+	}
+	const double scaleX = input.getWidth() / static_cast<double>(output.getWidth());
+	const double scaleY = input.getHeight() / static_cast<double>(output.getHeight());
+	return resampleScale(input, output, scaleX, scaleY, filter, cb);
+}
+
+bool resampleScale(const Bitmap& input, Bitmap& output, double scaleX, double scaleY, ScaleFilter filter, ProgressCallback * cb) {
+	const int bw = input.getWidth();
+	const int bh = input.getHeight();
+	const int obw = output.getWidth();
+	const int obh = output.getHeight();
+	if (!input.isOK() || !output.isOK() || bw <= 0 || bh <= 0 || obw <= 0 || obh <= 0 || !(scaleX > 0.0) || !(scaleY > 0.0)) {
+		return false;
+	}
+	const ScaleWeights horizontal(bw, obw, scaleX, filter);
+	const ScaleWeights vertical(bh, obh, scaleY, filter);
+	const uint8 * src = reinterpret_cast<const uint8 *>(input.getDataPtr());
+	uint8 * dst = reinterpret_cast<uint8 *>(output.getDataPtr());
+	const int64 srcStride = static_cast<int64>(bw) * 3;
+	const int rowValues = obw * 3;
+	// every block of output rows scales horizontally only the input rows it reads, and then its columns are
+	// accumulated row by row over whole intermediate rows
+	const int blockCount = (obh + ScaleBlockRows - 1) / ScaleBlockRows;
+	int bandRows = 0;
+	for (int block = 0; block < blockCount; ++block) {
+		const int y0 = block * ScaleBlockRows;
+		const int y1 = std::min(obh, y0 + ScaleBlockRows) - 1;
+		bandRows = std::max(bandRows, vertical.start[y1] + vertical.taps - vertical.start[y0]);
+	}
+	const int workerCount = getWorkerCount();
+	std::vector<std::vector<int16> > bands(workerCount);
+	std::vector<std::vector<int32> > accumulators(workerCount);
+	std::atomic<int> blocksDone(0);
+	parallelFor(blockCount, [&](int block, int worker) {
+		if (cb && cb->getAbortFlag()) {
+			return;
+		}
+		const int y0 = block * ScaleBlockRows;
+		const int y1 = std::min(obh, y0 + ScaleBlockRows);
+		const int bandStart = vertical.start[y0];
+		const int bandEnd = vertical.start[y1 - 1] + vertical.taps;
+		std::vector<int16>& band = bands[worker];
+		band.resize(static_cast<size_t>(bandRows) * rowValues);
+		std::vector<int32>& acc = accumulators[worker];
+		acc.resize(rowValues);
+		for (int y = bandStart; y < bandEnd; ++y) {
+			scaleRow(src + y * srcStride, band.data() + static_cast<size_t>(y - bandStart) * rowValues, obw, horizontal.start.data(), horizontal.weights.data(), horizontal.taps);
+		}
+		for (int y = y0; y < y1; ++y) {
+			std::fill(acc.begin(), acc.end(), 1 << (ScaleWeightBits + ScaleIntermediateBits - 1));
+			const int16 * weights = &vertical.weights[static_cast<size_t>(y) * vertical.taps];
+			for (int k = 0; k < vertical.taps; ++k) {
+				if (weights[k] != 0) {
+					accumulateRow(band.data() + static_cast<size_t>(vertical.start[y] + k - bandStart) * rowValues, acc.data(), rowValues, weights[k]);
+				}
+			}
+			storeRow(acc.data(), dst + static_cast<int64>(y) * rowValues, rowValues);
+		}
+		if (cb) {
+			cb->setPercentDone(++blocksDone, blockCount);
+		}
+	}, workerCount);
+	return !(cb && cb->getAbortFlag());
+}
@@ -4,6 +4,7 @@
 #include "wx_bitmap_canvas.h"
 #include "util.h"
 #include "drect.h"
+#include "resample.h"
 
 /************************************
 *          ImageRescaler            *
@@ -15,6 +16,7 @@ ImageRescaler::~ImageRescaler() {
 
 void ImageRescaler::setBitmap(const wxBitmap & _bmp) {
 	clearCache();
+	source.freeMem();
 	bmp = _bmp;
 }
 
@@ -53,35 +55,24 @@ wxBitmap ImageRescaler::getDownscaledSubBitmap(int scale, const wxRect & subRect
 	if (it != downscaleCache.end()) {
 		fullBmp = it->second;
 	} else {
-		const int scaleSqr = scale * scale;
 		const wxSize scaledSize = bmp.GetSize() / scale;
-		const int unscaledWidth = bmp.GetWidth();
 		const int width = scaledSize.GetWidth();
 		const int height = scaledSize.GetHeight();
-		const int bpp = 3;
-		int accumulated[bpp] = { 0 };
-		const wxImage sourceImg = bmp.ConvertToImage();
-		wxImage scaledImg(scaledSize);
-		const unsigned char * srcData = sourceImg.GetData();
-		unsigned char * imgData = scaledImg.GetData();
-		for (int y = 0; y < height; ++y) {
-			for (int x = 0; x < width; ++x) {
-				memset(accumulated, 0, bpp * sizeof(accumulated[0]));
-				for (int s = 0; s < scaleSqr; ++s) {
-					const int row = s / scale;
-					const int column = s % scale;
-					accumulated[0] += srcData[((y * scale + row) * unscaledWidth) * bpp + (x * scale + column) * bpp + 0];
-					accumulated[1] += srcData[((y * scale + row) * unscaledWidth) * bpp + (x * scale + column) * bpp + 1];
-					accumulated[2] += srcData[((y * scale + row) * unscaledWidth) * bpp + (x * scale + column) * bpp + 2];
-				}
-				for (int i = 0; i < bpp; ++i) {
-					accumulated[i] /= scaleSqr;
-				}
-				imgData[(y * width + x) * bpp + 0] = static_cast<unsigned char>(accumulated[0]);
-				imgData[(y * width + x) * bpp + 1] = static_cast<unsigned char>(accumulated[1]);
-				imgData[(y * width + x) * bpp + 2] = static_cast<unsigned char>(accumulated[2]);
-			}
+		if (!source.isOK()) {
+			const wxImage sourceImg = bmp.ConvertToImage();
+			source = Bitmap(sourceImg.GetWidth(), sourceImg.GetHeight(), reinterpret_cast<const Color *>(sourceImg.GetData()));
+		}
+		// the deepest level of the pyramid not below the scale is averaged the rest of the way
+		int level = 0;
+		while ((2 << level) <= scale) {
+			++level;
 		}
+		const std::shared_ptr<const Bitmap> levelBmp = source.getPyramidLevel(level);
+		const double levelScale = scale / static_cast<double>(1 << level);
+		Bitmap scaled(width, height);
+		resampleScale(levelBmp ? *levelBmp : source, scaled, levelScale, levelScale, SF_BOX);
+		wxImage scaledImg(scaledSize);
+		memcpy(scaledImg.GetData(), scaled.getDataPtr(), width * height * sizeof(Color));
 		wxBitmap * downscaledBmp = new wxBitmap(scaledImg);
 		downscaleCache[scale] = downscaledBmp;
 		fullBmp = downscaledBmp;
@@ -654,8 +645,9 @@ void ImagePanel::setOutput(const Bitmap & obmp, int id) {
 		std::lock_guard<std::mutex> lk(bmpMutex);
 		bmp = obmp;
 		histPanel->setImage(bmp);
-		Color * bmpDataPtr = bmp.getDataPtr();
-		wxImage canvasImg(wxSize(obmp.getWidth(), obmp.getHeight()), reinterpret_cast<unsigned char *>(bmpDataPtr), true);
+		// the canvas only copies the pixels, so they are read without dropping the shared pyramid
+		const Color * bmpDataPtr = static_cast<const Bitmap&>(bmp).getDataPtr();
+		wxImage canvasImg(wxSize(obmp.getWidth(), obmp.getHeight()), reinterpret_cast<unsigned char *>(const_cast<Color *>(bmpDataPtr)), true);
 		canvas->setImage(canvasImg, id);
 	}
 }
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+#include "bitmap.h"
+#include "fft_codec.h"
+
+// a smooth gradient with some texture, so the low frequencies carry most of the image
+Bitmap testImage(int width, int height) {
+	Bitmap bmp(width, height);
+	Color * data = bmp.getDataPtr();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			data[y * width + x] = Color(
+				static_cast<uint8>(x * 255 / width),
+				static_cast<uint8>(y * 255 / height),
+				static_cast<uint8>(((x / 4) ^ (y / 4)) & 1 ? 200 : 40)
+				);
+		}
+	}
+	return bmp;
+}
+
+int maxError(const Bitmap& lhs, const Bitmap& rhs) {
+	int error = 0;
+	const Color * lhsData = lhs.getDataPtr();
+	const Color * rhsData = rhs.getDataPtr();
+	for (int i = 0; i < lhs.getDimensionProduct(); ++i) {
+		for (int c = 0; c < 3; ++c) {
+			error = std::max(error, abs(static_cast<int>(lhsData[i][c]) - static_cast<int>(rhsData[i][c])));
+		}
+	}
+	return error;
+}
+
+// encodes and decodes the whole spectrum, so the error is only from the quantization
+template<class T>
+int testRoundTrip(const char * name, const Bitmap& bmp, float quantStep, int maxAllowedError) {
+	std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+	Bitmap decoded;
+	int errors = 0;
+	if (!FFTCodec<T>::encode(bmp, bmp.getWidth(), bmp.getHeight(), quantStep, stream) || !FFTCodec<T>::decode(stream, decoded)) {
+		std::cout << name << " step " << quantStep << ": round trip failed" << std::endl;
+		errors++;
+	} else if (decoded.getWidth() != bmp.getWidth() || decoded.getHeight() != bmp.getHeight()) {
+		std::cout << name << " step " << quantStep << ": wrong dimensions" << std::endl;
+		errors++;
+	} else {
+		const int error = maxError(bmp, decoded);
+		std::cout << name << " step " << quantStep << ": max error " << error << std::endl;
+		if (error > maxAllowedError) {
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char* argv[]) {
+	int errors = 0;
+	const Bitmap bmp = testImage(64, 48);
+	// the quantization error of a coefficient is at most half a step, and a level more comes from the rounding
+	errors += testRoundTrip<double>("double", bmp, 1.0f, 2);
+	errors += testRoundTrip<float>("float", bmp, 1.0f, 2);
+	// the steps too small for the image are raised, instead of wrapping the quantized coefficients
+	for (float quantStep : { 1e-3f, 1e-6f, 1e-7f, 1e-20f }) {
+		errors += testRoundTrip<double>("double", bmp, quantStep, 1);
+		errors += testRoundTrip<float>("float", bmp, quantStep, 1);
+	}
+	// a white image has the largest dc coefficient
+	Bitmap white(64, 48);
+	std::fill(white.getDataPtr(), white.getDataPtr() + white.getDimensionProduct(), Color(255, 255, 255));
+	errors += testRoundTrip<double>("white", white, 1e-9f, 1);
+	std::cout << "Errors: " << errors << std::endl;
+	return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
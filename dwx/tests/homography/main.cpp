@@ -0,0 +1,109 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+
+#include "homography.h"
+
+const double Tolerance = 1e-6;
+
+// every source point must be mapped to its destination point (relative to the size of the coordinates)
+int testMapping(const char * name, const Vector2 src[4], const Vector2 dst[4]) {
+	Homography h;
+	if (!Homography::fromPoints(src, dst, h)) {
+		std::cout << name << ": no transform is found" << std::endl;
+		return 1;
+	}
+	int errors = 0;
+	for (int i = 0; i < 4; ++i) {
+		double x = 0.0, y = 0.0;
+		const double scale = std::fmax(1.0, std::fmax(std::fabs(dst[i].x), std::fabs(dst[i].y)));
+		if (!h.apply(src[i].x, src[i].y, x, y) || std::fabs(x - dst[i].x) > Tolerance * scale || std::fabs(y - dst[i].y) > Tolerance * scale) {
+			std::cout << name << ": point " << i << " is mapped to (" << x << ", " << y << ") instead of (" << dst[i].x << ", " << dst[i].y << ")" << std::endl;
+			errors++;
+		}
+	}
+	// the inverse maps the destination points back and the product of both is the identity
+	Homography inv;
+	if (!h.inverse(inv)) {
+		std::cout << name << ": the transform has no inverse" << std::endl;
+		return errors + 1;
+	}
+	for (int i = 0; i < 4; ++i) {
+		double x = 0.0, y = 0.0;
+		const double scale = std::fmax(1.0, std::fmax(std::fabs(src[i].x), std::fabs(src[i].y)));
+		if (!inv.apply(dst[i].x, dst[i].y, x, y) || std::fabs(x - src[i].x) > Tolerance * scale || std::fabs(y - src[i].y) > Tolerance * scale) {
+			std::cout << name << ": point " << i << " is mapped back to (" << x << ", " << y << ") instead of (" << src[i].x << ", " << src[i].y << ")" << std::endl;
+			errors++;
+		}
+	}
+	const Homography product = inv * h;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			const double expected = (i == j ? product.m[2][2] : 0.0);
+			if (std::fabs(product.m[i][j] - expected) > Tolerance * std::fabs(product.m[2][2])) {
+				std::cout << name << ": the product with the inverse is not the identity at " << i << ", " << j << std::endl;
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+// compares the found transform with the expected one, both scaled so the last element is 1
+int testExpected(const char * name, const Vector2 src[4], const Vector2 dst[4], const Homography& expected) {
+	Homography h;
+	if (!Homography::fromPoints(src, dst, h)) {
+		std::cout << name << ": no transform is found" << std::endl;
+		return 1;
+	}
+	int errors = 0;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			const double value = h.m[i][j] / h.m[2][2];
+			const double expectedValue = expected.m[i][j] / expected.m[2][2];
+			if (std::fabs(value - expectedValue) > Tolerance * std::fmax(1.0, std::fabs(expectedValue))) {
+				std::cout << name << ": element " << i << ", " << j << " is " << value << " instead of " << expectedValue << std::endl;
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+int testDegenerate(const char * name, const Vector2 src[4], const Vector2 dst[4]) {
+	Homography h;
+	if (Homography::fromPoints(src, dst, h) || Homography::fromPoints(dst, src, h)) {
+		std::cout << name << ": a transform is found for degenerate points" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int errors = 0;
+	const Vector2 square[4] = { Vector2(0.0f, 0.0f), Vector2(1.0f, 0.0f), Vector2(1.0f, 1.0f), Vector2(0.0f, 1.0f) };
+	const Vector2 image[4] = { Vector2(0.0f, 0.0f), Vector2(1920.0f, 0.0f), Vector2(1920.0f, 1080.0f), Vector2(0.0f, 1080.0f) };
+	const Vector2 shifted[4] = { Vector2(10.0f, 5.0f), Vector2(3850.0f, 5.0f), Vector2(3850.0f, 2165.0f), Vector2(10.0f, 2165.0f) };
+	const Vector2 quad[4] = { Vector2(120.0f, 40.0f), Vector2(1750.0f, 130.0f), Vector2(1890.0f, 1010.0f), Vector2(35.0f, 940.0f) };
+	const Vector2 keystone[4] = { Vector2(400.0f, 0.0f), Vector2(1520.0f, 0.0f), Vector2(1920.0f, 1080.0f), Vector2(0.0f, 1080.0f) };
+
+	errors += testExpected("identity", square, square, Homography());
+	errors += testExpected("large identity", image, image, Homography());
+	errors += testExpected("scale and shift", image, shifted, Homography(2.0, 0.0, 10.0, 0.0, 2.0, 5.0, 0.0, 0.0, 1.0));
+	errors += testMapping("unit square", square, quad);
+	errors += testMapping("general quad", image, quad);
+	errors += testMapping("keystone", image, keystone);
+	errors += testMapping("inverse keystone", keystone, image);
+
+	const Vector2 collinear[4] = { Vector2(0.0f, 0.0f), Vector2(500.0f, 250.0f), Vector2(1000.0f, 500.0f), Vector2(0.0f, 1080.0f) };
+	const Vector2 nearlyCollinear[4] = { Vector2(0.0f, 0.0f), Vector2(500.0f, 250.0f + 1e-4f), Vector2(1000.0f, 500.0f), Vector2(0.0f, 1080.0f) };
+	const Vector2 coincident[4] = { Vector2(7.0f, 3.0f), Vector2(7.0f, 3.0f), Vector2(7.0f, 3.0f), Vector2(7.0f, 3.0f) };
+	const Vector2 line[4] = { Vector2(0.0f, 0.0f), Vector2(1.0f, 1.0f), Vector2(2.0f, 2.0f), Vector2(3.0f, 3.0f) };
+	errors += testDegenerate("collinear", image, collinear);
+	errors += testDegenerate("nearly collinear", image, nearlyCollinear);
+	errors += testDegenerate("coincident", image, coincident);
+	errors += testDegenerate("line", square, line);
+
+	std::cout << "Errors: " << errors << std::endl;
+	return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
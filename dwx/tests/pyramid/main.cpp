@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "bitmap.h"
+#include "pyramid.h"
+
+// a pattern with all frequencies, so every level of the pyramid has details
+Bitmap testImage(int width, int height) {
+	Bitmap bmp(width, height);
+	Color * data = bmp.getDataPtr();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			data[y * width + x] = Color(
+				static_cast<uint8>((x * 7 + y * 3) & 255),
+				static_cast<uint8>((x * x + y) & 255),
+				static_cast<uint8>(((x ^ y) * 5) & 255)
+				);
+		}
+	}
+	return bmp;
+}
+
+int testLevelCount(int width, int height, int minSide, int expected) {
+	const int count = getPyramidLevelCount(width, height, minSide);
+	if (count != expected) {
+		std::cout << width << "x" << height << " down to " << minSide << ": " << count << " levels instead of " << expected << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+// the levels halve the size of the previous one (rounding up) and the collapse restores the input exactly
+int testReconstruction(int width, int height, int levelCount) {
+	int errors = 0;
+	const Bitmap input = testImage(width, height);
+	LaplacianPyramid pyramid;
+	if (!pyramid.build(input, levelCount)) {
+		std::cout << width << "x" << height << " with " << levelCount << " levels: the build failed" << std::endl;
+		return 1;
+	}
+	const int expectedCount = (levelCount > 0 ?
+		std::min(levelCount, getPyramidLevelCount(width, height, 1)) :
+		getPyramidLevelCount(width, height));
+	if (pyramid.getLevelCount() != expectedCount) {
+		std::cout << width << "x" << height << " with " << levelCount << " levels: " << pyramid.getLevelCount() << " levels instead of " << expectedCount << std::endl;
+		errors++;
+	}
+	int levelWidth = width;
+	int levelHeight = height;
+	for (int k = 0; k < pyramid.getLevelCount(); ++k) {
+		const PyramidImage& level = pyramid.getLevel(k);
+		if (level.width != levelWidth || level.height != levelHeight || level.channels != 3) {
+			std::cout << width << "x" << height << " with " << levelCount << " levels: level " << k << " is " << level.width << "x" << level.height << std::endl;
+			errors++;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+	Bitmap output;
+	pyramid.collapse(output);
+	if (output.getWidth() != width || output.getHeight() != height ||
+		memcmp(input.getDataPtr(), output.getDataPtr(), input.getDimensionProduct() * sizeof(Color)) != 0)
+	{
+		std::cout << width << "x" << height << " with " << levelCount << " levels: the collapse does not restore the image" << std::endl;
+		errors++;
+	}
+	return errors;
+}
+
+// the weights of the reduction and the expansion sum up to one, so a flat image has no details at any level
+int testFlat(int width, int height) {
+	const Color flat(200, 100, 30);
+	const float values[3] = { flat.r, flat.g, flat.b };
+	Bitmap input(width, height);
+	std::fill(input.getDataPtr(), input.getDataPtr() + input.getDimensionProduct(), flat);
+	LaplacianPyramid pyramid;
+	pyramid.build(input, 0);
+	const int last = pyramid.getLevelCount() - 1;
+	for (int k = 0; k <= last; ++k) {
+		const PyramidImage& level = pyramid.getLevel(k);
+		for (size_t i = 0; i < level.data.size(); ++i) {
+			const float expected = (k == last ? values[i % 3] : 0.0f);
+			if (fabs(level.data[i] - expected) > 1e-3f) {
+				std::cout << width << "x" << height << ": level " << k << " of the flat image has " << level.data[i] << " instead of " << expected << std::endl;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	int errors = 0;
+	errors += testLevelCount(1, 1, 1, 1);
+	errors += testLevelCount(2, 2, 1, 2);
+	errors += testLevelCount(15, 100, 8, 1);
+	errors += testLevelCount(16, 16, 8, 2);
+	errors += testLevelCount(64, 48, 8, 3);
+	errors += testLevelCount(37, 23, 1, 6);
+	const int sizes[][2] = { { 64, 48 }, { 37, 23 }, { 101, 7 }, { 2, 3 }, { 1, 1 } };
+	const int levelCounts[] = { 0, 1, 2, 3, 100 };
+	for (const auto& size : sizes) {
+		for (int levelCount : levelCounts) {
+			errors += testReconstruction(size[0], size[1], levelCount);
+		}
+	}
+	errors += testFlat(64, 48);
+	errors += testFlat(37, 23);
+	std::cout << "Errors: " << errors << std::endl;
+	return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
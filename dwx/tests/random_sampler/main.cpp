@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "bitmap.h"
+#include "philox.h"
+#include "random_sampler.h"
+
+// the known answers of Philox4x32-10 from the Random123 distribution (kat_vectors)
+struct PhiloxKat {
+	uint32 counter[4];
+	uint32 key[2];
+	uint32 expected[4];
+};
+
+const PhiloxKat philoxKats[] = {
+	{ { 0x00000000, 0x00000000, 0x00000000, 0x00000000 }, { 0x00000000, 0x00000000 }, { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 } },
+	{ { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0xffffffff, 0xffffffff }, { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd } },
+	{ { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }, { 0xa4093822, 0x299f31d0 }, { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } },
+};
+
+int testPhiloxKats() {
+	int errors = 0;
+	for (const PhiloxKat& kat : philoxKats) {
+		Philox4x32 gen((static_cast<uint64>(kat.key[1]) << 32) | kat.key[0]);
+		gen.seek((static_cast<uint64>(kat.counter[3]) << 32) | kat.counter[2], (static_cast<uint64>(kat.counter[1]) << 32) | kat.counter[0]);
+		for (int i = 0; i < Philox4x32::BlockSize; ++i) {
+			const uint32 value = gen();
+			if (value != kat.expected[i]) {
+				printf("Philox kat %08x: word %d is %08x instead of %08x\n", kat.counter[0], i, value, kat.expected[i]);
+				errors++;
+			}
+		}
+	}
+	return errors;
+}
+
+// discarding words must give the same values as generating them
+int testPhiloxDiscard() {
+	int errors = 0;
+	Philox4x32 reference(12345);
+	reference.seek(7, 0);
+	std::vector<uint32> values(64);
+	for (uint32& value : values) {
+		value = reference();
+	}
+	for (int skip = 0; skip < 16; ++skip) {
+		Philox4x32 gen(12345);
+		gen.seek(7, 0);
+		gen.discard(skip);
+		for (int i = skip; i < skip + 16; ++i) {
+			if (gen() != values[i]) {
+				printf("Philox discard %d: word %d differs\n", skip, i);
+				errors++;
+				break;
+			}
+		}
+	}
+	return errors;
+}
+
+// a fixed seed must give the same image, regardless of the number of workers drawing the chunks
+template<class RandGen, class PointDistribution>
+int testSamplerWorkers(const char * name, const PointDistribution& pd) {
+	const std::vector<uint32> seeds = { 42, 7 };
+	const int64 samples = 3 * RandomBmpSampler<RandGen, PointDistribution>::ChunkSize + 123;
+	const TColor<double> color(1.0, 1.0, 1.0);
+	Pixelmap<TColor<double> > single(97, 61);
+	single.fill(TColor<double>());
+	RandomBmpSampler<RandGen, PointDistribution>(seeds, pd).sample(single, color, samples, nullptr, 1);
+	int errors = 0;
+	for (int workers : { 2, 3, 8 }) {
+		Pixelmap<TColor<double> > multi(97, 61);
+		multi.fill(TColor<double>());
+		RandomBmpSampler<RandGen, PointDistribution>(seeds, pd).sample(multi, color, samples, nullptr, workers);
+		if (memcmp(single.getDataPtr(), multi.getDataPtr(), single.getDimensionProduct() * sizeof(TColor<double>)) != 0) {
+			std::cout << name << ": the image with " << workers << " workers differs from the one with a single worker" << std::endl;
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char* argv[]) {
+	int errors = 0;
+	errors += testPhiloxKats();
+	errors += testPhiloxDiscard();
+	using UniformPoints = IndependentPointDistribution<std::uniform_int_distribution<int>, std::uniform_int_distribution<int> >;
+	const UniformPoints uniform(std::uniform_int_distribution<int>(0, 96), std::uniform_int_distribution<int>(0, 60));
+	using NormalPoints = IndependentPointDistribution<std::normal_distribution<double>, std::normal_distribution<double> >;
+	const NormalPoints normal(std::normal_distribution<double>(48.0, 15.0), std::normal_distribution<double>(30.0, 10.0));
+	errors += testSamplerWorkers<Philox4x32>("philox uniform", uniform);
+	errors += testSamplerWorkers<Philox4x32>("philox normal", normal);
+	errors += testSamplerWorkers<std::mt19937>("mt19937 uniform", uniform);
+	errors += testSamplerWorkers<std::mt19937>("mt19937 normal", normal);
+	errors += testSamplerWorkers<std::minstd_rand>("minstd_rand normal", normal);
+	std::cout << "Errors: " << errors << std::endl;
+	return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
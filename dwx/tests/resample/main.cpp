@@ -0,0 +1,75 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "bitmap.h"
+#include "resample.h"
+
+const char * filterNames[] = { "box", "triangle", "mitchell", "lanczos3" };
+
+// a pattern with all frequencies, so any filtering of the same size changes it
+Bitmap testImage(int width, int height) {
+	Bitmap bmp(width, height);
+	Color * data = bmp.getDataPtr();
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			data[y * width + x] = Color(
+				static_cast<uint8>((x * 7 + y * 3) & 255),
+				static_cast<uint8>((x * x + y) & 255),
+				static_cast<uint8>(((x ^ y) * 5) & 255)
+				);
+		}
+	}
+	return bmp;
+}
+
+// scaling to the same size must return the input unchanged
+int testSameSize(int width, int height) {
+	int errors = 0;
+	const Bitmap input = testImage(width, height);
+	for (int f = SF_BOX; f <= SF_LANCZOS3; ++f) {
+		Bitmap output(width, height);
+		if (!resampleScale(input, output, static_cast<ScaleFilter>(f)) ||
+			memcmp(input.getDataPtr(), output.getDataPtr(), input.getDimensionProduct() * sizeof(Color)) != 0)
+		{
+			std::cout << filterNames[f] << " " << width << "x" << height << ": the same size changes the image" << std::endl;
+			errors++;
+		}
+	}
+	return errors;
+}
+
+// the weights of every output pixel sum up to one, so a flat image stays flat for any size
+int testFlat(int width, int height, int outWidth, int outHeight) {
+	int errors = 0;
+	const Color flat(200, 100, 30);
+	Bitmap input(width, height);
+	std::fill(input.getDataPtr(), input.getDataPtr() + input.getDimensionProduct(), flat);
+	for (int f = SF_BOX; f <= SF_LANCZOS3; ++f) {
+		Bitmap output(outWidth, outHeight);
+		bool isFlat = resampleScale(input, output, static_cast<ScaleFilter>(f));
+		const Color * outData = output.getDataPtr();
+		for (int i = 0; i < output.getDimensionProduct() && isFlat; ++i) {
+			isFlat = (outData[i].r == flat.r && outData[i].g == flat.g && outData[i].b == flat.b);
+		}
+		if (!isFlat) {
+			std::cout << filterNames[f] << " " << width << "x" << height << " to " << outWidth << "x" << outHeight << ": the flat image changes" << std::endl;
+			errors++;
+		}
+	}
+	return errors;
+}
+
+int main(int argc, char* argv[]) {
+	int errors = 0;
+	errors += testSameSize(64, 48);
+	errors += testSameSize(1, 1);
+	errors += testSameSize(37, 3);
+	errors += testFlat(64, 48, 64, 48);
+	errors += testFlat(64, 48, 17, 13);
+	errors += testFlat(64, 48, 1, 1);
+	errors += testFlat(64, 48, 200, 31);
+	errors += testFlat(3, 5, 97, 61);
+	std::cout << "Errors: " << errors << std::endl;
+	return (errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}